@@ -8,6 +8,80 @@ import scipy.stats
 import sqlite3
 import os
 
+# Columnar sidecar for rocpd_op, see RaptorParser.get_op_df
+_op_cache_version = 1
+_op_cache_int_cols = ['id', 'gpuId', 'queueId', 'sequenceId', 'start', 'end']
+
+def _read_op_columns(con):
+    """
+    Read rocpd_op as numpy columns sorted by start.  Kernel names and op types
+    are stored as codes into the 'kernels' and 'opTypes' lists, keyed by their
+    rocpd_string id.
+    """
+    chunks = []
+    cur = con.execute("select id, gpuId, queueId, sequenceId, start, end, description_id, opType_id "
+                      "from rocpd_op order by start, id")
+    while True:
+        rows = cur.fetchmany(1 << 20)
+        if not rows:
+            break
+        chunks.append(np.array(rows, dtype=np.int64))
+    table = np.concatenate(chunks) if chunks else np.zeros((0, 8), dtype=np.int64)
+
+    strings = dict(con.execute("select id, string from rocpd_string where id in "
+                               "(select description_id from rocpd_op union select opType_id from rocpd_op)"))
+    string_ids = np.array(sorted(strings.keys()), dtype=np.int64)
+
+    # The op view inner-joins rocpd_string, so rows with a dangling id drop out
+    table = table[np.isin(table[:, 6], string_ids) & np.isin(table[:, 7], string_ids)]
+
+    cols = {name : np.ascontiguousarray(table[:, i]) for i, name in enumerate(_op_cache_int_cols)}
+    kernel_ids, cols['kernel'] = np.unique(table[:, 6], return_inverse=True)
+    op_type_ids, cols['opType'] = np.unique(table[:, 7], return_inverse=True)
+    cols['kernel'] = cols['kernel'].astype(np.int32)
+    cols['opType'] = cols['opType'].astype(np.int32)
+    meta = {
+        'kernels' : [strings[i] for i in kernel_ids.tolist()],
+        'opTypes' : [strings[i] for i in op_type_ids.tolist()],
+    }
+    return cols, meta
+
+def _source_stamp(path):
+    st = os.stat(path)
+    return {'version' : _op_cache_version, 'mtime_ns' : st.st_mtime_ns, 'size' : st.st_size}
+
+def _load_op_cache(cache_dir, stamp):
+    """ Memory-map a sidecar written for this exact source file, or return None """
+    import json
+    try:
+        with open(os.path.join(cache_dir, "meta.json")) as f:
+            meta = json.load(f)
+        if meta.get('source') != stamp:
+            return None
+        cols = {name : np.load(os.path.join(cache_dir, name + ".npy"), mmap_mode='r')
+                for name in _op_cache_int_cols + ['kernel', 'opType']}
+        return cols, meta
+    except (OSError, ValueError):
+        return None
+
+def _write_op_cache(cache_dir, stamp, cols, meta):
+    """ Columns first, meta.json last, so a partial sidecar never validates """
+    import json
+    try:
+        os.makedirs(cache_dir, exist_ok=True)
+        meta_file = os.path.join(cache_dir, "meta.json")
+        if os.path.exists(meta_file):
+            os.remove(meta_file)
+        for name, col in cols.items():
+            np.save(os.path.join(cache_dir, name + ".npy"), col)
+        tmp = meta_file + ".tmp"
+        with open(tmp, "w") as f:
+            json.dump(dict(meta, source=stamp), f)
+        os.replace(tmp, meta_file)
+    except OSError as e:
+        print (f"warning: could not write op cache {cache_dir}: {e}")
+
+
 @dataclass
 class RaptorParser:
     # usage_doc is also shown in the raptor.py script usage:
@@ -72,6 +146,10 @@ class RaptorParser:
 
     tmp_file : str = None
 
+    # Keep rocpd_op in a columnar sidecar next to the rpd (<rpd_file>.raptor/)
+    op_cache : bool = True
+    op_columns : dict = None
+
     # Special internal category names:
     _other_cat = "_Other"
     _gpu_idle_cat = "_GPU_Idle"
@@ -99,6 +177,12 @@ class RaptorParser:
                         with open(tmp_path, "wb") as f_out:
                             f_out.write(f_in.read())
                     self.con = sqlite3.connect(tmp_path)
+                elif extension == '.rpdz':
+                    from rocpd.compress import unpack
+                    tmp_path = tempfile.NamedTemporaryFile(delete=True).name
+                    self.tmp_file = tmp_path
+                    unpack(self.rpd_file, tmp_path)
+                    self.con = sqlite3.connect(tmp_path)
                 else:
                     self.con = sqlite3.connect(self.rpd_file)
             else:
@@ -199,47 +283,29 @@ class RaptorParser:
         """
         Trim the source RPD to the current ROI. 
         If inplace is specified, the on-disk file is modified.
+        The in-window rows are copied forward into a new file (see rocpd.trim),
+        so there is no delete + vacuum pass over the whole trace.
         """
-        if not inplace:
-            import pathlib,shutil
+        from rocpd.trim import trimToWindow, trimInPlace
+
+        start_ns = self.roi_start_ns + self.first_abs_ns
+        end_ns = self.roi_end_ns + self.first_abs_ns
+        # .gz and .rpdz inputs are read from their unpacked temporary copy
+        source = self.tmp_file if self.tmp_file else self.rpd_file
+
+        if inplace:
+            self.con.close()
+            trimInPlace(source, start_ns, end_ns)
+            self.con = sqlite3.connect(source)
+            # An unpacked copy no longer matches the sidecar of its archive
+            if self.tmp_file:
+                self.op_cache = False
+            self.op_columns = None
+        else:
             if new_file_name is None:
                 new_file_name = pathlib.PurePath(self.rpd_file).with_suffix(".trim.rpd")
                 print (f"{new_file_name}")
-                shutil.copy2(self.rpd_file, new_file_name)
-                
-            if os.path.isfile(new_file_name):
-                connection = sqlite3.connect(new_file_name)
-            else:
-                raise RuntimeError ("RPD file '" + new_file_name + "' does not exist.")
-        else:
-            connection = self.con
-
-        connection.execute("delete from rocpd_api where start < %d or start > %d" % \
-                            (self.roi_start_ns, self.roi_end_ns))
-        connection.execute("delete from rocpd_api_ops where api_id not in (select id from rocpd_api)")
-        connection.execute("delete from rocpd_op where id not in (select op_id from rocpd_api_ops)")
-        try:
-            connection.execute("delete from rocpd_monitor where start < (select min(start) from rocpd_api) or start > (select max(end) from rocpd_op)")
-        except:
-            pass
-
-        connection.commit()
-
-        #clear any unused strings
-        if 0:
-            stringCount = connection.execute("select count(*) from rocpd_string").fetchall()[0][0]
-            from rocpd.importer import RocpdImportData
-            from rocpd.strings import cleanStrings
-            importData = RocpdImportData()
-            importData.resumeExisting(connection) # load the current db state
-            cleanStrings(importData, False)
-            stringRemaingCount = connection.execute("select count(*) from rocpd_string").fetchall()[0][0]
-            print(f"Removed {stringCount - stringRemaingCount} of {stringCount} strings.  {stringRemaingCount} remaining")
-
-        connection.isolation_level = None
-        connection.execute("vacuum")
-        connection.commit()
-        connection.close()
+            trimToWindow(source, str(new_file_name), start_ns, end_ns)
 
     # translate text tag to number of ns
     _time_units = {
@@ -335,7 +401,8 @@ class RaptorParser:
         op_df.rename(columns={'start' : 'Start_ns', 'end' : 'End_ns',
                               'description':'Kernel'}, inplace=True)
 
-        op_df.sort_values(['gpuId', 'Start_ns'], ascending=True, inplace=True)
+        # stable like sort_values, without factorizing every start time
+        op_df = op_df.iloc[np.lexsort((op_df['Start_ns'].values, op_df['gpuId'].values))]
         op_df = op_df.reset_index()
         op_df.index += 1
 
@@ -343,7 +410,7 @@ class RaptorParser:
 
         # expanding.max computes a running max of end times - so commands that
         # finish out-of-order (with an earlier end) do not move end time.
-        op_df['PreGap_ns'] = (op_df['Start_ns'] -  gpu_group['End_ns'].transform(lambda x : x.shift(1).expanding().max())).clip(lower=0)
+        op_df['PreGap_ns'] = (op_df['Start_ns'] - gpu_group['End_ns'].shift(1).groupby(op_df['gpuId']).cummax()).clip(lower=0)
         op_df['sequenceId'] = gpu_group.cumcount() + 1
 
         if set_roi:
@@ -356,6 +423,40 @@ class RaptorParser:
 
         return self.op_df
 
+    def get_op_columns(self, force=False):
+        """
+        All of rocpd_op as numpy columns sorted by start, with kernel names and
+        op types as codes into meta['kernels'] / meta['opTypes'].
+        With op_cache set these are memory-mapped from a sidecar that is
+        rebuilt whenever the rpd file's mtime or size changes.
+        """
+        if self.op_columns is None or force:
+            cache_dir = self.rpd_file + ".raptor"
+            stamp = _source_stamp(self.rpd_file)
+            cached = _load_op_cache(cache_dir, stamp) if self.op_cache and not force else None
+            if cached is None:
+                cached = _read_op_columns(self.con)
+                if self.op_cache:
+                    _write_op_cache(cache_dir, stamp, *cached)
+                    cached = _load_op_cache(cache_dir, stamp) or cached
+            self.op_columns = cached
+        return self.op_columns
+
+    def _get_roi_ops(self):
+        """ Equivalent of "select * from op <sql_filter_str> order by start" """
+        cols, meta = self.get_op_columns()
+        start = cols['start']
+        lo = np.searchsorted(start, self.roi_start_ns + self.first_abs_ns, side='left')
+        hi = np.searchsorted(start, self.roi_end_ns + self.first_abs_ns, side='right')
+        keep = slice(lo, hi)
+        if self.gpu_id != -1:
+            keep = lo + np.flatnonzero(cols['gpuId'][lo:hi] == self.gpu_id)
+
+        op_df = pd.DataFrame({name : np.asarray(cols[name][keep]) for name in _op_cache_int_cols})
+        op_df['description'] = np.array(meta['kernels'], dtype=object)[cols['kernel'][keep]]
+        op_df['opType'] = np.array(meta['opTypes'], dtype=object)[cols['opType'][keep]]
+        return op_df
+
     def get_op_df(self, force=False, kernel_name: str = None):
         """ 
         Read the op table from the sql input into op_df.
@@ -363,8 +464,7 @@ class RaptorParser:
         """
 
         if self.op_df is None or force:
-            ops_query = "select * from op %s order by start ASC " % self.sql_filter_str()
-            op_df = pd.read_sql_query(ops_query, self.con) 
+            op_df = self._get_roi_ops()
 
             op_df = op_df[op_df['opType'].isin(['KernelExecution', 'CopyDeviceToDevice', 'Task'])]
 
@@ -452,23 +552,48 @@ class RaptorParser:
         self.gpu_ts_df = gpu_ts_df
         return self.gpu_ts_df
 
-    def _get_kernelseq_df(self, op_df:pd.DataFrame):
-        if self.prekernel_seq:
-            self.kernel_cols = ['Kernel']
-            for i in range(self.prekernel_seq):
-                shift_col_name = "Kernel+%d" % (i+1)
-                self.kernel_cols.append(shift_col_name)
-                op_df[shift_col_name] = op_df['Kernel'].shift(i+1)
-        else:
-            self.kernel_cols = ['Kernel']
+    def _kernelseq_keys(self, op_df:pd.DataFrame):
+        """
+        Dense integer id for each op's kernel sequence (Kernel, Kernel+1, ...),
+        numbered in order of first appearance, built from integer kernel ids
+        rather than tuples of strings.  Ops whose sequence runs off the start
+        of the trace get -1.
+        """
+        codes, uniques = pd.factorize(op_df['Kernel'])
+        key = codes.astype(np.int64)
+        for i in range(self.prekernel_seq):
+            shifted = np.full(len(codes), -1, dtype=np.int64)
+            shifted[i+1:] = codes[:len(codes)-i-1]
+            valid = (key >= 0) & (shifted >= 0)
+            # key < rows and shifted < kernels, so the pair fits in an int64
+            # and is re-densified before the next step
+            pair = key[valid] * (len(uniques) + 1) + shifted[valid]
+            key = np.full(len(codes), -1, dtype=np.int64)
+            key[valid] = pd.factorize(pair)[0]
+        return key
 
-        top_gb_all = op_df.groupby(self.kernel_cols, sort=False)
+    def _get_kernelseq_df(self, op_df:pd.DataFrame):
+        self.kernel_cols = ['Kernel']
+        for i in range(self.prekernel_seq):
+            shift_col_name = "Kernel+%d" % (i+1)
+            self.kernel_cols.append(shift_col_name)
+            op_df[shift_col_name] = op_df['Kernel'].shift(i+1)
+
+        key = self._kernelseq_keys(op_df)
+        key = pd.Series(pd.array(np.where(key >= 0, key, 0), dtype="Int64"), index=op_df.index).mask(key < 0)
+        top_gb_all = op_df.groupby(key, sort=False)
         self.top_gb_all = top_gb_all
 
-        op_df['Duration_zscore'] = top_gb_all['Duration_ns'].transform(lambda x : 0 if len(x)==1 else scipy.stats.zscore(x))
+        # scipy.stats.zscore per group (population std), 0 for single-op groups
+        duration = op_df['Duration_ns'].astype(float)
+        deviation = duration - top_gb_all['Duration_ns'].transform('mean')
+        std = np.sqrt((deviation ** 2).groupby(key, sort=False).transform('mean'))
+        with np.errstate(divide='ignore', invalid='ignore'):
+            zscore = deviation / std
+        op_df['Duration_zscore'] = zscore.where(top_gb_all['Duration_ns'].transform('size') != 1, 0)
         op_df['Outlier'] = False if self.zscore_threshold == -1 else (abs(op_df['Duration_zscore']) >= self.zscore_threshold)
 
-        top_gb_filter = op_df[~op_df['Outlier']].groupby(self.kernel_cols, sort=False)
+        top_gb_filter = op_df[~op_df['Outlier']].groupby(key[~op_df['Outlier']], sort=False)
 
         agg_ops = {
             'Start_ns' : ['min', 'max'],
@@ -481,6 +606,15 @@ class RaptorParser:
         kernelseq_df['Outliers'] = (top_gb_all.size() - top_gb_filter.size()).astype("Int64")
         kernelseq_df['TotalCalls'] = top_gb_filter.size()
 
+        # Name each sequence from its first op
+        first_rows = pd.Series(np.arange(len(op_df)), index=op_df.index).groupby(key, sort=False).first()
+        first_rows = first_rows.loc[kernelseq_df.index].values
+        if self.prekernel_seq:
+            kernelseq_df.index = pd.MultiIndex.from_arrays(
+                [op_df[col].values[first_rows] for col in self.kernel_cols], names=self.kernel_cols)
+        else:
+            kernelseq_df.index = pd.Index(op_df['Kernel'].values[first_rows], name='Kernel')
+
         # Gaps:
         # Extract pre-gap info from each command and create separate rows 
         # in the kernelseq_df summary.
@@ -649,13 +783,16 @@ class RaptorParser:
 
         # Set kernelseq_df.cat.  
         # For overlapping patterns, the LAST one wins
-        kernelseq_df['Category'] = self._other_cat
+        # Patterns are matched once per distinct kernel name, not per sequence
+        codes, names = pd.factorize(kernelseq_df.index.str[0])
+        names = pd.Series(names)
+        category = np.full(len(names), self._other_cat, dtype=object)
         for category_name,pat_list in categories.items():
-            mask = pd.Series(False, index=kernelseq_df.index)
+            mask = np.zeros(len(names), dtype=bool)
             for pat in pat_list:
-                mask |= kernelseq_df.index.str[0].str.contains(pat=pat, regex=True)
-            if len(mask):
-                kernelseq_df.loc[mask, 'Category'] = category_name
+                mask |= names.str.contains(pat=pat, regex=True).to_numpy(dtype=bool, na_value=False)
+            category[mask] = category_name
+        kernelseq_df['Category'] = category[codes]
 
     def get_category_per_gpu_df(self, categories:Dict=None,
                                 variability_method=None, duration_units='ms'):
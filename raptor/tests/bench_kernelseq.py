@@ -0,0 +1,69 @@
+# Benchmark op_df post-processing (PreGap, kernel sequences, zscore) on a
+# synthetic trace.  Not collected by pytest; run directly:
+#   python3 tests/bench_kernelseq.py --ops 5000000
+
+import sys
+import os
+sys.path.append(os.path.dirname(os.path.abspath(__file__)) + "/../")
+
+from raptor_parser import RaptorParser
+import argparse
+import time
+import numpy as np
+import pandas as pd
+
+
+def make_op_df(ops, gpus, kernels, seed=0):
+    """
+    A model step (a fixed run of kernels) repeated on every gpu, with a few
+    substituted kernels and duration outliers so sequences and zscores vary.
+    """
+    rng = np.random.default_rng(seed)
+    names = np.array(["Cijk_Ailk_Bljk_SB_MT%dx%dx16_kernel_%d" % (64 << (i % 3), 32 << (i % 2), i)
+                      for i in range(kernels)], dtype=object)
+    step = rng.integers(0, kernels, 4 * kernels)
+    kernel = np.resize(step, ops)
+    swap = rng.random(ops) < 0.01
+    kernel[swap] = rng.integers(0, kernels, swap.sum())
+
+    base = rng.integers(2000, 200000, kernels)
+    duration = (base[kernel] * rng.normal(1.0, 0.05, ops)).astype(np.int64).clip(min=1)
+    slow = rng.random(ops) < 0.001
+    duration[slow] *= 5
+
+    gpu = np.arange(ops) % gpus
+    gap = rng.integers(0, 2000, ops)
+    start = np.zeros(ops, dtype=np.int64)
+    for g in range(gpus):
+        on_gpu = gpu == g
+        start[on_gpu] = np.cumsum(duration[on_gpu] + gap[on_gpu]) - duration[on_gpu]
+    return pd.DataFrame({
+        'start' : start,
+        'end' : start + duration,
+        'gpuId' : gpu,
+        'Kernel' : names[kernel],
+    })
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Time raptor op_df post-processing on a synthetic trace')
+    parser.add_argument('--ops', type=int, default=5000000)
+    parser.add_argument('--gpus', type=int, default=8)
+    parser.add_argument('--kernels', type=int, default=200)
+    parser.add_argument('--prekernel-seq', type=int, default=2)
+    parser.add_argument('--zscore', type=int, default=3)
+    args = parser.parse_args()
+
+    t0 = time.time()
+    op_df = make_op_df(args.ops, args.gpus, args.kernels)
+    t1 = time.time()
+    print ("synthetic op_df  : %8.2fs  (%d ops, %d gpus, %d kernels)" % (t1 - t0, args.ops, args.gpus, args.kernels))
+
+    raptor = RaptorParser(prekernel_seq=args.prekernel_seq, zscore_threshold=args.zscore)
+    raptor.set_op_df(op_df, set_roi=True)
+    t2 = time.time()
+    print ("set_op_df        : %8.2fs" % (t2 - t1))
+
+    kernelseq_df = raptor.get_kernelseq_df()
+    t3 = time.time()
+    print ("get_kernelseq_df : %8.2fs  (%d sequences, %d outliers)" % (t3 - t2, len(kernelseq_df), raptor.get_op_df()['Outlier'].sum()))
@@ -19,71 +19,254 @@
 * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 * THE SOFTWARE.
 ********************************************************************************/
+// Control channel for the tracer.  A thread listens on a per process unix domain socket,
+//   $RPDT_CONTROL_DIR/rpd-<pid>.sock (default /tmp), and drives the tracer through its C api.
+//   One command per connection, one line in, reply out.  See rpdRemote.py
+//     start | stop | flush | capture <seconds> | filter <spec> | dump | stats
+//   Replies start with "ok" or "error <reason>"
+
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <chrono>
 #include <dlfcn.h>
-#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 
 static void remoteInit() __attribute__((constructor));
+static void remoteFinalize() __attribute__((destructor));
 
 namespace {
-    bool init = false;
-    int refCount = 0;
-    void (*dl) = nullptr;
+    bool tracing = false;
+    void *dl = nullptr;
+    int listenFd = -1;          // set before the control thread starts, closed after it is joined
+    int wakeFds[2] = {-1, -1};  // pipe, wakes the control thread to exit
+    std::atomic<bool> running {false};
+    std::thread *controlThread = nullptr;
+    pid_t ownerPid = 0;         // forked children inherit the fds but not the thread or socket
+    char socketPath[sizeof(sockaddr_un::sun_path)];    // plain storage, still valid in the destructor
+    int64_t captureEnd = 0;     // ms, steady clock.  0 if no capture window
+    uint64_t commandCount = 0;
+
+    int64_t now()
+    {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    void *symbol(const char *name)
+    {
+        if (dl == nullptr)
+            dl = dlopen("librpd_tracer.so", RTLD_LAZY);
+        return dl ? dlsym(dl, name) : nullptr;
+    }
+
+    bool call(const char *name)
+    {
+        void (*func) (void) = reinterpret_cast<void(*)()>(symbol(name));
+        if (func == nullptr)
+            return false;
+        func();
+        return true;
+    }
 };
 
-void startTracing(int sig);
-void stopTracing(int sig);
+static void controlLoop();
+static std::string handleCommand(const std::string &line);
 
 void remoteInit()
 {
-    fprintf(stderr, "rpdRemote: init()\n");
-    signal(SIGUSR1, startTracing);
-    signal(SIGUSR2, stopTracing);
+    const char *dir = getenv("RPDT_CONTROL_DIR");
+    const std::string path = std::string(dir ? dir : "/tmp") + "/rpd-" + std::to_string(getpid()) + ".sock";
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "rpdRemote: socket path too long: %s\n", path.c_str());
+        return;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    strncpy(socketPath, addr.sun_path, sizeof(socketPath));
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socketPath);     // stale, pids get reused
+    // Owner only from the moment the socket exists, no window before a chmod
+    const mode_t mask = umask(0077);
+    const bool bound = listenFd >= 0 && bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    umask(mask);
+    if (bound == false
+        || listen(listenFd, 16) < 0
+        || pipe2(wakeFds, O_CLOEXEC) < 0) {
+        fprintf(stderr, "rpdRemote: unable to listen on %s: %s\n", socketPath, strerror(errno));
+        if (bound)
+            unlink(socketPath);
+        if (listenFd >= 0)
+            close(listenFd);
+        listenFd = -1;
+        return;
+    }
+
+    fprintf(stderr, "rpdRemote: listening on %s\n", socketPath);
+    running = true;
+    ownerPid = getpid();
+    controlThread = new std::thread(controlLoop);
 }
 
-void startTracing(int sig)
+void remoteFinalize()
 {
-    signal(SIGUSR1, startTracing);
-    if (refCount > 0)
+    if (controlThread == nullptr)
+        return;
+
+    if (getpid() != ownerPid) {
+        // Forked child: the socket and thread belong to the parent
+        close(listenFd);
+        close(wakeFds[0]);
+        close(wakeFds[1]);
         return;
-    if (dl == nullptr) {
-        dl = dlopen("librpd_tracer.so", RTLD_LAZY);
     }
-    if (dl) {
-        void (*start_func) (void) = reinterpret_cast<void(*)()>(dlsym(dl, "rpdstart"));
-        if (start_func) {
-            fprintf(stderr, "rpdRemote: tracing started\n");
-            start_func();
+
+    running = false;
+    char c = 0;
+    write(wakeFds[1], &c, 1);
+    controlThread->join();      // a command in flight is bounded by the 1 s socket timeouts
+    delete controlThread;
+    controlThread = nullptr;
+
+    unlink(socketPath);
+    close(listenFd);
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+    listenFd = -1;
+}
+
+void controlLoop()
+{
+    while (running) {
+        // Wake up for connections, the end of a capture window or shutdown
+        int timeout = -1;
+        if (captureEnd > 0)
+            timeout = std::max<int64_t>(captureEnd - now(), 0);
+        pollfd pfds[2] = { { listenFd, POLLIN, 0 }, { wakeFds[0], POLLIN, 0 } };
+        int ret = poll(pfds, 2, timeout);
+
+        if (running == false)
+            break;
+
+        if (captureEnd > 0 && now() >= captureEnd)
+            handleCommand("stop");
+
+        if (ret <= 0 || (pfds[0].revents & POLLIN) == 0)
+            continue;
+
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+
+        // Don't let a stalled client wedge the channel
+        timeval tv = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        std::string line;
+        char buff[4096];
+        while (line.find('\n') == std::string::npos && line.size() < 65536) {
+            ssize_t count = read(fd, buff, sizeof(buff));
+            if (count <= 0)
+                break;
+            line.append(buff, count);
         }
-        else {
-            fprintf(stderr, "rpdRemote: tracing failed\n");
+        line = line.substr(0, line.find('\n'));
+        if (line.empty() == false) {
+            std::string reply = handleCommand(line) + "\n";
+            write(fd, reply.data(), reply.size());
         }
+        close(fd);
     }
-    ++refCount;
 }
 
-void stopTracing(int sig)
+std::string handleCommand(const std::string &line)
 {
-    signal(SIGUSR2, stopTracing);
-    if (refCount > 1)
-        return;
-    if (dl) {
-        void (*stop_func) (void) = reinterpret_cast<void(*)()>(dlsym(dl, "rpdstop"));
-        if (stop_func) {
+    ++commandCount;
+    const size_t split = line.find(' ');
+    const std::string command = line.substr(0, split);
+    const std::string arg = (split == std::string::npos) ? "" : line.substr(split + 1);
+
+    if (command == "start") {
+        captureEnd = 0;
+        if (tracing == false) {
+            if (call("rpdstart") == false)
+                return "error tracer not loaded";
+            tracing = true;
+            fprintf(stderr, "rpdRemote: tracing started\n");
+        }
+        return "ok";
+    }
+    else if (command == "stop") {
+        captureEnd = 0;
+        if (tracing) {
+            call("rpdstop");
+            call("rpdflush");
+            tracing = false;
             fprintf(stderr, "rpdRemote: tracing stopped\n");
-            stop_func();
         }
-        void (*flush_func) (void) = reinterpret_cast<void(*)()>(dlsym(dl, "rpdflush"));
-        if (flush_func) {
-            fprintf(stderr, "rpdRemote: trace flushed\n");
-            flush_func();
+        return "ok";
+    }
+    else if (command == "flush") {
+        if (call("rpdflush") == false)
+            return "error tracer not loaded";
+        return "ok";
+    }
+    else if (command == "capture") {
+        const double seconds = atof(arg.c_str());
+        if (seconds <= 0)
+            return "error usage: capture <seconds>";
+        std::string reply = handleCommand("start");
+        if (reply != "ok")
+            return reply;
+        captureEnd = now() + int64_t(seconds * 1000);
+        return "ok capturing for " + arg + " s";
+    }
+    else if (command == "filter") {
+        int (*filter_func) (const char*) = reinterpret_cast<int(*)(const char*)>(symbol("rpd_setApiFilter"));
+        if (filter_func == nullptr)
+            return "error tracer not loaded";
+        if (arg.empty())
+            return "error usage: filter <spec>";
+        if (filter_func(arg.c_str()) != 0)
+            return "error filter not applied: " + arg;
+        return "ok";
+    }
+    else if (command == "dump") {
+        // Flight recorder window, see RPDT_RECORDER
+        if (call("rpd_recorderDump") == false)
+            return "error tracer not loaded";
+        return "ok";
+    }
+    else if (command == "stats") {
+        std::string reply = "ok";
+        reply += "\npid=" + std::to_string(getpid());
+        reply += "\ntracing=" + std::to_string(tracing ? 1 : 0);
+        reply += "\ncapture_remaining_ms=" + std::to_string(captureEnd > 0 ? std::max<int64_t>(captureEnd - now(), 0) : 0);
+        reply += "\ncommands=" + std::to_string(commandCount);
+        int (*stats_func) (char*, int) = reinterpret_cast<int(*)(char*, int)>(symbol("rpd_getStats"));
+        if (stats_func != nullptr) {
+            std::string stats(stats_func(nullptr, 0) + 1, '\0');
+            const int length = stats_func(&stats[0], stats.size());
+            stats.resize(std::min<size_t>(length, stats.size() - 1));
+            reply += "\ntracer=" + stats;
         }
-        // FIXME unloading is tricky, so don't
-#if 0
-        int ret = dlclose(dl);
-        if (ret == 0)
-            dl = nullptr;
-#endif
-        --refCount;
+        return reply;
     }
+    return "error unknown command: " + command;
 }
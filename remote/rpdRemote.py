@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2021 - 2024 Advanced Micro Devices, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+################################################################################
+
+#
+# Control processes running librpd_remote.so through their control sockets
+#   rpdRemote <start | stop | flush | dump | stats> [pid ...]
+#   rpdRemote capture <seconds> [pid ...]
+#   rpdRemote filter <spec> [pid ...]
+# With no pids, every process on the node with a control socket is sent the command, in parallel
+#
+
+import argparse
+import glob
+import os
+import re
+import socket
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+COMMANDS = ['start', 'stop', 'flush', 'dump', 'stats', 'capture', 'filter']
+TAKES_ARG = ['capture', 'filter']
+
+
+def socketPath(directory, pid):
+    return os.path.join(directory, f"rpd-{pid}.sock")
+
+
+def findPids(directory):
+    pids = []
+    for path in glob.glob(socketPath(directory, "*")):
+        match = re.match(r"rpd-(\d+)\.sock$", os.path.basename(path))
+        if match == None:
+            continue
+        pid = int(match.group(1))
+        try:
+            os.kill(pid, 0)
+        except ProcessLookupError:
+            continue    # stale socket
+        except PermissionError:
+            pass
+        pids.append(pid)
+    return sorted(pids)
+
+
+def send(directory, pid, line, timeout):
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.settimeout(timeout)
+            sock.connect(socketPath(directory, pid))
+            sock.sendall((line + "\n").encode())
+            reply = b""
+            while True:
+                data = sock.recv(4096)
+                if not data:
+                    break
+                reply += data
+            return reply.decode().strip()
+    except OSError as e:
+        return f"error {e}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Control processes traced with librpd_remote.so')
+    parser.add_argument('command', choices=COMMANDS)
+    parser.add_argument('args', nargs='*', help='<seconds> for capture, <spec> for filter, then pids (default: all on this node)')
+    parser.add_argument('--dir', default=os.getenv("RPDT_CONTROL_DIR", "/tmp"), help='control socket directory (default: $RPDT_CONTROL_DIR or /tmp)')
+    parser.add_argument('--timeout', type=float, default=30.0, help='seconds to wait for each process')
+    args = parser.parse_args()
+
+    line = args.command
+    rest = args.args
+    if args.command in TAKES_ARG:
+        if len(rest) == 0:
+            parser.error(f"{args.command} needs an argument")
+        line = f"{args.command} {rest[0]}"
+        rest = rest[1:]
+
+    try:
+        pids = [int(pid) for pid in rest] if rest else findPids(args.dir)
+    except ValueError:
+        parser.error("pids must be integers")
+    if len(pids) == 0:
+        print(f"rpdRemote: no control sockets found in {args.dir}", file=sys.stderr)
+        return 1
+
+    with ThreadPoolExecutor(max_workers=len(pids)) as pool:
+        replies = list(pool.map(lambda pid: send(args.dir, pid, line, args.timeout), pids))
+
+    failed = 0
+    for pid, reply in zip(pids, replies):
+        for text in reply.splitlines():
+            print(f"{pid}: {text}")
+        if reply.startswith("ok") == False:
+            failed += 1
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
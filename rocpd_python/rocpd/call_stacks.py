@@ -51,7 +51,7 @@ def generateCallStacks(imp):
                 gpu_time = 0 if row[3] == None else row[3]
                 for span in stack:
                     depth = depth - 1
-                    if (depth > 0):
+                    if (depth < len(stack) - 1):    # every caller, including the outermost
                         stack[depth].child_cpu_time = stack[depth].child_cpu_time + cpu_time
                     call_inserts.append((count, span.id, row[0], depth, cpu_time, gpu_time))
                     count = count + 1
@@ -92,7 +92,7 @@ if __name__ == "__main__":
   connection = sqlite3.connect(args.input_rpd)
 
   importData = RocpdImportData()
-  importData.resumeExisting(connection) # load the current db state
+  importData.resumeExisting(connection, lazy=True) # strings are looked up on demand
 
   createCallStackTable(importData)
   generateCallStacks(importData)
@@ -0,0 +1,256 @@
+################################################################################
+# Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+################################################################################
+
+
+#
+#   Compressed rpd files (.rpdz)
+#
+#       The sqlite file is cut into fixed size chunks that are compressed independently,
+#       in parallel, followed by an index.  Readers unpack to a cached sqlite file and open
+#       that, so every tool keeps working on plain sqlite.
+#
+#       python3 -m rocpd.compress pack trace.rpd [trace.rpdz]
+#       python3 -m rocpd.compress unpack trace.rpdz [trace.rpd]
+#       python3 -m rocpd.compress info trace.rpdz
+#       python3 -m rocpd.compress bench trace.rpd
+#
+#   Layout (little endian):
+#       header  'RPDZ' version:u8 codec:u8 level:u8 pad:u8 chunkSize:u32 rawSize:u64
+#       chunks
+#       index   per chunk: offset:u64 compressedSize:u32 rawSize:u32 crc32:u32
+#       footer  indexOffset:u64 chunkCount:u32 'RPDZ'
+#
+
+import os
+import sys
+import time
+import zlib
+import lzma
+import struct
+import sqlite3
+import pathlib
+import hashlib
+import argparse
+import tempfile
+from collections import deque
+from concurrent.futures import ThreadPoolExecutor
+
+MAGIC = b'RPDZ'
+VERSION = 1
+HEADER = struct.Struct('<4sBBBBIQ')
+INDEX = struct.Struct('<QIII')
+FOOTER = struct.Struct('<QI4s')
+DEFAULT_CHUNK = 4 * 1024 * 1024
+
+# codec id -> (name, compress(data, level), decompress(data))
+CODECS = {
+    1: ('zlib', lambda data, level: zlib.compress(data, level), zlib.decompress),
+    3: ('lzma', lambda data, level: lzma.compress(data, preset=level), lzma.decompress),
+}
+try:
+    import zstandard
+    CODECS[2] = ('zstd', lambda data, level: zstandard.ZstdCompressor(level=level).compress(data),
+                 lambda data: zstandard.ZstdDecompressor().decompress(data))
+except ImportError:
+    pass
+
+# zlib 1 packs ~3x faster than 6 for ~1% more size on rpd files
+DEFAULT_LEVEL = {'zlib': 1, 'zstd': 3, 'lzma': 0}
+
+
+def codecId(name):
+    for key, codec in CODECS.items():
+        if codec[0] == name:
+            return key
+    raise ValueError(f"codec '{name}' not available, have: {', '.join(c[0] for c in CODECS.values())}")
+
+
+def isCompressed(path):
+    try:
+        with open(path, 'rb') as f:
+            return f.read(4) == MAGIC
+    except OSError:
+        return False
+
+
+def _bounded(executor, func, items, window):
+    # executor.map() submits everything up front.  Keep at most 'window' chunks in memory
+    pending = deque()
+    for item in items:
+        pending.append(executor.submit(func, item))
+        if len(pending) >= window:
+            yield pending.popleft().result()
+    while pending:
+        yield pending.popleft().result()
+
+
+def pack(src, dst=None, codec='zlib', level=None, chunkSize=DEFAULT_CHUNK, threads=None):
+    if dst is None:
+        dst = os.path.splitext(src)[0] + '.rpdz'
+    cid = codecId(codec)
+    if level is None:
+        level = DEFAULT_LEVEL[codec]
+    compress = CODECS[cid][1]
+    threads = threads or os.cpu_count() or 1
+    rawSize = os.path.getsize(src)
+
+    def readChunks(f):
+        while True:
+            data = f.read(chunkSize)
+            if not data:
+                return
+            yield data
+
+    def work(data):
+        return compress(data, level), len(data), zlib.crc32(data)
+
+    index = []
+    with open(src, 'rb') as fin, open(dst + '.tmp', 'wb') as fout, ThreadPoolExecutor(threads) as executor:
+        fout.write(HEADER.pack(MAGIC, VERSION, cid, level, 0, chunkSize, rawSize))
+        for blob, size, crc in _bounded(executor, work, readChunks(fin), threads * 2):
+            index.append((fout.tell(), len(blob), size, crc))
+            fout.write(blob)
+        indexOffset = fout.tell()
+        for entry in index:
+            fout.write(INDEX.pack(*entry))
+        fout.write(FOOTER.pack(indexOffset, len(index), MAGIC))
+    os.replace(dst + '.tmp', dst)
+    return dst
+
+
+def readIndex(f):
+    header = HEADER.unpack(f.read(HEADER.size))
+    if header[0] != MAGIC:
+        raise ValueError("not an rpdz file")
+    if header[1] != VERSION:
+        raise ValueError(f"unsupported rpdz version {header[1]}")
+    if header[2] not in CODECS:
+        raise ValueError(f"rpdz codec {header[2]} not available (zstd needs the 'zstandard' module)")
+    f.seek(-FOOTER.size, os.SEEK_END)
+    indexOffset, count, magic = FOOTER.unpack(f.read(FOOTER.size))
+    if magic != MAGIC:
+        raise ValueError("truncated rpdz file")
+    f.seek(indexOffset)
+    raw = f.read(INDEX.size * count)
+    index = [INDEX.unpack_from(raw, i * INDEX.size) for i in range(count)]
+    return header, index
+
+
+def unpack(src, dst=None, threads=None):
+    if dst is None:
+        dst = os.path.splitext(src)[0] + '.rpd'
+    threads = threads or os.cpu_count() or 1
+    with open(src, 'rb') as fin:
+        header, index = readIndex(fin)
+        decompress = CODECS[header[2]][2]
+
+        def readBlobs():
+            for offset, csize, size, crc in index:
+                fin.seek(offset)
+                yield fin.read(csize), size, crc
+
+        def work(item):
+            blob, size, crc = item
+            data = decompress(blob)
+            if len(data) != size or zlib.crc32(data) != crc:
+                raise ValueError(f"corrupt chunk in {src}")
+            return data
+
+        with open(dst + '.tmp', 'wb') as fout, ThreadPoolExecutor(threads) as executor:
+            for data in _bounded(executor, work, readBlobs(), threads * 2):
+                fout.write(data)
+    os.replace(dst + '.tmp', dst)
+    return dst
+
+
+def cachedPath(path):
+    # Unpacked copy, reused while the rpdz is unchanged.  RPDZ_CACHE picks the directory
+    st = os.stat(path)
+    key = hashlib.sha1(f"{os.path.abspath(path)}:{st.st_size}:{st.st_mtime_ns}".encode()).hexdigest()[:16]
+    cacheDir = os.environ.get('RPDZ_CACHE', os.path.join(tempfile.gettempdir(), 'rpdz-cache'))
+    os.makedirs(cacheDir, exist_ok=True)
+    cached = os.path.join(cacheDir, f"{os.path.basename(os.path.splitext(path)[0])}-{key}.rpd")
+    if not os.path.exists(cached):
+        unpack(path, cached)
+    return cached
+
+
+def connect(path, **kwargs):
+    # Drop-in for sqlite3.connect().  Compressed files open read-only; temp tables still work
+    if isCompressed(path):
+        uri = pathlib.Path(cachedPath(path)).resolve().as_uri()
+        return sqlite3.connect(f"{uri}?mode=ro", uri=True, **kwargs)
+    return sqlite3.connect(path, **kwargs)
+
+
+def bench(path, codecs, levels, chunkSize, threads):
+    rawSize = os.path.getsize(path)
+    print(f"{path}: {rawSize / 1e6:.1f} MB")
+    with tempfile.TemporaryDirectory() as tmp:
+        for codec in codecs:
+            for level in (levels or [DEFAULT_LEVEL[codec]]):
+                packed = os.path.join(tmp, 'bench.rpdz')
+                t0 = time.perf_counter()
+                pack(path, packed, codec, level, chunkSize, threads)
+                t1 = time.perf_counter()
+                unpack(packed, os.path.join(tmp, 'bench.rpd'), threads)
+                t2 = time.perf_counter()
+                size = os.path.getsize(packed)
+                print(f"  {codec:5s} level {level:2d}: {size / 1e6:8.1f} MB  ratio {rawSize / size:5.2f}  "
+                      f"pack {rawSize / 1e6 / (t1 - t0):7.1f} MB/s  unpack {rawSize / 1e6 / (t2 - t1):7.1f} MB/s")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='compressed rpd files (.rpdz)')
+    parser.add_argument('command', choices=['pack', 'unpack', 'info', 'bench'])
+    parser.add_argument('input', type=str, help="input file")
+    parser.add_argument('output', type=str, nargs='?', help="output file, default swaps .rpd/.rpdz")
+    parser.add_argument('--codec', type=str, default='zlib', help=f"compression codec: {', '.join(c[0] for c in CODECS.values())}")
+    parser.add_argument('--level', type=int, nargs='*', help="compression level (bench accepts several)")
+    parser.add_argument('--chunk-mb', type=int, default=DEFAULT_CHUNK // (1024 * 1024), help="chunk size in MB")
+    parser.add_argument('--threads', type=int, default=None, help="worker threads, default all cpus")
+    parser.add_argument('--keep', action='store_true', help="keep the input after pack/unpack")
+    args = parser.parse_args()
+
+    chunkSize = args.chunk_mb * 1024 * 1024
+    if args.command == 'pack':
+        if isCompressed(args.input):
+            sys.exit(f"{args.input} is already compressed")
+        level = args.level[0] if args.level else None
+        out = pack(args.input, args.output, args.codec, level, chunkSize, args.threads)
+        print(f"{args.input} -> {out}: ratio {os.path.getsize(args.input) / os.path.getsize(out):.2f}")
+        if not args.keep:
+            os.remove(args.input)
+    elif args.command == 'unpack':
+        out = unpack(args.input, args.output, args.threads)
+        print(f"{args.input} -> {out}")
+        if not args.keep:
+            os.remove(args.input)
+    elif args.command == 'info':
+        with open(args.input, 'rb') as f:
+            header, index = readIndex(f)
+        packed = os.path.getsize(args.input)
+        print(f"codec {CODECS[header[2]][0]} level {header[3]}, {len(index)} chunks of {header[5] // 1024} KB, "
+              f"{header[6] / 1e6:.1f} MB -> {packed / 1e6:.1f} MB, ratio {header[6] / packed:.2f}")
+    elif args.command == 'bench':
+        codecs = [args.codec] if args.codec != 'all' else [c[0] for c in CODECS.values()]
+        bench(args.input, codecs, args.level, chunkSize, args.threads)
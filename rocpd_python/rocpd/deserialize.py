@@ -95,7 +95,7 @@ if __name__ == "__main__":
   connection = sqlite3.connect(args.input_rpd)
 
   importData = RocpdImportData()
-  importData.resumeExisting(connection)	# load the current db state
+  importData.resumeExisting(connection, lazy=True)	# strings are looked up on demand
 
   roctxApis = ["UserMarker"]
   print(f"Deserializing apis in: {str(roctxApis)[1:-1]}")
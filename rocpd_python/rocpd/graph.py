@@ -61,7 +61,7 @@ def generateGraph(imp):
     }
 
     print(f"Creating subclass table for 'graph' apis: {graphApis}")
-    createSubclassTable(importData, 'api', 'graph', graphApis, argTypes)
+    createSubclassTable(imp, 'api', 'graph', graphApis, argTypes)
 
     # create a subclass table for graph launches
     graphApis = [
@@ -71,7 +71,7 @@ def generateGraph(imp):
     ]
 
     print(f"Creating subclass table for 'graphLaunch' apis: {graphApis}")
-    createSubclassTable(importData, 'api', 'graphLaunch', graphApis, argTypes)
+    createSubclassTable(imp, 'api', 'graphLaunch', graphApis, argTypes)
 
 
     # Fill the graph list table
@@ -81,12 +81,12 @@ def generateGraph(imp):
 
 
     # Populate the graph -> kernel bridge table
-    graphs = [];
-    for row in imp.connection.execute('SELECT id, stream, start, end from ext_graph'):
-        graphs.append(row)
-
-    for row in graphs:
-        imp.connection.execute('INSERT INTO ext_graph_kernelapis("graph_id","api_id", "sequence") SELECT %s, B.id, ROW_NUMBER() OVER (ORDER BY B.start) from rocpd_kernelApi A join rocpd_api B on B.id = A.api_ptr_id where A.stream = "%s" and B.end >= %s and B.end <= %s order by B.start'%(row[0],row[1],row[2],row[3],))
+    # Kernel launches on capturing streams, indexed by (stream, end), so each
+    # graph finds its launches with one range search.  One statement for all graphs.
+    imp.connection.execute('CREATE TEMPORARY TABLE "temp.graphKernel" AS SELECT A.stream, B.end, B.start, B.id from rocpd_kernelApi A join rocpd_api B on B.id = A.api_ptr_id where A.stream in (SELECT stream from ext_graph)')
+    imp.connection.execute('CREATE INDEX "temp.graphKernel_stream_end" on "temp.graphKernel"(stream, end)')
+    imp.connection.execute('INSERT INTO ext_graph_kernelapis("graph_id","api_id", "sequence") SELECT A.id, B.id, ROW_NUMBER() OVER (PARTITION BY A.id ORDER BY B.start) from ext_graph A join "temp.graphKernel" B on B.stream = A.stream and B.end >= A.start and B.end <= A.end order by A.id, B.start')
+    imp.connection.execute('DROP TABLE "temp.graphKernel"')
 
 
     # mark metadata so we don't do this again
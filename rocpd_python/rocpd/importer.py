@@ -25,6 +25,8 @@
 #
 #
 
+import sqlite3
+from collections import OrderedDict
 
 
 class RocpdImportData:
@@ -40,6 +42,12 @@ class RocpdImportData:
         self.empty_string_id = 1
         self.connection = None
         self.string_inserts = []
+        # Lazy mode: strings are looked up through the string index on demand,
+        #   behind a bounded LRU, instead of all being loaded up front
+        self.lazy = False
+        self.cache_size = 0
+        self.pending = {}     # string -> id, inserted but not yet committed
+        self.string_index = False
 
     def __del__(self):
         self.commitStrings(True)
@@ -50,9 +58,14 @@ class RocpdImportData:
         self.connection = connection
         self.initEmptyString()
 
-    def resumeExisting(self, connection):
+    def resumeExisting(self, connection, lazy=False, cacheSize=65536):
         self.connection = connection
-        self.buildStringCache()
+        self.lazy = lazy
+        if lazy:
+            self.cache_size = cacheSize
+            self.resumeLazyStrings()
+        else:
+            self.buildStringCache()
         self.buildCurrentIds()
 
     def initEmptyString(self):
@@ -76,6 +89,64 @@ class RocpdImportData:
         for row in self.connection.execute("select id, string from rocpd_string"):
             self.strings[row[1]] = row[0]
 
+    # Constant time: only the next id is read.  The empty string is resolved on first use.
+    def resumeLazyStrings(self):
+        self.strings = OrderedDict()
+        self.pending = {}
+        self.string_inserts = []
+        self._empty_string_id = None
+        self.string_id = 1
+        for row in self.connection.execute("select id from rocpd_string order by id desc limit 1"):
+            self.string_id = row[0] + 1
+
+    # Build the rocpd_string(string) index from index2Schema if no index covers it.  This is
+    #   paid once per file, the first time a lazy importer has to look a string up.
+    def ensureStringIndex(self):
+        if self.string_index:
+            return
+        for index in self.connection.execute("pragma index_list(rocpd_string)").fetchall():
+            columns = self.connection.execute(f"pragma index_info(\"{index[1]}\")").fetchall()
+            if len(columns) > 0 and columns[0][2] == 'string':
+                self.string_index = True
+                return
+        try:
+            self.connection.execute('CREATE INDEX IF NOT EXISTS "rocpd_strin_string_c7b9cd_idx" ON "rocpd_string" ("string")')
+        except sqlite3.OperationalError:
+            pass      # read-only, lookups fall back to a scan
+        self.string_index = True
+
+    def lookupString(self, val):
+        try:
+            self.strings.move_to_end(val)
+            return self.strings[val]
+        except KeyError:
+            pass
+        id = self.pending.get(val)
+        if id is None:
+            self.ensureStringIndex()
+            # Duplicates resolve to the last id, as the full cache would
+            id = self.connection.execute("select max(id) from rocpd_string where string = ?", (val,)).fetchone()[0]
+        if id is None:
+            id = self.string_id
+            self.string_id = self.string_id + 1
+            self.string_inserts.append((id, val))
+            self.pending[val] = id
+            return id
+        self.strings[val] = id
+        if len(self.strings) > self.cache_size:
+            self.strings.popitem(last=False)
+        return id
+
+    @property
+    def empty_string_id(self):
+        if self._empty_string_id is None:
+            self._empty_string_id = self.getStringId("")
+        return self._empty_string_id
+
+    @empty_string_id.setter
+    def empty_string_id(self, value):
+        self._empty_string_id = value
+
     def buildCurrentIds(self):
         for row in self.connection.execute("select id from rocpd_op order by id desc limit 1"):
             self.op_id = row[0] + 1
@@ -86,6 +157,8 @@ class RocpdImportData:
 # Handle string cache and string table insert in one place
 
     def getStringId(self, val):
+        if self.lazy:
+            return self.lookupString(val)
         id = None
         try:
             id = self.strings[val]
@@ -103,6 +176,7 @@ class RocpdImportData:
             if commit == True:
                 self.connection.commit()
             self.string_inserts = []
+            self.pending = {}
 
 
 
@@ -0,0 +1,324 @@
+################################################################################
+# Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+################################################################################
+
+
+
+
+#
+#   Merge rpd files from several nodes into one
+#
+#       Each input is staged on its own thread (sqlite releases the GIL), into a
+#       private file next to the output:
+#         - integer primary keys are rebased into a range no other input uses, and
+#           every column referencing them (declared foreign keys, plus the string
+#           columns in string_users) follows
+#         - start/end columns are moved onto the first input's clock using the
+#           "Clock::Anchor" (wall clock ns, monotonic ns) pair the tracer records
+#         - tables with a start column get a nodeId, the input's row in rocpd_node
+#         - pids and gpu ids are offset per node, so tools that key tracks on them
+#           (rpd2tracing, raptor, ...) keep equal values from different nodes apart.
+#           The offsets are kept in rocpd_node
+#       The staged files are then appended to the output one at a time.  Strings
+#       already in the output (or repeated within an input) are mapped onto the
+#       existing id instead of being copied.
+#
+
+import os
+import pathlib
+import sqlite3
+import argparse
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+from rocpd.trim import string_users, _tables, _columns, _references
+
+# Metadata describing one input, kept in rocpd_node instead
+node_tags = ["session_count", "Clock::Anchor", "Node::Hostname"]
+time_columns = ["start", "end"]
+pid_columns = ["pid"]
+gpu_columns = ["gpuId", "deviceId"]
+pid_stride = 10000000       # above linux pid_max (4194304)
+
+node_schema = 'CREATE TABLE IF NOT EXISTS "rocpd_node" ("id" integer NOT NULL PRIMARY KEY, "name" varchar(4096) NOT NULL, "file" varchar(4096) NOT NULL, "clockShift" integer NOT NULL, "wallAnchor" integer, "monotonicAnchor" integer, "pidOffset" integer NOT NULL, "gpuOffset" integer NOT NULL)'
+
+
+def _connect(path):
+    connection = sqlite3.connect(pathlib.Path(path).absolute().as_uri(), uri=True, isolation_level=None, check_same_thread=False)
+    connection.execute("pragma journal_mode=off")
+    connection.execute("pragma synchronous=off")
+    return connection
+
+def _metadata(connection, schema, tag):
+    if "rocpd_metadata" not in _tables(connection, schema):
+        return None
+    row = connection.execute(f"select value from {schema}.rocpd_metadata where tag = ?", (tag,)).fetchone()
+    return row[0] if row else None
+
+def _integerKey(connection, schema, table):
+    # The table's own integer primary key, or None for tables keyed by a reference
+    keys = [row for row in connection.execute(f'pragma {schema}.table_info("{table}")') if row[5] > 0]
+    if len(keys) != 1 or keys[0][2].lower() != "integer":
+        return None
+    if keys[0][1] in [c for c, r in _references(connection, schema, table)]:
+        return None
+    return keys[0][1]
+
+
+class _Input:
+    """ What staging one file needs: its tables, keys, id ranges and clock """
+    def __init__(self, index, path, name):
+        self.index = index
+        self.path = path
+        self.stage = None
+        connection = sqlite3.connect(pathlib.Path(path).absolute().as_uri() + "?mode=ro", uri=True)
+        self.tables = [t for t in _tables(connection, "main") if t != "sqlite_sequence"]
+        self.sql = {row[0]: row[1] for row in connection.execute("select name, sql from sqlite_master where type='table'")}
+        self.extras = connection.execute("select type, name, sql from sqlite_master where type in ('index', 'view', 'trigger') and sql is not null order by type='view', type='trigger', rowid").fetchall()
+        self.columns = {t: _columns(connection, "main", t) for t in self.tables}
+        self.keys = {t: _integerKey(connection, "main", t) for t in self.tables}
+        # Undeclared string references count as foreign keys
+        users = set(u for u in string_users if u[0] in self.tables)
+        if "rocpd_metadata" in self.tables:
+            for (value,) in connection.execute("select value from rocpd_metadata where tag='references::rocpd_string.id'"):
+                value = eval(value)
+                if type(value) == tuple and value[0] in self.tables:
+                    users.add(value)
+        self.refs = {t: [(c, r) for c, r in _references(connection, "main", t) if r != t] for t in self.tables}
+        for table, column in users:
+            if (column, "rocpd_string") not in self.refs[table]:
+                self.refs[table].append((column, "rocpd_string"))
+        self.ranges = {}
+        for t in self.tables:
+            if self.keys[t]:
+                lo, hi = connection.execute(f'select min("{self.keys[t]}"), max("{self.keys[t]}") from "{t}"').fetchone()
+                if lo is not None:
+                    self.ranges[t] = (lo, hi)
+        anchor = _metadata(connection, "main", "Clock::Anchor")
+        self.anchor = tuple(int(v) for v in anchor.split()) if anchor else None
+        self.name = name or _metadata(connection, "main", "Node::Hostname") or pathlib.Path(path).stem
+        self.metadata = connection.execute("select tag, value from rocpd_metadata order by id").fetchall() if "rocpd_metadata" in self.tables else []
+        self.gpuCount = 1 + max([-1] + [connection.execute(f'select coalesce(max("{c}"), -1) from "{t}"').fetchone()[0]
+            for t in self.tables for c in self.columns[t] if c in gpu_columns])
+        connection.close()
+        self.delta = {}
+        self.shift = 0
+        self.pidOffset = 0
+        self.gpuOffset = 0
+
+
+def _stage(inp, nodeId):
+    """ Copy one input into its staging file with keys rebased, times shifted and nodeId set """
+    if os.path.exists(inp.stage):
+        os.remove(inp.stage)
+    connection = _connect(inp.stage)
+    connection.execute("attach database ? as src", (pathlib.Path(inp.path).absolute().as_uri() + "?mode=ro",))
+    connection.execute("begin")
+
+    def rebase(column, table):
+        # Values outside the source range (0 placeholders, dangling ids) are left alone
+        if table not in inp.ranges:
+            return f'"{column}"'
+        lo, hi = inp.ranges[table]
+        return f'case when "{column}" between {lo} and {hi} then "{column}" + {inp.delta[table]} else "{column}" end'
+
+    for table in inp.tables:
+        if table == "rocpd_metadata":
+            continue
+        connection.execute(inp.sql[table])
+        columns = inp.columns[table]
+        exprs = []
+        for column in columns:
+            refs = [r for c, r in inp.refs[table] if c == column]
+            if column == inp.keys[table]:
+                exprs.append(rebase(column, table))
+            elif refs:
+                exprs.append(rebase(column, refs[0]))
+            elif column in time_columns and inp.shift:
+                exprs.append(f'"{column}" + {inp.shift}')
+            elif column in pid_columns and inp.pidOffset:
+                exprs.append(f'"{column}" + {inp.pidOffset}')
+            elif column in gpu_columns and inp.gpuOffset:
+                exprs.append(f'case when "{column}" >= 0 then "{column}" + {inp.gpuOffset} else "{column}" end')
+            else:
+                exprs.append(f'"{column}"')
+        names = [f'"{c}"' for c in columns]
+        if "start" in columns and "nodeId" not in columns:
+            connection.execute(f'alter table main."{table}" add column "nodeId" integer NOT NULL DEFAULT 0')
+            names.append('"nodeId"')
+            exprs.append(str(nodeId))
+        connection.execute(f'insert into main."{table}" ({", ".join(names)}) select {", ".join(exprs)} from src."{table}"')
+    connection.execute("commit")
+    connection.execute("detach database src")
+    connection.close()
+
+
+def mergeFiles(inputs, output, names=None, align=True, jobs=0, verbose=True):
+    """
+    Merge the rpd files in inputs into a new file output.  names optionally labels each
+    input (default: the traced host, else the file name).  Returns {table: rows}.
+    """
+    if os.path.exists(output):
+        os.remove(output)
+    begin = time.time()
+    def log(message):
+        if verbose:
+            print(f"{time.time() - begin:7.2f}s  {message}")
+
+    names = names or [None] * len(inputs)
+    files = [_Input(i, path, name) for i, (path, name) in enumerate(zip(inputs, names))]
+
+    # Disjoint, dense key ranges, in input order
+    next_id = {}
+    for inp in files:
+        for table, (lo, hi) in inp.ranges.items():
+            base = next_id.get(table, 1)
+            inp.delta[table] = base - lo
+            next_id[table] = base + hi - lo + 1
+
+    # Node 0 keeps its pids and gpus, later nodes follow on
+    gpus = 0
+    for inp in files:
+        inp.pidOffset = inp.index * pid_stride
+        inp.gpuOffset = gpus
+        gpus += inp.gpuCount
+
+    # Everything onto the clock of the first input that has an anchor
+    reference = next((inp.anchor for inp in files if inp.anchor), None)
+    for inp in files:
+        if not align:
+            continue
+        if inp.anchor is None:
+            if reference:
+                print(f"Warning: {inp.path} has no clock anchor, its times are left as recorded")
+            continue
+        inp.shift = (inp.anchor[0] - inp.anchor[1]) - (reference[0] - reference[1])
+
+    for inp in files:
+        inp.stage = f"{output}.merge{inp.index}.tmp"
+    counts = {}
+    try:
+        with ThreadPoolExecutor(max_workers=jobs or min(len(files), os.cpu_count() or 1)) as pool:
+            for _ in pool.map(lambda inp: _stage(inp, inp.index + 1), files):
+                pass
+        log(f"staged {len(files)} inputs")
+
+        connection = _connect(output)
+        connection.execute("begin")
+        connection.execute(node_schema)
+        # Lookup for the string dedupe, dropped again unless an input had it
+        connection.execute('CREATE TABLE IF NOT EXISTS "rocpd_string" ("id" integer NOT NULL PRIMARY KEY AUTOINCREMENT, "string" varchar(4096) NOT NULL)')
+        connection.execute('CREATE INDEX IF NOT EXISTS "merge_string_idx" ON "rocpd_string" ("string")')
+        connection.execute('CREATE TEMPORARY TABLE "stringMap" ("before" integer NOT NULL PRIMARY KEY, "after" integer NOT NULL)')
+        metadata = []
+
+        connection.execute("commit")
+
+        # One transaction per input; a database can only be detached outside one
+        for inp in files:
+            connection.execute("attach database ? as stage", (pathlib.Path(inp.stage).absolute().as_uri(),))
+            connection.execute("begin")
+            staged = _tables(connection, "stage")
+            present = set(_tables(connection, "main"))
+            for table in staged:
+                if table not in present:
+                    connection.execute(connection.execute("select sql from stage.sqlite_master where type='table' and name=?", (table,)).fetchone()[0])
+                else:
+                    have = set(_columns(connection, "main", table))
+                    for column in _columns(connection, "stage", table):
+                        if column not in have:
+                            connection.execute(f'alter table main."{table}" add column "{column}"')
+
+            if "rocpd_string" in staged:
+                connection.execute('delete from temp.stringMap')
+                connection.execute('insert into temp.stringMap select S.id, M.id from stage.rocpd_string S join main.rocpd_string M on M.string = S.string')
+                connection.execute('insert into temp.stringMap select id, after from (select id, min(id) over (partition by string) as after from stage.rocpd_string where id not in (select before from temp.stringMap)) where id != after')
+                added = connection.execute('insert into main.rocpd_string (id, string) select id, string from stage.rocpd_string where id not in (select before from temp.stringMap)').rowcount
+                mapped = connection.execute('select count(*) from temp.stringMap').fetchone()[0]
+                log(f"{inp.name}: {added} new strings, {mapped} already present")
+
+            rows = 0
+            for table in staged:
+                if table == "rocpd_string":
+                    continue
+                columns = _columns(connection, "stage", table)
+                strings = set(c for c, r in inp.refs.get(table, []) if r == "rocpd_string")
+                exprs = [f'coalesce((select after from temp.stringMap where before = "{c}"), "{c}")' if c in strings else f'"{c}"' for c in columns]
+                cols = ", ".join(f'"{c}"' for c in columns)
+                rows += connection.execute(f'insert into main."{table}" ({cols}) select {", ".join(exprs)} from stage."{table}"').rowcount
+            log(f"{inp.name}: {rows} rows, clock shift {inp.shift} ns, pid offset {inp.pidOffset}, gpu offset {inp.gpuOffset}")
+
+            for tag, value in inp.metadata:
+                if tag not in node_tags and (tag, value) not in metadata:
+                    metadata.append((tag, value))
+            connection.execute("insert into rocpd_node (id, name, file, clockShift, wallAnchor, monotonicAnchor, pidOffset, gpuOffset) values (?,?,?,?,?,?,?,?)",
+                (inp.index + 1, inp.name, os.path.abspath(inp.path), inp.shift, inp.anchor[0] if inp.anchor else None, inp.anchor[1] if inp.anchor else None, inp.pidOffset, inp.gpuOffset))
+            connection.execute("commit")
+            connection.execute("detach database stage")
+            os.remove(inp.stage)
+
+        connection.execute("begin")
+
+        if any("rocpd_metadata" in inp.tables for inp in files):
+            connection.execute(next(inp.sql["rocpd_metadata"] for inp in files if "rocpd_metadata" in inp.tables))
+            connection.executemany("insert into rocpd_metadata (tag, value) values (?,?)", metadata)
+            if reference and align:
+                connection.execute("insert into rocpd_metadata (tag, value) values ('Clock::Anchor', ?)", (f"{reference[0]} {reference[1]}",))
+
+        # Autoincrement counters continue after the merged ids
+        if connection.execute("select count(*) from main.sqlite_master where name='sqlite_sequence'").fetchone()[0]:
+            connection.execute("delete from main.sqlite_sequence")
+            for table in _tables(connection, "main"):
+                key = _integerKey(connection, "main", table)
+                if key and "AUTOINCREMENT" in (connection.execute("select sql from sqlite_master where name=?", (table,)).fetchone()[0] or "").upper():
+                    connection.execute(f'insert into main.sqlite_sequence (name, seq) select ?, max("{key}") from main."{table}" having max("{key}") is not null', (table,))
+
+        connection.execute('DROP INDEX "merge_string_idx"')
+        created = set()
+        for inp in files:
+            for kind, name, sql in inp.extras:
+                if name not in created:
+                    created.add(name)
+                    connection.execute(sql)
+        log("indexes and views")
+
+        for table in _tables(connection, "main"):
+            if table != "sqlite_sequence":
+                counts[table] = connection.execute(f'select count(*) from main."{table}"').fetchone()[0]
+        connection.execute("commit")
+        connection.close()
+    finally:
+        for inp in files:
+            if os.path.exists(inp.stage):
+                os.remove(inp.stage)
+    return counts
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Merge rpd files from several nodes into one, with disjoint ids and aligned clocks')
+    parser.add_argument('output_rpd', type=str, help="merged rpd db")
+    parser.add_argument('input_rpd', type=str, nargs='+', help="input rpd dbs")
+    parser.add_argument('--names', type=str, help="comma separated node names, one per input (default: traced host name)")
+    parser.add_argument('--no-align', dest='align', action='store_false', help="keep each input's timestamps as recorded")
+    parser.add_argument('--jobs', type=int, default=0, help="inputs staged at once (default: number of cpus)")
+    args = parser.parse_args()
+
+    mergeFiles(args.input_rpd, args.output_rpd, args.names.split(',') if args.names else None, args.align, args.jobs)
@@ -28,7 +28,9 @@ import sys
 import os
 import csv
 import re
+import shutil
 import sqlite3
+import subprocess
 from collections import defaultdict
 from datetime import datetime
 import argparse
@@ -39,6 +41,16 @@ from rocpd.importer import RocpdImportData
 
 
 
+def nativeTool():
+    """ Path of the native rocprof2rpd importer (make -C tools), or None """
+    tool = shutil.which("rocprof2rpd")
+    if tool is None:
+        local = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools", "rocprof2rpd")
+        if os.access(local, os.X_OK):
+            tool = local
+    return tool
+
+
 def importOps(imp, infile):
     exp = re.compile("^(\d*):(\d*)\s+(\d*):(\d*)\s+(\w+):(\d*):(\d*).*$")
     count = 0;
@@ -155,7 +167,7 @@ def importRoctx(imp, infile):
 # Clear args for a given api
 def clearApiArgs(imp, apiname):
     imp.connection.execute("update rocpd_api set args_id = ? where apiName_id in (select id from rocpd_string where string = ?)", (imp.empty_string_id, apiname))
-    connection.commit()
+    imp.connection.commit()
 
 
 # Remove unreferenced rows from string table
@@ -170,7 +182,7 @@ def purgeStrings(imp):
             # DISABLED to review HSA support
             #union all select distinct apiName_id from rocpd_hsaApi
             #union all select distinct args_id from rocpd_hsaApi 
-    connection.commit()
+    imp.connection.commit()
 
 
 #
@@ -189,7 +201,7 @@ def populateKernelInfo(imp):
 
     def commitRecords():
         nonlocal kernel_inserts
-        imp.commitStrings
+        imp.commitStrings()
         imp.connection.executemany("insert into rocpd_kernelapi(api_ptr_id, stream, gridX, gridY, gridZ, workgroupX, workgroupY, workgroupZ, groupSegmentSize, privateSegmentSize, codeObject_id, kernelName_id, kernelArgAddress, aquireFence, releaseFence) values (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)", kernel_inserts)
         imp.connection.commit()
         kernel_inserts = []
@@ -230,7 +242,7 @@ def populateKernelInfo(imp):
     # copy the kernel names into the base op table's description
     # Most use cases will just want the kernel name and can avoid joining KernelOp
     imp.connection.execute("CREATE INDEX opid_index ON rocpd_api_ops (op_id)");
-    imp.connection.execute("update rocpd_op set description_id = (select kernelName_id from rocpd_api_ops A join rocpd_kernelapi B on B.api_ptr_id = A.api_id where rocpd_op.id = A.op_id) where rocpd_op.id in (select A.id from rocpd_api_ops A join rocpd_kernelapi B on B.api_ptr_id=A.api_id)")
+    imp.connection.execute("update rocpd_op set description_id = (select kernelName_id from rocpd_api_ops A join rocpd_kernelapi B on B.api_ptr_id = A.api_id where rocpd_op.id = A.op_id) where rocpd_op.id in (select A.op_id from rocpd_api_ops A join rocpd_kernelapi B on B.api_ptr_id=A.api_id)")
     imp.connection.commit()
 
 
@@ -252,7 +264,7 @@ def populateCopyInfo(imp):
         imp.connection.commit()
         copy_inserts = []
 
-    for row in connection.execute("select A.api_id, C.string from rocpd_api_ops A join rocpd_api B on B.id = A.api_id join rocpd_string C on C.id = B.args_id where B.apiName_id in (select id from rocpd_string where string in (%s))" % str(copyApis)[1:-1]):
+    for row in imp.connection.execute("select A.api_id, C.string from rocpd_api_ops A join rocpd_api B on B.id = A.api_id join rocpd_string C on C.id = B.args_id where B.apiName_id in (select id from rocpd_string where string in (%s))" % str(copyApis)[1:-1]):
         args = {}
         for line in row[1].split(','):
             key, value = line.partition("=")[::2]
@@ -270,6 +282,7 @@ def populateCopyInfo(imp):
         pinned = False
 
         copy_inserts.append((row[0], stream, size, width, height, kind, src, dst, srcDevice, dstDevice, sync, pinned))
+        count = count + 1
         if (count % 100000 == 99999):
             commitRecords()
     commitRecords()
@@ -289,6 +302,7 @@ if __name__ == "__main__":
   parser.add_argument('--roctx_input_file', type=str, help="roctx_trace.txt from rocprofiler")
   parser.add_argument('--filter', type=str, help="input filter file")
   parser.add_argument('--input_dir', type=str, help="directory containing rocprofiler intermediate files")
+  parser.add_argument('--native', action='store_true', help="import with tools/rocprof2rpd")
   parser.add_argument('output_rpd', type=str, help="output file")
   args = parser.parse_args()
 
@@ -311,6 +325,26 @@ if __name__ == "__main__":
   connection = sqlite3.connect(args.output_rpd)
   RocpdSchema().writeSchema(connection)
 
+  # The native importer streams each file once and fills in kernel and copy
+  # info as it goes, so none of the passes below are needed
+  if args.native:
+      tool = nativeTool()
+      if tool is None:
+          raise Exception("rocprof2rpd not found, build it with: make -C tools")
+      connection.commit()
+      connection.close()
+      cmd = [tool]
+      if args.ops_input_file:
+          cmd += ["--ops_input_file", args.ops_input_file]
+      if args.api_input_file:
+          cmd += ["--api_input_file", args.api_input_file]
+      if args.roctx_input_file:
+          cmd += ["--roctx_input_file", args.roctx_input_file]
+      if args.hsa_input_file:
+          print(f"SKIPPING hsa api calls from {args.hsa_input_file}")
+      subprocess.run(cmd + [args.output_rpd], check=True)
+      sys.exit(0)
+
   # Initialize import state
   imp = RocpdImportData();
   imp.initNew(connection);
@@ -328,7 +362,7 @@ if __name__ == "__main__":
       infile.close()
 
   if args.hsa_input_file:
-      printf(f"SKIPPING hsa api calls from {args.hsa_input_file}")
+      print(f"SKIPPING hsa api calls from {args.hsa_input_file}")
       #print(f"Importing hsa api calls from {args.hsa_input_file}")
       #infile = open(args.hsa_input_file, 'r', encoding="utf-8")
       #importHsa(connection, infile)
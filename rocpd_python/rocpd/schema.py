@@ -45,6 +45,8 @@ class RocpdSchema:
             self.index2Schema = schema.read()
         with open(str(schemadir/'schema_data/utilitySchema.cmd'), 'r') as schema:
             self.utilitySchema = schema.read()
+        with open(str(schemadir/'schema_data/timeIndexSchema.cmd'), 'r') as schema:
+            self.timeIndexSchema = schema.read()
 
     def writeSchema(self, connection):
         connection.executescript(self.tableSchema)
@@ -61,6 +63,11 @@ class RocpdSchema:
         connection.executescript(self.index2Schema)
         connection.executescript(self.utilitySchema)
 
+    # B-tree indexes on event start times (and the api<->op links) so
+    # time-window queries are range scans.  Safe to run on populated files.
+    def writeTimeIndexes(self, connection):
+        connection.executescript(self.timeIndexSchema)
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description='convert rocprofiler output to an RPD database')
     parser.add_argument('--create', type=str, help="filename in create empty db")
@@ -0,0 +1,6 @@
+CREATE INDEX IF NOT EXISTS "rocpd_api_start_idx" ON "rocpd_api" ("start");
+CREATE INDEX IF NOT EXISTS "rocpd_op_start_idx" ON "rocpd_op" ("start");
+CREATE INDEX IF NOT EXISTS "rocpd_op_gpuId_start_idx" ON "rocpd_op" ("gpuId", "start");
+CREATE INDEX IF NOT EXISTS "rocpd_monitor_start_idx" ON "rocpd_monitor" ("start");
+CREATE INDEX IF NOT EXISTS "rocpd_api_ops_api_id_f87632ad" ON "rocpd_api_ops" ("api_id");
+CREATE INDEX IF NOT EXISTS "rocpd_api_ops_op_id_b35ab7c9" ON "rocpd_api_ops" ("op_id");
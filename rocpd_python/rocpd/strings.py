@@ -13,11 +13,6 @@ from rocpd.importer import RocpdImportData
 
 
 def cleanStrings(imp, fix_autograd):
-    # Create backup table
-    imp.connection.execute('CREATE TEMPORARY TABLE IF NOT EXISTS "rocpd_string_original" ("id" integer NOT NULL PRIMARY KEY AUTOINCREMENT, "string" varchar(4096) NOT NULL)')
-    imp.connection.execute('INSERT into rocpd_string_original SELECT * from rocpd_string')
-
-
     # Make a list of all columns that reference rocpd_string
     #   These will need to be updated and relinked
     #   Also, we can detect and remove unreferences strings
@@ -40,16 +35,16 @@ def cleanStrings(imp, fix_autograd):
     # Normalize autograd strings
     if fix_autograd:
         imp.connection.execute("""
-            UPDATE rocpd_string_original set string = SUBSTR(string, 1, INSTR(string, ", seq") - 1) where string like "%, seq%"
+            UPDATE rocpd_string set string = SUBSTR(string, 1, INSTR(string, ", seq") - 1) where string like "%, seq%"
         """)
         imp.connection.execute("""
-            UPDATE rocpd_string_original set string = SUBSTR(string, 1, INSTR(string, ", op_id") - 1) where string like "%, op_id%"
+            UPDATE rocpd_string set string = SUBSTR(string, 1, INSTR(string, ", op_id") - 1) where string like "%, op_id%"
         """)
         imp.connection.execute("""
-            UPDATE rocpd_string_original set string = SUBSTR(string, 1, INSTR(string, ", sizes") - 1) where string like "%, sizes%"
+            UPDATE rocpd_string set string = SUBSTR(string, 1, INSTR(string, ", sizes") - 1) where string like "%, sizes%"
         """)
         imp.connection.execute("""
-            UPDATE rocpd_string_original set string = SUBSTR(string, 1, INSTR(string, ", input_op_ids") - 1) where string like "%, input_op_ids%"
+            UPDATE rocpd_string set string = SUBSTR(string, 1, INSTR(string, ", input_op_ids") - 1) where string like "%, input_op_ids%"
         """)
 
 
@@ -63,41 +58,40 @@ def cleanStrings(imp, fix_autograd):
         imp.connection.execute(query)
 
 
-    # Drop, recreate, and populate the string table
-    imp.connection.execute("""
-        DROP TABLE "rocpd_string";
-        """)
+    # Integer map from each duplicate id to the lowest id holding the same string.
+    #   One pass over the string index; no per-row text lookups.
     imp.connection.execute("""
-        CREATE TABLE IF NOT EXISTS "rocpd_string" ("id" integer NOT NULL PRIMARY KEY AUTOINCREMENT, "string" varchar(4096) NOT NULL);
+        CREATE TEMPORARY TABLE IF NOT EXISTS "temp.stringMap" ("before" integer NOT NULL PRIMARY KEY, "after" integer NOT NULL);
         """)
     imp.connection.execute("""
-        CREATE INDEX "rocpd_strin_string_c7b9cd_idx" ON "rocpd_string" ("string");
-        """)
-    imp.connection.execute("""
-        INSERT into rocpd_string(string) SELECT distinct string from rocpd_string_original where id in (SELECT id FROM "temp.activeString") order by id;
-        """)
-
-
-    # Map from old id to new; UPDATE all table with new string id
-    imp.connection.execute("""
-        CREATE TEMPORARY VIEW IF NOT EXISTS mapper as SELECT A.id as before, B.id as after from rocpd_string_original A join rocpd_string B on B.string = A.string;
+        INSERT INTO "temp.stringMap" SELECT id, after FROM (SELECT id, min(id) OVER (PARTITION BY string) AS after FROM rocpd_string WHERE id IN (SELECT id FROM "temp.activeString")) WHERE id != after;
         """)
 
+    # Relink only the rows that point at a duplicate
+    update_from = sqlite3.sqlite_version_info >= (3, 33, 0)
     for column in string_users:
-        query = f"""UPDATE {column[0]} set {column[1]} = (SELECT after from mapper A where {column[1]}=A.before) """
+        if update_from:
+            query = f"""UPDATE {column[0]} set {column[1]} = M.after FROM "temp.stringMap" M where M.before = {column[0]}.{column[1]}"""
+        else:
+            query = f"""UPDATE {column[0]} set {column[1]} = (SELECT after from "temp.stringMap" where before = {column[1]}) where {column[1]} in (SELECT before from "temp.stringMap")"""
         #print(query)
         imp.connection.execute(query)
 
+    # Drop duplicates and unreferenced strings.  Surviving strings keep their ids.
+    imp.connection.execute("""
+        DELETE FROM rocpd_string WHERE id NOT IN (SELECT id FROM "temp.activeString") OR id IN (SELECT before FROM "temp.stringMap");
+        """)
+
     # cleanup
     imp.connection.execute("""
-        DROP TABLE rocpd_string_original
+        DROP TABLE "temp.stringMap"
         """)
     imp.connection.execute("""
         DROP TABLE "temp.activeString"
         """)
 
     imp.connection.commit()
-    imp.resumeExisting(imp.connection)	# reload state
+    imp.resumeExisting(imp.connection, imp.lazy)	# reload state
 
 if __name__ == "__main__":
 
@@ -110,7 +104,7 @@ if __name__ == "__main__":
     connection = sqlite3.connect(args.input_rpd)
 
     importData = RocpdImportData()
-    importData.resumeExisting(connection) # load the current db state
+    importData.resumeExisting(connection, lazy=True) # strings are looked up on demand
 
     if args.dedupe or args.clean_autograd:
         cleanStrings(importData, args.clean_autograd)
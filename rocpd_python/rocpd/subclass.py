@@ -35,13 +35,39 @@ import sys
 import os
 import re
 import argparse
+import shutil
 import sqlite3
+import subprocess
 from rocpd.importer import RocpdImportData
 
 
-def createSubclassTable(importData, baseClass, subClass, events, argTypes):
+def nativeTool():
+    """ Path of the native rpd_subclass tool (make -C tools), or None """
+    tool = shutil.which("rpd_subclass")
+    if tool is None:
+        local = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools", "rpd_subclass")
+        if os.access(local, os.X_OK):
+            tool = local
+    return tool
+
+
+def createSubclassTable(importData, baseClass, subClass, events, argTypes, native=False):
     if baseClass != 'api' and baseClass != 'op':
         raise("baseClass must be 'api' or 'op'")
+
+    # The native tool splits each distinct args string once, in parallel, and
+    # infers integer/real columns.  It works on the file, so commit first.
+    if native:
+        tool = nativeTool()
+        if tool is None:
+            raise Exception("rpd_subclass not found, build it with: make -C tools")
+        dbFile = importData.connection.execute("pragma database_list").fetchone()[2]
+        importData.connection.commit()
+        cmd = [tool]
+        for arg, argType in argTypes.items():
+            cmd += ["--type", f"{arg}={argType}"]
+        subprocess.run(cmd + [dbFile, baseClass, subClass] + list(events), check=True)
+        return
     queryString = \
         'select distinct B.string from rocpd_api A join rocpd_string B on B.id = A.args_id where A.apiName_id in\n\
             (select id from rocpd_string where string in (%s))' \
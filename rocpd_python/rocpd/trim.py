@@ -0,0 +1,194 @@
+################################################################################
+# Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+################################################################################
+
+
+
+#
+#   Trim an rpd file to a time window by copying forward
+#
+#       Builds a new file holding only the in-window rows instead of deleting the rest
+#       and vacuuming.  Tables are filtered with set-based INSERT ... SELECT statements
+#       against the source, which is attached read-only:
+#         - rocpd_api (and any other table with a start column) by start time
+#         - rocpd_api_ops by kept apis, rocpd_op by kept api_ops
+#         - tables with foreign keys into filtered tables (kernelapi, copyapi, kernelop,
+#           ext_callstack, ...) by the rows they reference
+#         - rocpd_monitor samples overlapping the kept range
+#         - rocpd_string by the ids the kept rows reference
+#       Tables with no time or foreign key to a filtered table are copied whole.
+#
+
+import os
+import pathlib
+import sqlite3
+import argparse
+import time
+
+# Referenced string columns without a declared foreign key
+string_users = [
+    ("rocpd_op", "description_id"),
+    ("rocpd_op", "opType_id"),
+    ("rocpd_api", "apiName_id"),
+    ("rocpd_api", "args_id"),
+    ("rocpd_kernelapi", "kernelName_id"),
+    ]
+
+
+def _tables(connection, schema):
+    return [row[0] for row in connection.execute(f"select name from {schema}.sqlite_master where type='table' and name not like 'sqlite_%' order by rowid")]
+
+def _columns(connection, schema, table):
+    return [row[1] for row in connection.execute(f'pragma {schema}.table_info("{table}")')]
+
+def _references(connection, schema, table):
+    # (column, referenced table) for each declared foreign key
+    return [(row[3], row[2]) for row in connection.execute(f'pragma {schema}.foreign_key_list("{table}")')]
+
+
+def trimToWindow(src, dst, start_ns, end_ns, verbose=True):
+    """
+    Write the rows of src that fall in [start_ns, end_ns] (absolute ns, on api start time) to a new file dst.
+    Returns {table: (kept, total)}.
+    """
+    if os.path.exists(dst):
+        os.remove(dst)
+
+    # The new file is only renamed into place when complete, so no journal
+    connection = sqlite3.connect(pathlib.Path(dst).absolute().as_uri(), uri=True, isolation_level=None)
+    connection.execute("pragma journal_mode=off")
+    connection.execute("pragma synchronous=off")
+    connection.execute("attach database ? as src", (pathlib.Path(src).absolute().as_uri() + "?mode=ro",))
+
+    counts = {}
+    begin = time.time()
+    def log(message):
+        if verbose:
+            print(f"{time.time() - begin:7.2f}s  {message}")
+
+    # Tables first, indexes/views/triggers once the data is in
+    connection.execute("begin")
+    for (sql,) in connection.execute("select sql from src.sqlite_master where type='table' and name not like 'sqlite_%' order by rowid").fetchall():
+        connection.execute(sql)
+
+    tables = _tables(connection, "src")
+    refs = {table: [(c, r) for c, r in _references(connection, "src", table) if r != table] for table in tables}
+    columns = {table: _columns(connection, "src", table) for table in tables}
+    filtered = set()
+
+    def copy(table, where):
+        cols = ", ".join(f'"{c}"' for c in columns[table])
+        connection.execute(f'insert into main."{table}" ({cols}) select {cols} from src."{table}" {where}')
+        kept = connection.execute(f'select count(*) from main."{table}"').fetchone()[0]
+        total = connection.execute(f'select count(*) from src."{table}"').fetchone()[0]
+        counts[table] = (kept, total)
+        log(f"{table:32} {kept:>12} of {total}")
+
+    # Roots: apis by start, then the ops they launched
+    if "rocpd_api" in tables:
+        copy("rocpd_api", f"where start between {int(start_ns)} and {int(end_ns)}")
+        filtered.add("rocpd_api")
+    if "rocpd_api_ops" in tables:
+        copy("rocpd_api_ops", "where api_id in (select id from main.rocpd_api)")
+        filtered.add("rocpd_api_ops")
+    if "rocpd_op" in tables:
+        copy("rocpd_op", "where id in (select op_id from main.rocpd_api_ops)")
+        filtered.add("rocpd_op")
+
+    # Counters extend to the last kept op
+    last = connection.execute("select max(end) from main.rocpd_op").fetchone()[0] if "rocpd_op" in tables else None
+    last_ns = max(int(end_ns), last or 0)
+
+    pending = [t for t in tables if t not in filtered and t != "rocpd_string"]
+    while pending:
+        # A table is ready once everything it references has been copied
+        ready = [t for t in pending if all(r not in pending or r == t for c, r in refs[t])]
+        if not ready:
+            ready = pending[:1]
+        for table in ready:
+            pending.remove(table)
+            keys = [(c, r) for c, r in refs[table] if r in filtered]
+            if keys:
+                copy(table, "where " + " and ".join(f'"{c}" in (select id from main."{r}")' for c, r in keys))
+                filtered.add(table)
+            elif table == "rocpd_monitor":
+                copy(table, f"where start <= {last_ns} and end >= {int(start_ns)}")
+                filtered.add(table)
+            elif "start" in columns[table]:
+                copy(table, f"where start between {int(start_ns)} and {int(end_ns)}")
+                filtered.add(table)
+            else:
+                copy(table, "")
+
+    # Strings referenced by anything kept
+    if "rocpd_string" in tables:
+        users = set(u for u in string_users if u[0] in tables)
+        for table in tables:
+            users.update((table, c) for c, r in refs[table] if r == "rocpd_string")
+        if "rocpd_metadata" in tables:
+            for (value,) in connection.execute("select value from main.rocpd_metadata where tag='references::rocpd_string.id'"):
+                value = eval(value)
+                if type(value) == tuple and value[0] in tables:
+                    users.add(value)
+        connection.execute('create temporary table activeString ("id" integer NOT NULL PRIMARY KEY)')
+        for table, column in sorted(users):
+            connection.execute(f'insert or ignore into temp.activeString select "{column}" from main."{table}"')
+        copy("rocpd_string", "where id in (select id from temp.activeString)")
+        connection.execute("drop table temp.activeString")
+
+    # Keep autoincrement counters where the source left them
+    if connection.execute("select count(*) from main.sqlite_master where name='sqlite_sequence'").fetchone()[0]:
+        connection.execute("delete from main.sqlite_sequence")
+        connection.execute("insert into main.sqlite_sequence select * from src.sqlite_sequence")
+
+    for (sql,) in connection.execute("select sql from src.sqlite_master where type in ('index', 'view', 'trigger') and sql is not null order by type='view', type='trigger', rowid").fetchall():
+        connection.execute(sql)
+    log("indexes and views")
+
+    connection.execute("commit")
+    connection.execute("detach database src")
+    connection.close()
+    return counts
+
+
+def trimInPlace(path, start_ns, end_ns, verbose=True):
+    """
+    trimToWindow into a temporary file next to path, then replace path with it.
+    """
+    tmp = f"{path}.trim.tmp"
+    try:
+        counts = trimToWindow(path, tmp, start_ns, end_ns, verbose)
+        os.replace(tmp, path)
+    finally:
+        if os.path.exists(tmp):
+            os.remove(tmp)
+    return counts
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Copy the rows of an rpd file inside a time window (absolute ns, on api start) to a new file')
+    parser.add_argument('input_rpd', type=str, help="input rpd db")
+    parser.add_argument('output_rpd', type=str, help="trimmed rpd db")
+    parser.add_argument('start', type=int, help="window start, ns")
+    parser.add_argument('end', type=int, help="window end, ns")
+    args = parser.parse_args()
+
+    trimToWindow(args.input_rpd, args.output_rpd, args.start, args.end)
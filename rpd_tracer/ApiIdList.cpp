@@ -22,6 +22,14 @@
 ********************************************************************************/
 #include "ApiIdList.h"
 
+#include <fstream>
+#include <sstream>
+#include <regex>
+#include <fnmatch.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
 //#include <roctracer_hip.h>
 // FIXME: make this work for cud and hip or turn into interface
 
@@ -30,11 +38,21 @@ ApiIdList::ApiIdList()
 {
 }
 
+void ApiIdList::set(uint32_t apiId, bool value)
+{
+    if (apiId >= m_filter.size()) {
+        if (value == false)
+            return;
+        m_filter.resize(apiId + 1, false);
+    }
+    m_filter[apiId] = value;
+}
+
 void ApiIdList::add(const std::string &apiName)
 {
     uint32_t cid = mapName(apiName);
     if (cid > 0)
-        m_filter[cid] = 1;
+        set(cid, true);
 #if 0
   uint32_t cid = 0;
   if (roctracer_op_code(ACTIVITY_DOMAIN_HIP_API, apiName.c_str(), &cid, NULL) == ROCTRACER_STATUS_SUCCESS)
@@ -45,7 +63,7 @@ void ApiIdList::remove(const std::string &apiName)
 {
     uint32_t cid = mapName(apiName);
     if (cid > 0)
-        m_filter.erase(cid);
+        set(cid, false);
 #if 0
   uint32_t cid = 0;
   if (roctracer_op_code(ACTIVITY_DOMAIN_HIP_API, apiName.c_str(), &cid, NULL) == ROCTRACER_STATUS_SUCCESS)
@@ -53,12 +71,126 @@ void ApiIdList::remove(const std::string &apiName)
 #endif
 }
 
+bool ApiIdList::addSpec(const std::string &spec)
+{
+    // Tokenize.  Regexes are delimited by '/' and may contain separators
+    std::vector<std::string> entries;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        const char c = spec[pos];
+        if (c == ',' || isspace(c)) {
+            ++pos;
+            continue;
+        }
+        if (c == '#') {
+            pos = spec.find('\n', pos);
+            if (pos == std::string::npos)
+                break;
+            continue;
+        }
+        size_t begin = pos;
+        if (spec[pos] == '-')
+            ++pos;
+        if (pos < spec.size() && spec[pos] == '/') {
+            pos = spec.find('/', pos + 1);
+            if (pos == std::string::npos) {
+                fprintf(stderr, "rpd_tracer: unterminated regex in api filter: %s\n", spec.substr(begin).c_str());
+                return false;
+            }
+            ++pos;
+        }
+        else {
+            while (pos < spec.size() && spec[pos] != ',' && !isspace(spec[pos]))
+                ++pos;
+        }
+        entries.push_back(spec.substr(begin, pos - begin));
+    }
+
+    bool ok = true;
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        std::string entry = *it;
+        if (entry == "include:" || entry == "exclude:") {
+            m_invert = (entry == "exclude:");
+            m_filter.clear();
+            continue;
+        }
+        bool value = true;
+        if (entry[0] == '-') {
+            value = false;
+            entry = entry.substr(1);
+        }
+        if (entry.empty())
+            continue;
+
+        const bool isRegex = entry.size() > 1 && entry.front() == '/' && entry.back() == '/';
+        const bool isGlob = entry.find_first_of("*?[") != std::string::npos;
+        if (!isRegex && !isGlob) {
+            uint32_t cid = mapName(entry);
+            if (cid > 0)
+                set(cid, value);
+            continue;
+        }
+
+        if (m_namesLoaded == false) {
+            listNames(m_names);
+            m_namesLoaded = true;
+        }
+        if (isRegex) {
+            try {
+                std::regex re(entry.substr(1, entry.size() - 2));
+                for (auto nit = m_names.begin(); nit != m_names.end(); ++nit)
+                    if (std::regex_search(nit->first, re))
+                        set(nit->second, value);
+            }
+            catch (std::regex_error &e) {
+                fprintf(stderr, "rpd_tracer: bad regex in api filter: %s (%s)\n", entry.c_str(), e.what());
+                ok = false;
+            }
+        }
+        else {
+            for (auto nit = m_names.begin(); nit != m_names.end(); ++nit)
+                if (fnmatch(entry.c_str(), nit->first.c_str(), 0) == 0)
+                    set(nit->second, value);
+        }
+    }
+    return ok;
+}
+
 bool ApiIdList::loadUserPrefs()
 {
-  // FIXME: check an ENV variable that points to an exclude file
-  return false;
+    // RPDT_API_FILTER_FILE is applied first, then RPDT_API_FILTER
+    bool loaded = false;
+    const char *val = getenv("RPDT_API_FILTER_FILE");
+    if (val != nullptr) {
+        std::ifstream file(val);
+        if (file) {
+            std::stringstream spec;
+            spec << file.rdbuf();
+            addSpec(spec.str());
+            loaded = true;
+        }
+        else
+            fprintf(stderr, "rpd_tracer: unable to read api filter file: %s\n", val);
+    }
+    val = getenv("RPDT_API_FILTER");
+    if (val != nullptr) {
+        addSpec(val);
+        loaded = true;
+    }
+    return loaded;
 }
-bool ApiIdList::contains(uint32_t apiId)
+
+bool ApiIdList::contains(uint32_t apiId) const
+{
+  const bool listed = apiId < m_filter.size() && m_filter[apiId];
+  return listed ? !m_invert : m_invert;  // XOR
+}
+
+std::vector<uint32_t> ApiIdList::filterList() const
 {
-  return (m_filter.find(apiId) != m_filter.end()) ? !m_invert : m_invert;  // XOR
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < m_filter.size(); ++i)
+        if (m_filter[i])
+            ids.push_back(i);
+    return ids;
 }
@@ -22,7 +22,8 @@
 #pragma once
 
 #include <string>
-#include <map>
+#include <vector>
+#include <utility>
 #include <unordered_map>
 #include <cstddef>
 #include <cstdint>
@@ -34,26 +35,46 @@
 //   contains() are items you are interested in, i.e. matches the filter
 //   "normal mode": things you add() are the only things matching the filter
 //   invertMode() == true: All things match filter except what you add()
+//
+// Filter specs, applied with addSpec().  Entries are separated by commas or whitespace
+//   name        exact api name
+//   hipEvent*   glob (fnmatch)
+//   /^hip.*Get/ regex (ECMAScript, searched)
+//   -entry      take matching apis back out of the list
+//   include:    switch to normal mode and clear the list
+//   exclude:    switch to invert mode and clear the list
+//   # ...       comment to end of line
+// Patterns are resolved against the domain's api names once, when the spec is applied.
 
 class ApiIdList
 {
 public:
   ApiIdList();
+  virtual ~ApiIdList() { }
   bool invertMode() { return m_invert; }
   void setInvertMode(bool invert) { m_invert = invert; }
   void add(const std::string &apiName);
   void remove(const std::string &apiName);
+  bool addSpec(const std::string &spec);
   bool loadUserPrefs();
 
   // Map api string to cnid enum
   virtual uint32_t mapName(const std::string &apiName) = 0;
 
-  bool contains(uint32_t apiId);
+  // Every (name, cid) in the domain.  Used to resolve patterns
+  virtual void listNames(std::vector<std::pair<std::string, uint32_t>> &names) = 0;
 
-  const std::unordered_map<uint32_t, uint32_t> &filterList() { return m_filter; }
+  bool contains(uint32_t apiId) const;
+
+  // cids add()ed to the list
+  std::vector<uint32_t> filterList() const;
 
 private:
-  std::unordered_map<uint32_t, uint32_t> m_filter;	// apiId -> "1"
+  std::vector<bool> m_filter;	// apiId -> in list
   bool m_invert;
-};
 
+  std::vector<std::pair<std::string, uint32_t>> m_names;
+  bool m_namesLoaded {false};
+
+  void set(uint32_t apiId, bool value);
+};
@@ -23,16 +23,20 @@
 
 #include <thread>
 #include <deque>
-#include <map>
+#include <set>
 #include <array>
 #include <mutex>
+#include <atomic>
 
 #include "Utility.h"
+#include "FlightRecorder.h"
 
 
 const char *SCHEMA_API = "CREATE TEMPORARY TABLE \"temp_rocpd_api\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"pid\" integer NOT NULL, \"tid\" integer NOT NULL, \"start\" integer NOT NULL, \"end\" integer NOT NULL, \"apiName_id\" integer NOT NULL REFERENCES \"rocpd_string\" (\"id\") DEFERRABLE INITIALLY DEFERRED, \"args_id\" integer NOT NULL REFERENCES \"rocpd_string\" (\"id\") DEFERRABLE INITIALLY DEFERRED)";
 
 
+class RoctxStack;
+
 class ApiTablePrivate
 {
 public:
@@ -41,12 +45,21 @@ public:
     static const int BATCHSIZE = 4096;           // rows per transaction
     std::array<ApiTable::row, BUFFERSIZE> rows; // Circular buffer
 
-    std::map<std::pair<sqlite3_int64, sqlite3_int64>, std::deque<ApiTable::row>> roctxStacks;
+    // roctx range stacks live in thread local storage.  The registry is only used to end
+    //   open ranges in suspendRoctx() and is not touched by push or pop.
+    RoctxStack &roctxStack();
+    std::mutex registryMutex;
+    std::set<RoctxStack*> roctxStacks;
+    std::deque<ApiTable::row> orphanedRanges;    // Open ranges from exited threads
+    void insertRange(ApiTable::row &row);
 
     sqlite3_stmt *apiInsert;
     sqlite3_stmt *apiInsertNoId;
 
-    sqlite3_int64 roctxResumeTime;
+    std::atomic<sqlite3_int64> roctxResumeTime;
+
+    RecorderWindow<ApiTable::row> window;     // flight recorder
+    void insertRow(const ApiTable::row &row);
 
     ApiTable *p;
 };
@@ -75,25 +88,34 @@ ApiTable::~ApiTable()
 
 void ApiTable::insert(const ApiTable::row &row)
 {
+    if (d->window.active()) {
+        d->window.record(row);
+        FlightRecorder::singleton().checkDuration(row.start, row.end);
+        return;
+    }
+
     std::unique_lock<std::mutex> lock(m_mutex);
 
-    if (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
-        // buffer is full; insert in-line or wait
+    while (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
+        // buffer is full; wait.  Recheck after logging the stall
         //const timestamp_t start = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
 	//FIXME
         const timestamp_t start = clocktime_ns();
-        // FIXME: overhead record here
-        m_wait.notify_one();  // make sure working is running
-        m_wait.wait(lock);
+        while (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
+            m_wait.notify_one();  // make sure working is running
+            m_wait.wait(lock);
+        }
         //const timestamp_t end = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
 	//FIXME
         const timestamp_t end = clocktime_ns();
+        countBlocked(end - start);
         lock.unlock();
-        createOverheadRecord(start, end, "BLOCKING", "rpd_tracer::ApiTable::insert");
+        createTelemetryRecord("ApiTable::insert", start, end, 0, ApiTablePrivate::BUFFERSIZE, end - start);
         lock.lock();
     }
 
     d->rows[(++m_head) % ApiTablePrivate::BUFFERSIZE] = row;
+    countInsert();
 
     if (workerRunning() == false && (m_head - m_tail) >= ApiTablePrivate::BATCHSIZE) {
         lock.unlock();
@@ -101,26 +123,39 @@ void ApiTable::insert(const ApiTable::row &row)
     }
 }
 
-static sqlite3_int64 roctx_id_hack = sqlite3_int64(1) << 31;
+// Shared by the ring sets, see Numa.h
+static std::atomic<sqlite3_int64> roctx_id_hack {sqlite3_int64(1) << 31};
 
 void ApiTable::insertRoctx(ApiTable::row &row)
 {
+    if (d->window.active()) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        row.api_id = ++roctx_id_hack;
+        lock.unlock();
+        d->window.record(row);
+        return;
+    }
+
     std::unique_lock<std::mutex> lock(m_mutex);
-    if (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
+    while (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
         //const timestamp_t start = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
 	//FIXME
         const timestamp_t start = clocktime_ns();
-        m_wait.notify_one();
-        m_wait.wait(lock);
+        while (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
+            m_wait.notify_one();
+            m_wait.wait(lock);
+        }
         //const timestamp_t end = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
 	//FIXME
         const timestamp_t end = clocktime_ns();
+        countBlocked(end - start);
         lock.unlock();
-        createOverheadRecord(start, end, "BLOCKING", "rpd_tracer::ApiTable::insert");
+        createTelemetryRecord("ApiTable::insert", start, end, 0, ApiTablePrivate::BUFFERSIZE, end - start);
         lock.lock();
     }
     row.api_id = ++roctx_id_hack;
     d->rows[(++m_head) % ApiTablePrivate::BUFFERSIZE] = row;
+    countInsert();
 
     if (workerRunning() == false && (m_head - m_tail) >= ApiTablePrivate::BATCHSIZE) {
         lock.unlock();
@@ -128,81 +163,157 @@ void ApiTable::insertRoctx(ApiTable::row &row)
     }
 }
 
-void ApiTable::pushRoctx(const ApiTable::row &row)
+// Per-thread roctx range stack.  Only the owning thread pushes and pops.  The mutex is
+//   uncontended except when suspendRoctx() ends the open ranges from another thread.
+class RoctxStack
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    auto key = std::pair<sqlite3_int64, sqlite3_int64>(row.pid, row.tid);
-    auto &stack = d->roctxStacks[key];
-    stack.push_front(row);
+public:
+    std::mutex mutex;
+    std::deque<ApiTable::row> rows;
+};
+
+// Thread exit hands any still-open ranges back to the table so suspendRoctx() can end them
+class RoctxStackHolder
+{
+public:
+    ~RoctxStackHolder();
+    RoctxStack *stack {nullptr};
+    ApiTablePrivate *owner {nullptr};
+};
+
+static thread_local RoctxStackHolder roctxStackHolder;
+
+RoctxStack &ApiTablePrivate::roctxStack()
+{
+    if (roctxStackHolder.stack == nullptr) {
+        roctxStackHolder.stack = new RoctxStack();
+        roctxStackHolder.owner = this;
+        std::lock_guard<std::mutex> guard(registryMutex);
+        roctxStacks.insert(roctxStackHolder.stack);
+    }
+    return *roctxStackHolder.stack;
 }
 
-void ApiTable::popRoctx(const ApiTable::row &row)
+RoctxStackHolder::~RoctxStackHolder()
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    if (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
-        //const timestamp_t start = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
-	//FIXME
+    if (stack == nullptr)
+        return;
+    std::lock_guard<std::mutex> guard(owner->registryMutex);
+    {
+        std::lock_guard<std::mutex> sguard(stack->mutex);
+        for (auto it = stack->rows.begin(); it != stack->rows.end(); ++it)
+            owner->orphanedRanges.push_back(*it);
+    }
+    owner->roctxStacks.erase(stack);
+    delete stack;
+    stack = nullptr;
+}
+
+void ApiTablePrivate::insertRange(ApiTable::row &row)
+{
+    if (window.active()) {
+        std::unique_lock<std::mutex> lock(p->m_mutex);
+        row.api_id = ++roctx_id_hack;
+        lock.unlock();
+        window.record(row);
+        FlightRecorder::singleton().checkDuration(row.start, row.end);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(p->m_mutex);
+    while (p->m_head - p->m_tail >= ApiTablePrivate::BUFFERSIZE) {
         const timestamp_t start = clocktime_ns();
-        m_wait.notify_one();
-        m_wait.wait(lock);
-        //const timestamp_t end = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
-	//FIXME
+        while (p->m_head - p->m_tail >= ApiTablePrivate::BUFFERSIZE) {
+            p->m_wait.notify_one();
+            p->m_wait.wait(lock);
+        }
         const timestamp_t end = clocktime_ns();
+        p->countBlocked(end - start);
         lock.unlock();
-        createOverheadRecord(start, end, "BLOCKING", "rpd_tracer::ApiTable::insert");
+        createTelemetryRecord("ApiTable::insert", start, end, 0, ApiTablePrivate::BUFFERSIZE, end - start);
         lock.lock();
     }
-    auto key = std::pair<sqlite3_int64, sqlite3_int64>(row.pid, row.tid);
-    auto &stack = d->roctxStacks[key];
-    if (stack.empty() == false) {
-        ApiTable::row &r = stack.front();
-        r.end = row.end;
-        r.api_id = ++roctx_id_hack;
-        d->rows[(++m_head) % ApiTablePrivate::BUFFERSIZE] = r;
-        stack.pop_front();
+    row.api_id = ++roctx_id_hack;
+    rows[(++(p->m_head)) % ApiTablePrivate::BUFFERSIZE] = row;
+    p->countInsert();
+
+    if (p->workerRunning() == false && (p->m_head - p->m_tail) >= ApiTablePrivate::BATCHSIZE) {
+        lock.unlock();
+        p->m_wait.notify_one();
     }
-    else {  // Pop without a push.  This is due to suspend/resume.  Fudge the start.
-        ApiTable::row &r = const_cast<ApiTable::row&>(row);
-        r.start = d->roctxResumeTime;
-        r.api_id = ++roctx_id_hack;
-        d->rows[(++m_head) % ApiTablePrivate::BUFFERSIZE] = r;
+}
+
+// Flight recorder dump.  Rows already have their ids
+void ApiTablePrivate::insertRow(const ApiTable::row &row)
+{
+    std::unique_lock<std::mutex> lock(p->m_mutex);
+    while (p->m_head - p->m_tail >= ApiTablePrivate::BUFFERSIZE) {
+        p->m_wait.notify_one();
+        p->m_wait.wait(lock);
     }
+    rows[(++(p->m_head)) % ApiTablePrivate::BUFFERSIZE] = row;
+    p->countInsert();
 
-    if (workerRunning() == false && (m_head - m_tail) >= ApiTablePrivate::BATCHSIZE) {
+    if (p->workerRunning() == false && (p->m_head - p->m_tail) >= ApiTablePrivate::BATCHSIZE) {
         lock.unlock();
-        m_wait.notify_one();
+        p->m_wait.notify_one();
     }
 }
 
-void ApiTable::suspendRoctx(sqlite3_int64 atTime)
+void ApiTable::dumpWindow()
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    if (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
-        m_wait.notify_one();
-        m_wait.wait(lock);
+    d->window.drain([this](const ApiTable::row &row) { d->insertRow(row); });
+}
+
+void ApiTable::pushRoctx(const ApiTable::row &row)
+{
+    RoctxStack &stack = d->roctxStack();
+    std::lock_guard<std::mutex> guard(stack.mutex);
+    stack.rows.push_back(row);
+}
+
+void ApiTable::popRoctx(const ApiTable::row &row)
+{
+    RoctxStack &stack = d->roctxStack();
+    ApiTable::row r;
+    {
+        std::lock_guard<std::mutex> guard(stack.mutex);
+        if (stack.rows.empty() == false) {
+            r = stack.rows.back();
+            r.end = row.end;
+            stack.rows.pop_back();
+        }
+        else {  // Pop without a push.  This is due to suspend/resume.  Fudge the start.
+            r = row;
+            r.start = d->roctxResumeTime;
+        }
     }
+    d->insertRange(r);
+}
 
+void ApiTable::suspendRoctx(sqlite3_int64 atTime)
+{
     // Profiling is suspended, we won't get pops for anything pushed.  So end them all now.
-    auto it = d->roctxStacks.begin();
-    while (it != d->roctxStacks.end()) {
-        auto &stack = it->second;
-        while (stack.empty() == false) {
-            // Make sure there is room
-            if (m_head - m_tail >= ApiTablePrivate::BUFFERSIZE) {
-                m_wait.notify_one();
-                m_wait.wait(lock);
+    std::deque<ApiTable::row> open;
+    {
+        std::lock_guard<std::mutex> guard(d->registryMutex);
+        open.swap(d->orphanedRanges);
+        for (auto it = d->roctxStacks.begin(); it != d->roctxStacks.end(); ++it) {
+            RoctxStack &stack = **it;
+            std::lock_guard<std::mutex> sguard(stack.mutex);
+            // Innermost first, matching the order pops would have arrived in
+            while (stack.rows.empty() == false) {
+                open.push_back(stack.rows.back());
+                stack.rows.pop_back();
             }
-            ApiTable::row &r = stack.front();
-            r.end = atTime;
-            r.api_id = ++roctx_id_hack;
-            d->rows[(++m_head) % ApiTablePrivate::BUFFERSIZE] = r;
-            stack.pop_front();
         }
-        ++it;
     }
 
-    if (workerRunning() == false && (m_head - m_tail) >= ApiTablePrivate::BATCHSIZE)
-        m_wait.notify_one();
+    for (auto it = open.begin(); it != open.end(); ++it) {
+        ApiTable::row &r = *it;
+        r.end = atTime;
+        d->insertRange(r);
+    }
 }
 
 void ApiTable::resumeRoctx(sqlite3_int64 atTime)
@@ -257,6 +368,7 @@ void ApiTable::writeRows()
     }
     lock.lock();
     m_tail = end;
+    countWritten(end - start + 1, (end - start + 1) * sizeof(ApiTable::row));
     lock.unlock();
 
     //const timestamp_t cb_mid_time = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
@@ -264,7 +376,5 @@ void ApiTable::writeRows()
     //const timestamp_t cb_end_time = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
     //FIXME
     const timestamp_t cb_end_time = clocktime_ns();
-    char buff[4096];
-    std::snprintf(buff, 4096, "count=%d | remaining=%d", end - start + 1, m_head - m_tail);
-    createOverheadRecord(cb_begin_time, cb_end_time, "ApiTable::writeRows", buff);
+    createTelemetryRecord("ApiTable::writeRows", cb_begin_time, cb_end_time, end - start + 1, m_head - m_tail, 0);
 }
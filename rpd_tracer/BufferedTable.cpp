@@ -3,6 +3,7 @@
  **************************************************************************/
 #include "Table.h"
 #include "Utility.h"
+#include "Numa.h"
 
 #include <thread>
 
@@ -73,6 +74,12 @@ void BufferedTable::finalize()
 }
 
 
+void BufferedTable::pinWriter(const std::vector<int> &cpus)
+{
+    Numa::pin(d->worker->native_handle(), cpus);
+}
+
+
 bool BufferedTable::workerRunning()
 {
     return d->workerRunning;
@@ -90,6 +97,7 @@ void BufferedTablePrivate::work()
             lock.lock();
         }
         workerRunning = false;
+        p->m_wait.notify_all();     // flush() waits for the worker to go idle
         if (done == false)
             p->m_wait.wait(lock);
         workerRunning = true;
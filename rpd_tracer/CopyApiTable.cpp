@@ -27,6 +27,7 @@
 
 #include "rpd_tracer.h"
 #include "Utility.h"
+#include "FlightRecorder.h"
 
 
 const char *SCHEMA_COPYAPI = "CREATE TEMPORARY TABLE \"temp_rocpd_copyapi\" (\"api_ptr_id\" integer NOT NULL PRIMARY KEY REFERENCES \"rocpd_api\" (\"id\") DEFERRABLE INITIALLY DEFERRED, \"stream\" varchar(18) NOT NULL, \"size\" integer NOT NULL, \"width\" integer NOT NULL, \"height\" integer NOT NULL, \"kind\" integer NOT NULL, \"dst\" varchar(18) NOT NULL, \"src\" varchar(18) NOT NULL, \"dstDevice\" integer NOT NULL, \"srcDevice\" integer NOT NULL, \"sync\" bool NOT NULL, \"pinned\" bool NOT NULL);";
@@ -41,6 +42,9 @@ public:
 
     sqlite3_stmt *apiInsert;
 
+    RecorderWindow<CopyApiTable::row> window;     // flight recorder
+    void insertRow(const CopyApiTable::row &row);
+
     CopyApiTable *p;
 };
 
@@ -66,18 +70,37 @@ CopyApiTable::~CopyApiTable()
 
 void CopyApiTable::insert(const CopyApiTable::row &row)
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    while (m_head - m_tail >= CopyApiTablePrivate::BUFFERSIZE) {
-        // buffer is full; insert in-line or wait
-        m_wait.notify_one();  // make sure working is running
-        m_wait.wait(lock);
+    if (d->window.active()) {
+        d->window.record(row, row.stream.capacity() + row.dst.capacity() + row.src.capacity());
+        return;
+    }
+    d->insertRow(row);
+}
+
+void CopyApiTable::dumpWindow()
+{
+    d->window.drain([this](const CopyApiTable::row &row) { d->insertRow(row); });
+}
+
+void CopyApiTablePrivate::insertRow(const CopyApiTable::row &row)
+{
+    std::unique_lock<std::mutex> lock(p->m_mutex);
+    if (p->m_head - p->m_tail >= CopyApiTablePrivate::BUFFERSIZE) {
+        const timestamp_t start = clocktime_ns();
+        while (p->m_head - p->m_tail >= CopyApiTablePrivate::BUFFERSIZE) {
+            // buffer is full; insert in-line or wait
+            p->m_wait.notify_one();  // make sure working is running
+            p->m_wait.wait(lock);
+        }
+        p->countBlocked(clocktime_ns() - start);
     }
 
-    d->rows[(++m_head) % CopyApiTablePrivate::BUFFERSIZE] = row;
+    rows[(++p->m_head) % CopyApiTablePrivate::BUFFERSIZE] = row;
+    p->countInsert();
 
-    if (workerRunning() == false && (m_head - m_tail) >= CopyApiTablePrivate::BATCHSIZE) {
+    if (p->workerRunning() == false && (p->m_head - p->m_tail) >= CopyApiTablePrivate::BATCHSIZE) {
         lock.unlock();
-        m_wait.notify_one();
+        p->m_wait.notify_one();
     }
 }
 
@@ -112,6 +135,7 @@ void CopyApiTable::writeRows()
 
     sqlite3_exec(m_connection, "BEGIN DEFERRED TRANSACTION", NULL, NULL, NULL);
 
+    uint64_t bytes = 0;
     for (int i = start; i <= end; ++i) {
         int index = 1;
         CopyApiTable::row &r = d->rows[i % BUFFERSIZE];
@@ -141,11 +165,13 @@ void CopyApiTable::writeRows()
         sqlite3_bind_int(d->apiInsert, index++, r.srcDevice);
         sqlite3_bind_int(d->apiInsert, index++, r.sync);
         sqlite3_bind_int(d->apiInsert, index++, r.pinned);
+        bytes += sizeof(CopyApiTable::row) + r.stream.size() + r.dst.size() + r.src.size();
         int ret = sqlite3_step(d->apiInsert);
         sqlite3_reset(d->apiInsert);
     }
     lock.lock();
     m_tail = end;
+    countWritten(end - start + 1, bytes);
     lock.unlock();
 
     //const timestamp_t cb_mid_time = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
@@ -153,7 +179,5 @@ void CopyApiTable::writeRows()
     //const timestamp_t cb_end_time = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
     // FIXME
     const timestamp_t cb_end_time = clocktime_ns();
-    char buff[4096];
-    std::snprintf(buff, 4096, "count=%d | remaining=%d", end - start + 1, m_head - m_tail);
-    createOverheadRecord(cb_begin_time, cb_end_time, "CopyApiTable::writeRows", buff);
+    createTelemetryRecord("CopyApiTable::writeRows", cb_begin_time, cb_end_time, end - start + 1, m_head - m_tail, 0);
 }
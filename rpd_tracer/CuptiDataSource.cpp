@@ -48,8 +48,28 @@ extern "C" {
 static std::once_flag register_once;
 static std::once_flag registerAgain_once;
 
+CuptiDataSource *CuptiDataSource::s_instance = nullptr;
+
+static const size_t BUFFER_ALIGNMENT = 4096;
+
 void CuptiDataSource::init()
 {
+    s_instance = this;
+
+    // Preallocate activity buffers
+    const char *val = getenv("RPDT_CUPTI_BUFFER_SIZE");
+    if (val != nullptr && atoll(val) > 0)
+        m_bufferSize = (atoll(val) + BUFFER_ALIGNMENT - 1) & ~(BUFFER_ALIGNMENT - 1);
+    int count = 4;
+    val = getenv("RPDT_CUPTI_BUFFER_COUNT");
+    if (val != nullptr && atoi(val) > 0)
+        count = atoi(val);
+    for (int i = 0; i < count; ++i)
+        m_freeBuffers.push_back(allocateBuffer());
+
+    m_done = false;
+    m_worker = new std::thread(&CuptiDataSource::work, this);
+    Numa::pin(m_worker->native_handle(), Numa::singleton().writerCpus(-1));
 
     // Pick some apis to ignore
     m_apiList.setInvertMode(true);  // Omit the specified api
@@ -57,6 +77,9 @@ void CuptiDataSource::init()
     m_apiList.add("cudaSetDevice_v3020");
     m_apiList.add("cudaGetLastError_v3020");
 
+    // RPDT_API_FILTER_FILE / RPDT_API_FILTER
+    m_apiList.loadUserPrefs();
+
     //FIXME: gross
     setenv("NVTX_INJECTION64_PATH", "/usr/local/cuda/targets/x86_64-linux/lib/libcupti.so", 0);
 
@@ -85,24 +108,41 @@ void CuptiDataSource::init()
 void CuptiDataSource::end()
 {
     cuptiActivityFlushAll(1);
+
+    std::unique_lock<std::mutex> lock(m_bufferMutex);
+    m_done = true;
+    m_bufferWait.notify_all();
+    lock.unlock();
+    m_worker->join();	// Drains any remaining buffers
+    delete m_worker;
+    m_worker = nullptr;
+
+    reportDroppedRecords();
+
+    lock.lock();
+    for (auto it = m_freeBuffers.begin(); it != m_freeBuffers.end(); ++it)
+        free(*it);
+    m_freeBuffers.clear();
 }
 
 void CuptiDataSource::startTracing()
 {
+    std::unique_lock<std::mutex> lock(m_apiListMutex);
+    m_tracing = true;
     if (m_apiList.invertMode() == true) {
         // exclusion list - enable entire domain and turn off things in list
         cuptiEnableDomain(1, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API);
-        const std::unordered_map<uint32_t, uint32_t> &filter = m_apiList.filterList();
+        const std::vector<uint32_t> filter = m_apiList.filterList();
         for (auto it = filter.begin(); it != filter.end(); ++it) {
-            cuptiEnableCallback(0, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API, it->first);
+            cuptiEnableCallback(0, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API, *it);
         }
     }
     else {
         // inclusion list - only enable things in the list
         cuptiEnableDomain(0, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API);
-        const std::unordered_map<uint32_t, uint32_t> &filter = m_apiList.filterList();
+        const std::vector<uint32_t> filter = m_apiList.filterList();
         for (auto it = filter.begin(); it != filter.end(); ++it) {
-            cuptiEnableCallback(1, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API, it->first);
+            cuptiEnableCallback(1, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API, *it);
         }
     }
 
@@ -114,6 +154,8 @@ void CuptiDataSource::startTracing()
 
 void CuptiDataSource::stopTracing()
 {
+    std::unique_lock<std::mutex> lock(m_apiListMutex);
+    m_tracing = false;
     cuptiEnableDomain(0, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API);
     cuptiEnableDomain(0, m_subscriber, CUPTI_CB_DOMAIN_NVTX);
     cuptiActivityDisable(CUPTI_ACTIVITY_KIND_MEMCPY);
@@ -121,9 +163,32 @@ void CuptiDataSource::stopTracing()
     cuptiActivityDisable(CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL);
 }
 
+bool CuptiDataSource::setApiFilter(const std::string &spec)
+{
+    std::unique_lock<std::mutex> lock(m_apiListMutex);
+    CudaApiIdList apiList = m_apiList;
+    if (apiList.addSpec(spec) == false)
+        return false;
+
+    // Callbacks are (re)enabled from the list in startTracing().  Only touch what changed
+    if (m_tracing) {
+        std::vector<std::pair<std::string, uint32_t>> names;
+        apiList.listNames(names);
+        for (auto it = names.begin(); it != names.end(); ++it) {
+            const bool enable = apiList.contains(it->second);
+            if (enable != m_apiList.contains(it->second))
+                cuptiEnableCallback(enable ? 1 : 0, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API, it->second);
+        }
+    }
+    m_apiList = apiList;
+    return true;
+}
+
 void CuptiDataSource::flush()
 {
     cuptiActivityFlushAll(0);
+    waitForCompletedBuffers();
+    reportDroppedRecords();
 }
 
 void CUPTIAPI CuptiDataSource::api_callback(void *userdata, CUpti_CallbackDomain domain, CUpti_CallbackId cbid, const CUpti_CallbackData *cbInfo)
@@ -649,16 +714,91 @@ void CUPTIAPI CuptiDataSource::api_callback(void *userdata, CUpti_CallbackDomain
 }
 
 
+uint8_t *CuptiDataSource::allocateBuffer()
+{
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, BUFFER_ALIGNMENT, m_bufferSize) != 0)
+        return nullptr;
+    ++m_bufferCount;
+    return (uint8_t*)buffer;
+}
+
 void CUPTIAPI CuptiDataSource::bufferRequested(uint8_t **buffer, size_t *size, size_t *maxNumRecords)
 {
-    *buffer = (uint8_t*)malloc(16 * 1024);
-    *size = 16 * 1024;
+    CuptiDataSource &source = *s_instance;
+    std::unique_lock<std::mutex> lock(source.m_bufferMutex);
+    if (source.m_freeBuffers.empty() == false) {
+        *buffer = source.m_freeBuffers.front();
+        source.m_freeBuffers.pop_front();
+    }
+    else {
+        // Never make CUPTI wait on us.  Grow the pool instead.
+        *buffer = source.allocateBuffer();
+    }
+    *size = (*buffer != nullptr) ? source.m_bufferSize : 0;
     *maxNumRecords = 0;
 }
 
 void CUPTIAPI CuptiDataSource::bufferCompleted(CUcontext ctx, uint32_t streamId, uint8_t *buffer, size_t size, size_t validSize)
+{
+    CuptiDataSource &source = *s_instance;
+
+    // Count records dropped from the queue.  Reported in rocpd_metadata.
+    size_t dropped = 0;
+    if (cuptiActivityGetNumDroppedRecords(ctx, streamId, &dropped) == CUPTI_SUCCESS)
+        source.m_droppedRecords += dropped;
+
+    std::unique_lock<std::mutex> lock(source.m_bufferMutex);
+    source.m_completedBuffers.push_back({buffer, validSize});
+    source.m_bufferWait.notify_all();
+    lock.unlock();
+
+    std::call_once(registerAgain_once, atexit, Logger::rpdFinalize);
+}
+
+void CuptiDataSource::work()
+{
+    std::unique_lock<std::mutex> lock(m_bufferMutex);
+    while (true) {
+        while (m_completedBuffers.empty() == false) {
+            CompletedBuffer completed = m_completedBuffers.front();
+            m_completedBuffers.pop_front();
+            m_processing = true;
+            lock.unlock();
+
+            processBuffer(completed.buffer, completed.validSize);
+
+            lock.lock();
+            m_processing = false;
+            m_freeBuffers.push_back(completed.buffer);
+            m_bufferWait.notify_all();
+        }
+        if (m_done)
+            break;
+        m_bufferWait.wait(lock);
+    }
+}
+
+void CuptiDataSource::waitForCompletedBuffers()
+{
+    std::unique_lock<std::mutex> lock(m_bufferMutex);
+    while (m_completedBuffers.empty() == false || m_processing)
+        m_bufferWait.wait(lock);
+}
+
+void CuptiDataSource::reportDroppedRecords()
+{
+    Logger &logger = Logger::singleton();
+    logger.metadataTable().set(
+        fmt::format("cupti_dropped_records::{}", logger.metadataTable().sessionId()),
+        fmt::format("{}", m_droppedRecords.load()));
+}
+
+void CuptiDataSource::processBuffer(uint8_t *buffer, size_t validSize)
 {
     Logger &logger = Logger::singleton();
+    static sqlite3_int64 memcpyId = logger.stringTable().getOrCreate("Memcpy");
+    static sqlite3_int64 memsetId = logger.stringTable().getOrCreate("Memset");
     int batchSize = 0;
     CUpti_Activity *it = NULL;
 
@@ -688,7 +828,7 @@ void CUPTIAPI CuptiDataSource::bufferCompleted(CUcontext ctx, uint32_t streamId,
                             row.start = record->start + toffset;
                             row.end = record->end + toffset;
                             row.description_id = EMPTY_STRING_ID;
-                            row.opType_id = logger.stringTable().getOrCreate("Memcpy");
+                            row.opType_id = memcpyId;
                             row.api_id = record->correlationId;
                             logger.opTable().insert(row);
                         }
@@ -704,7 +844,7 @@ void CUPTIAPI CuptiDataSource::bufferCompleted(CUcontext ctx, uint32_t streamId,
                             row.start = record->start + toffset;
                             row.end = record->end + toffset;
                             row.description_id = EMPTY_STRING_ID;
-                            row.opType_id = logger.stringTable().getOrCreate("Memset");
+                            row.opType_id = memsetId;
                             row.api_id = record->correlationId;
                             logger.opTable().insert(row);
                         }
@@ -739,16 +879,7 @@ void CUPTIAPI CuptiDataSource::bufferCompleted(CUcontext ctx, uint32_t streamId,
                 status;
             }
         } while (1);
-
-      // report any records dropped from the queue
-      size_t dropped;
-      cuptiActivityGetNumDroppedRecords(ctx, streamId, &dropped);
-      if (dropped != 0) {
-          fprintf(stderr, "Dropped %u activity records\n", (unsigned int) dropped);
-      }
     }
-    free(buffer);
-    std::call_once(registerAgain_once, atexit, Logger::rpdFinalize);
 }
 
 
@@ -761,6 +892,12 @@ CudaApiIdList::CudaApiIdList()
     }
 }
 
+void CudaApiIdList::listNames(std::vector<std::pair<std::string, uint32_t>> &names)
+{
+    for (auto it = m_nameMap.begin(); it != m_nameMap.end(); ++it)
+        names.push_back({it->first, it->second});
+}
+
 uint32_t CudaApiIdList::mapName(const std::string &apiName)
 {
     auto it = m_nameMap.find(apiName);
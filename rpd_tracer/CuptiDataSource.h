@@ -26,6 +26,11 @@
 
 #include <string>
 #include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 
@@ -37,6 +42,7 @@ class CudaApiIdList : public ApiIdList
 public:
     CudaApiIdList();
     uint32_t mapName(const std::string &apiName) override;
+    void listNames(std::vector<std::pair<std::string, uint32_t>> &names) override;
 private:
     std::unordered_map<std::string, uint32_t> m_nameMap;
 };
@@ -50,9 +56,12 @@ public:
     void startTracing() override;
     void stopTracing() override;
     void flush() override;
+    bool setApiFilter(const std::string &spec) override;
 
 private:
     CudaApiIdList m_apiList;
+    std::mutex m_apiListMutex;
+    bool m_tracing {false};
 
     CUpti_SubscriberHandle m_subscriber;
 
@@ -62,4 +71,30 @@ private:
     static void CUPTIAPI bufferRequested(uint8_t **buffer, size_t *size, size_t *maxNumRecords);
     static void CUPTIAPI bufferCompleted(CUcontext ctx, uint32_t streamId, uint8_t *buffer, size_t size, size_t validSize);
 
+    // Activity buffers are pooled and reused.  Completed buffers are queued and parsed on
+    //   our own thread so CUPTI gets its buffers back quickly.
+    //     RPDT_CUPTI_BUFFER_SIZE   bytes per buffer (default 8MB)
+    //     RPDT_CUPTI_BUFFER_COUNT  buffers preallocated (default 4).  Grows if CUPTI needs more.
+    struct CompletedBuffer {
+        uint8_t *buffer;
+        size_t validSize;
+    };
+    std::mutex m_bufferMutex;
+    std::condition_variable m_bufferWait;
+    std::deque<uint8_t*> m_freeBuffers;
+    std::deque<CompletedBuffer> m_completedBuffers;
+    size_t m_bufferSize {8 * 1024 * 1024};
+    int m_bufferCount {0};
+    bool m_processing {false};
+    bool m_done {false};
+    std::thread *m_worker {nullptr};
+    std::atomic<uint64_t> m_droppedRecords {0};
+
+    uint8_t *allocateBuffer();
+    void work();
+    void processBuffer(uint8_t *buffer, size_t validSize);
+    void waitForCompletedBuffers();
+    void reportDroppedRecords();
+
+    static CuptiDataSource *s_instance;
 };
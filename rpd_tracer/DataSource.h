@@ -21,6 +21,8 @@
 ********************************************************************************/
 #pragma once
 
+#include <string>
+
 //#include "Logger.h"
 
 class DataSource
@@ -32,4 +34,7 @@ public:
     virtual void startTracing() = 0;
     virtual void stopTracing() = 0;
     virtual void flush() = 0;
+
+    // Apply an api filter spec (see ApiIdList) while running.  False if unsupported or invalid
+    virtual bool setApiFilter(const std::string &spec) { return false; }
 };
@@ -0,0 +1,154 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#include "FlightRecorder.h"
+
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <limits>
+
+#include "Logger.h"
+
+
+FlightRecorder& FlightRecorder::singleton()
+{
+    // Never destroyed.  Tables record into it until Logger::finalize(), which runs after static destructors
+    static FlightRecorder *recorder = new FlightRecorder();
+    return *recorder;
+}
+
+FlightRecorder::FlightRecorder()
+{
+    const char *val = getenv("RPDT_RECORDER");
+    if (val == nullptr || atof(val) <= 0)
+        return;
+    m_active = true;
+    m_window = sqlite3_int64(atof(val) * 1000000000);
+
+    val = getenv("RPDT_RECORDER_MB");
+    if (val != nullptr && atoll(val) > 0)
+        m_maxBytes = atoll(val) * 1024 * 1024;
+
+    val = getenv("RPDT_RECORDER_TRIGGER_MS");
+    if (val != nullptr && atof(val) > 0) {
+        m_trigger = sqlite3_int64(atof(val) * 1000000);
+        m_worker = new std::thread(&FlightRecorder::work, this);
+    }
+
+    fprintf(stderr, "rpd_tracer: flight recorder, %s s window\n", getenv("RPDT_RECORDER"));
+}
+
+void FlightRecorder::trigger(const std::string &reason)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_worker == nullptr || m_pending.empty() == false)
+        return;
+    if (m_lastDump > 0 && sqlite3_int64(clocktime_ns()) - m_lastDump < m_window)
+        return;
+    m_pending = reason;
+    m_wait.notify_one();
+}
+
+void FlightRecorder::dump(const std::string &reason)
+{
+    if (m_active == false)
+        return;
+    std::lock_guard<std::mutex> dumpGuard(m_dumpMutex);
+    const timestamp_t begin = clocktime_ns();
+    Logger::singleton().dumpRecorder();
+    const timestamp_t end = clocktime_ns();
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_lastDump = end;
+    fprintf(stderr, "rpd_tracer: flight recorder dump (%s) in %f ms\n", reason.c_str(), (end - begin) / 1000000.0);
+}
+
+void FlightRecorder::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        while (m_done == false && m_pending.empty())
+            m_wait.wait(lock);
+        if (m_done)
+            break;
+        std::string reason = m_pending;
+        lock.unlock();
+        dump(reason);
+        lock.lock();
+        m_pending.clear();
+    }
+}
+
+void FlightRecorder::finalize()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done = true;
+    m_wait.notify_one();
+    lock.unlock();
+    if (m_worker != nullptr) {
+        m_worker->join();
+        delete m_worker;
+        m_worker = nullptr;
+    }
+}
+
+void FlightRecorder::addWindow(RecorderWindowBase *window)
+{
+    std::lock_guard<std::mutex> guard(m_windowsMutex);
+    m_windows.push_back(window);
+}
+
+void FlightRecorder::removeWindow(RecorderWindowBase *window)
+{
+    std::lock_guard<std::mutex> guard(m_windowsMutex);
+    m_windows.erase(std::remove(m_windows.begin(), m_windows.end(), window), m_windows.end());
+}
+
+void FlightRecorder::trimToBudget()
+{
+    // Trim a little below the bound so a full recorder is not rescanned on every row.
+    //   Only one window lock is held at a time; record() never takes m_windowsMutex
+    //   while holding its own.
+    std::lock_guard<std::mutex> guard(m_windowsMutex);
+    const int64_t target = m_maxBytes - m_maxBytes / 16;
+    while (bytes() > target) {
+        RecorderWindowBase *victim = nullptr;
+        sqlite3_int64 first = std::numeric_limits<sqlite3_int64>::max();
+        sqlite3_int64 second = first;
+        for (auto window : m_windows) {
+            const sqlite3_int64 t = window->oldest();
+            if (t < 0)
+                continue;
+            if (t < first) {
+                second = first;
+                first = t;
+                victim = window;
+            }
+            else if (t < second)
+                second = t;
+        }
+        if (victim == nullptr)
+            break;
+        // Everything in the victim older than the next window's oldest row goes first
+        victim->evictUntil(second, target);
+    }
+}
@@ -0,0 +1,188 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#pragma once
+
+#include <sqlite3.h>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+#include "Utility.h"
+
+// Flight recorder mode.  Api, op, kernelapi and copyapi rows are kept in memory instead of
+//   being written, and the most recent window is dumped to the trace file on a trigger.
+//     RPDT_RECORDER=<seconds>          enable, keeping the last <seconds> of events
+//     RPDT_RECORDER_MB=<MB>            memory bound across all windows (default 256)
+//     RPDT_RECORDER_TRIGGER_MS=<ms>    dump when an api or roctx range takes longer than <ms>
+//   Triggers: rpd_recorderDump(), the 'dump' remote command, or the duration threshold.
+//   Threshold triggers are ignored for one window length after a dump.
+
+class RecorderWindowBase;
+
+class FlightRecorder
+{
+public:
+    static FlightRecorder& singleton();
+
+    bool active() const { return m_active; }
+    sqlite3_int64 window() const { return m_window; }
+
+    void addBytes(int64_t bytes) { m_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+    bool overBudget() const { return m_bytes.load(std::memory_order_relaxed) > m_maxBytes; }
+    int64_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+
+    // Trigger a dump from a completed api.  The dump happens on the recorder thread
+    void checkDuration(sqlite3_int64 start, sqlite3_int64 end)
+    {
+        if (m_trigger > 0 && end - start > m_trigger)
+            trigger("duration");
+    }
+    void trigger(const std::string &reason);
+
+    // Write out the current window.  Synchronous
+    void dump(const std::string &reason);
+
+    void finalize();
+
+    // Every table window, so memory pressure evicts the oldest rows first whichever table holds them
+    void addWindow(RecorderWindowBase *window);
+    void removeWindow(RecorderWindowBase *window);
+    void trimToBudget();
+
+private:
+    FlightRecorder();
+
+    std::mutex m_windowsMutex;
+    std::vector<RecorderWindowBase*> m_windows;
+
+    bool m_active {false};
+    sqlite3_int64 m_window {0};         // ns
+    sqlite3_int64 m_trigger {0};        // ns
+    int64_t m_maxBytes {256ll * 1024 * 1024};
+    std::atomic<int64_t> m_bytes {0};
+
+    std::mutex m_mutex;
+    std::mutex m_dumpMutex;
+    std::condition_variable m_wait;
+    std::string m_pending;              // trigger reason, empty if none
+    sqlite3_int64 m_lastDump {0};
+    bool m_done {false};
+    std::thread *m_worker {nullptr};
+    void work();
+};
+
+
+class RecorderWindowBase
+{
+public:
+    virtual ~RecorderWindowBase() { }
+    // Record time of the oldest row, -1 if empty
+    virtual sqlite3_int64 oldest() = 0;
+    // Drop rows recorded at or before limit while the recorder is above target bytes
+    virtual void evictUntil(sqlite3_int64 limit, int64_t target) = 0;
+};
+
+
+// A table's rolling window.  Rows fall out once they are older than the window, or
+//   oldest first across all windows while the recorder is over its memory bound.
+template <typename Row>
+class RecorderWindow: public RecorderWindowBase
+{
+public:
+    RecorderWindow() { FlightRecorder::singleton().addWindow(this); }
+    ~RecorderWindow() { FlightRecorder::singleton().removeWindow(this); }
+
+    bool active() const { return FlightRecorder::singleton().active(); }
+
+    void record(const Row &row, size_t extraBytes = 0)
+    {
+        const sqlite3_int64 now = clocktime_ns();
+        const size_t bytes = sizeof(Entry) + extraBytes;
+        FlightRecorder &recorder = FlightRecorder::singleton();
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_rows.push_back({now, bytes, row});
+            recorder.addBytes(bytes);
+            evict(now);
+        }
+        if (recorder.overBudget())
+            recorder.trimToBudget();
+    }
+
+    // Remove everything in the window and hand it to insert(), oldest first
+    template <typename Insert>
+    void drain(Insert insert)
+    {
+        std::deque<Entry> rows;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            evict(clocktime_ns());
+            rows.swap(m_rows);
+        }
+        int64_t bytes = 0;
+        for (auto it = rows.begin(); it != rows.end(); ++it) {
+            insert(it->row);
+            bytes += it->bytes;
+        }
+        FlightRecorder::singleton().addBytes(-bytes);
+    }
+
+private:
+    struct Entry {
+        sqlite3_int64 time;
+        size_t bytes;
+        Row row;
+    };
+    std::mutex m_mutex;
+    std::deque<Entry> m_rows;
+
+    sqlite3_int64 oldest() override
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_rows.empty() ? -1 : m_rows.front().time;
+    }
+
+    void evictUntil(sqlite3_int64 limit, int64_t target) override
+    {
+        FlightRecorder &recorder = FlightRecorder::singleton();
+        std::lock_guard<std::mutex> guard(m_mutex);
+        while (m_rows.empty() == false && m_rows.front().time <= limit && recorder.bytes() > target) {
+            recorder.addBytes(-int64_t(m_rows.front().bytes));
+            m_rows.pop_front();
+        }
+    }
+
+    // Rows past the window length.  Called with m_mutex held
+    void evict(sqlite3_int64 now)
+    {
+        FlightRecorder &recorder = FlightRecorder::singleton();
+        const sqlite3_int64 oldest = now - recorder.window();
+        while (m_rows.empty() == false && m_rows.front().time < oldest) {
+            recorder.addBytes(-int64_t(m_rows.front().bytes));
+            m_rows.pop_front();
+        }
+    }
+};
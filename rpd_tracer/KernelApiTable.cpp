@@ -27,6 +27,7 @@
 
 #include "rpd_tracer.h"
 #include "Utility.h"
+#include "FlightRecorder.h"
 
 
 const char *SCHEMA_KERNELAPI = "CREATE TEMPORARY TABLE \"temp_rocpd_kernelapi\" (\"api_ptr_id\" integer NOT NULL PRIMARY KEY, \"stream\" varchar(18) NOT NULL, \"gridX\" integer NOT NULL, \"gridY\" integer NOT NULL, \"gridz\" integer NOT NULL, \"workgroupX\" integer NOT NULL, \"workgroupY\" integer NOT NULL, \"workgroupZ\" integer NOT NULL, \"groupSegmentSize\" integer NOT NULL, \"privateSegmentSize\" integer NOT NULL, \"kernelArgAddress\" varchar(18) NOT NULL, \"aquireFence\" varchar(8) NOT NULL, \"releaseFence\" varchar(8) NOT NULL, \"codeObject_id\" integer, \"kernelName_id\" integer NOT NULL)";
@@ -41,6 +42,9 @@ public:
 
     sqlite3_stmt *apiInsert;
 
+    RecorderWindow<KernelApiTable::row> window;     // flight recorder
+    void insertRow(const KernelApiTable::row &row);
+
     KernelApiTable *p;
 };
 
@@ -66,18 +70,37 @@ KernelApiTable::~KernelApiTable()
 
 void KernelApiTable::insert(const KernelApiTable::row &row)
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    while (m_head - m_tail >= KernelApiTablePrivate::BUFFERSIZE) {
-        // buffer is full; insert in-line or wait
-        m_wait.notify_one();  // make sure working is running
-        m_wait.wait(lock);
+    if (d->window.active()) {
+        d->window.record(row, row.stream.capacity());
+        return;
+    }
+    d->insertRow(row);
+}
+
+void KernelApiTable::dumpWindow()
+{
+    d->window.drain([this](const KernelApiTable::row &row) { d->insertRow(row); });
+}
+
+void KernelApiTablePrivate::insertRow(const KernelApiTable::row &row)
+{
+    std::unique_lock<std::mutex> lock(p->m_mutex);
+    if (p->m_head - p->m_tail >= KernelApiTablePrivate::BUFFERSIZE) {
+        const timestamp_t start = clocktime_ns();
+        while (p->m_head - p->m_tail >= KernelApiTablePrivate::BUFFERSIZE) {
+            // buffer is full; insert in-line or wait
+            p->m_wait.notify_one();  // make sure working is running
+            p->m_wait.wait(lock);
+        }
+        p->countBlocked(clocktime_ns() - start);
     }
 
-    d->rows[(++m_head) % KernelApiTablePrivate::BUFFERSIZE] = row;
+    rows[(++p->m_head) % KernelApiTablePrivate::BUFFERSIZE] = row;
+    p->countInsert();
 
-    if (workerRunning() == false && (m_head - m_tail) >= KernelApiTablePrivate::BATCHSIZE) {
+    if (p->workerRunning() == false && (p->m_head - p->m_tail) >= KernelApiTablePrivate::BATCHSIZE) {
         //lock.unlock();
-        m_wait.notify_one();
+        p->m_wait.notify_one();
     }
 }
 
@@ -112,6 +135,7 @@ void KernelApiTable::writeRows()
 
     sqlite3_exec(m_connection, "BEGIN DEFERRED TRANSACTION", NULL, NULL, NULL);
 
+    uint64_t bytes = 0;
     for (int i = start; i <= end; ++i) {
         int index = 1;
         KernelApiTable::row &r = d->rows[i % BUFFERSIZE];
@@ -130,11 +154,13 @@ void KernelApiTable::writeRows()
         sqlite3_bind_text(d->apiInsert, index++, "", -1, SQLITE_STATIC);
         sqlite3_bind_text(d->apiInsert, index++, "", -1, SQLITE_STATIC);
         sqlite3_bind_int64(d->apiInsert, index++, r.kernelName_id + m_idOffset);
+        bytes += sizeof(KernelApiTable::row) + r.stream.size();
         int ret = sqlite3_step(d->apiInsert);
         sqlite3_reset(d->apiInsert);
     }
     lock.lock();
     m_tail = end;
+    countWritten(end - start + 1, bytes);
     lock.unlock();
 
     //const timestamp_t cb_mid_time = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
@@ -142,7 +168,5 @@ void KernelApiTable::writeRows()
     //const timestamp_t cb_end_time = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
     // FIXME
     const timestamp_t cb_end_time = clocktime_ns() + 1;
-    char buff[4096];
-    std::snprintf(buff, 4096, "count=%d | remaining=%d", end - start + 1, m_head - m_tail);
-    createOverheadRecord(cb_begin_time, cb_end_time, "KernelApiTable::writeRows", buff);
+    createTelemetryRecord("KernelApiTable::writeRows", cb_begin_time, cb_end_time, end - start + 1, m_head - m_tail, 0);
 }
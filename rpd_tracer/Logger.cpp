@@ -25,8 +25,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fmt/format.h>
 
 #include "Utility.h"
+#include "FlightRecorder.h"
 
 
 #if 0
@@ -61,6 +65,24 @@ void rpdflush()
     Logger::singleton().rpdflush();
 }
 
+int rpd_setApiFilter(const char *spec)
+{
+    return Logger::singleton().setApiFilter(spec) ? 0 : -1;
+}
+
+void rpd_recorderDump()
+{
+    FlightRecorder::singleton().dump("api");
+}
+
+int rpd_getStats(char *buffer, int size)
+{
+    const std::string stats = Logger::singleton().getStats();
+    if (buffer != nullptr && size > 0)
+        snprintf(buffer, size, "%s", stats.c_str());
+    return stats.size();
+}
+
 void rpd_rangePush(const char *domain, const char *apiName, const char* args)
 {
     Logger::singleton().rpd_rangePush(domain, apiName, args);
@@ -80,6 +102,12 @@ void createOverheadRecord(uint64_t start, uint64_t end, const std::string &name,
 }
 
 
+void createTelemetryRecord(const char *component, uint64_t start, uint64_t end, int64_t rows, int64_t queueDepth, int64_t blocked)
+{
+    Logger::singleton().createTelemetryRecord(component, start, end, rows, queueDepth, blocked);
+}
+
+
 Logger& Logger::singleton()
 {
     static Logger logger;
@@ -100,7 +128,9 @@ void Logger::rpdstart()
     std::unique_lock<std::mutex> lock(m_activeMutex);
     if (m_activeCount == 0) {
         //fprintf(stderr, "rpd_tracer: START\n");
-        m_apiTable->resumeRoctx(clocktime_ns());
+        const sqlite3_int64 now = clocktime_ns();
+        for (auto table : m_apiTables)
+            table->resumeRoctx(now);
         for (auto it = m_sources.begin(); it != m_sources.end(); ++it)
             (*it)->startTracing();
     }
@@ -114,11 +144,93 @@ void Logger::rpdstop()
         //fprintf(stderr, "rpd_tracer: STOP\n");
         for (auto it = m_sources.begin(); it != m_sources.end(); ++it)
             (*it)->stopTracing();
-        m_apiTable->suspendRoctx(clocktime_ns());
+        const sqlite3_int64 now = clocktime_ns();
+        for (auto table : m_apiTables)
+            table->suspendRoctx(now);
     }
     --m_activeCount;
 }
 
+bool Logger::setApiFilter(const std::string &spec)
+{
+    bool applied = false;
+    for (auto it = m_sources.begin(); it != m_sources.end(); ++it)
+        applied = (*it)->setApiFilter(spec) || applied;
+    return applied;
+}
+
+void Logger::dumpRecorder()
+{
+    // Pull in anything the data sources are holding so it lands in the window
+    {
+        std::unique_lock<std::mutex> lock(m_activeMutex);
+        for (auto it = m_sources.begin(); it != m_sources.end(); ++it)
+            (*it)->flush();
+    }
+
+    dumpWindows();
+    rpdflush();
+}
+
+void Logger::dumpWindows()
+{
+    m_stringTable->dumpWindow();	// Strings first, rows reference them
+    for (int set = 0; set < m_numa->sets(); ++set) {
+        m_apiTables[set]->dumpWindow();
+        m_opTables[set]->dumpWindow();
+        m_kernelApiTables[set]->dumpWindow();
+        m_copyApiTables[set]->dumpWindow();
+    }
+}
+
+// Summed over a table's ring sets.  highWater is the largest single ring's
+template<typename T>
+static std::string tableStats(const char *name, const std::vector<T*> &tables)
+{
+    uint64_t inserted = 0, written = 0, highWater = 0, capacity = 0;
+    uint64_t blockedNs = 0, blockedCount = 0, dropped = 0, bytesWritten = 0;
+    for (const BufferedTable *table : tables) {
+        const TableStats &s = table->stats();
+        inserted += s.inserted.load(std::memory_order_relaxed);
+        written += s.written.load(std::memory_order_relaxed);
+        highWater = std::max<uint64_t>(highWater, s.highWater.load(std::memory_order_relaxed));
+        capacity += table->capacity();
+        blockedNs += s.blockedNs.load(std::memory_order_relaxed);
+        blockedCount += s.blockedCount.load(std::memory_order_relaxed);
+        dropped += s.dropped.load(std::memory_order_relaxed);
+        bytesWritten += s.bytesWritten.load(std::memory_order_relaxed);
+    }
+    return fmt::format("\"{}\": {{\"inserted\": {}, \"written\": {}, \"occupancy\": {}, \"highWater\": {}, "
+        "\"capacity\": {}, \"blockedNs\": {}, \"blockedCount\": {}, \"dropped\": {}, \"bytesWritten\": {}}}",
+        name, inserted, written, inserted > written ? inserted - written : 0, highWater, capacity,
+        blockedNs, blockedCount, dropped, bytesWritten);
+}
+
+std::string Logger::getStats()
+{
+    if (m_stringTable == nullptr)
+        return "{}";
+
+    std::string tables = tableStats("api", m_apiTables);
+    tables += ", " + tableStats("op", m_opTables);
+    tables += ", " + tableStats("kernelapi", m_kernelApiTables);
+    tables += ", " + tableStats("copyapi", m_copyApiTables);
+    tables += ", " + tableStats("string", std::vector<StringTable*>{m_stringTable});
+    tables += ", " + tableStats("monitor", std::vector<MonitorTable*>{m_monitorTable});
+    tables += ", " + tableStats("telemetry", std::vector<TelemetryTable*>{m_telemetryTable});
+
+    uint64_t cacheSize, lookups, hits;
+    m_stringTable->cacheStats(cacheSize, lookups, hits);
+
+    struct stat st;
+    const int64_t fileBytes = (stat(m_filename.c_str(), &st) == 0) ? st.st_size : -1;
+
+    return fmt::format("{{\"tables\": {{{}}}, \"strings\": {{\"cacheSize\": {}, \"lookups\": {}, \"hits\": {}, "
+        "\"hitRate\": {:.4f}}}, \"recorderBytes\": {}, \"fileBytes\": {}, \"ringSets\": {}}}",
+        tables, cacheSize, lookups, hits, lookups > 0 ? double(hits) / lookups : 0.0,
+        FlightRecorder::singleton().bytes(), fileBytes, m_numa->sets());
+}
+
 void Logger::rpdflush()
 {
     std::unique_lock<std::mutex> lock(m_activeMutex);
@@ -130,14 +242,19 @@ void Logger::rpdflush()
             (*it)->flush();
 
     m_stringTable->flush();
-    m_kernelApiTable->flush();
-    m_copyApiTable->flush();
-    m_opTable->flush();
-    m_apiTable->flush();
+    for (auto table : m_kernelApiTables)
+        table->flush();
+    for (auto table : m_copyApiTables)
+        table->flush();
+    for (auto table : m_opTables)
+        table->flush();
+    for (auto table : m_apiTables)
+        table->flush();
     m_monitorTable->flush();
+    m_telemetryTable->flush();
 
     const timestamp_t cb_end_time = clocktime_ns();
-    createOverheadRecord(cb_begin_time, cb_end_time, "rpdflush", "");
+    createTelemetryRecord("rpdflush", cb_begin_time, cb_end_time, 0, 0, 0);
 }
 
 void Logger::rpd_rangePush(const char *domain, const char *apiName, const char* args)
@@ -155,7 +272,7 @@ void Logger::rpd_rangePush(const char *domain, const char *apiName, const char*
     row.apiName_id = m_stringTable->getOrCreate(apiName);
     row.args_id = m_stringTable->getOrCreate(args);
     row.api_id = 0;
-    m_apiTable->pushRoctx(row);
+    apiTable().pushRoctx(row);
 }
 
 void Logger::rpd_rangePop()
@@ -173,7 +290,7 @@ void Logger::rpd_rangePop()
     row.apiName_id = EMPTY_STRING_ID;
     row.args_id = EMPTY_STRING_ID;
     row.api_id = 0;
-    m_apiTable->popRoctx(row);
+    apiTable().popRoctx(row);
 }
 
 
@@ -192,29 +309,63 @@ void Logger::init()
     setenv("RPDT_LOADED", "1", 1);
 
     // Create table recorders
+    m_numa = &Numa::singleton();
 
     m_metadataTable = new MetadataTable(filename);
     m_stringTable = new StringTable(filename);
-    m_kernelApiTable = new KernelApiTable(filename);
-    m_copyApiTable = new CopyApiTable(filename);
-    m_opTable = new OpTable(filename);
-    m_apiTable = new ApiTable(filename);
     m_monitorTable = new MonitorTable(filename);
+    m_telemetryTable = new TelemetryTable(filename);
+    m_stringTable->pinWriter(m_numa->writerCpus(-1));
+    m_monitorTable->pinWriter(m_numa->writerCpus(-1));
+    m_telemetryTable->pinWriter(m_numa->writerCpus(-1));
+
+    // One ring set per node, built on that node
+    const int sets = m_numa->sets();
+    m_kernelApiTables.resize(sets);
+    m_copyApiTables.resize(sets);
+    m_opTables.resize(sets);
+    m_apiTables.resize(sets);
+    for (int set = 0; set < sets; ++set) {
+        m_numa->runOn(set, [&]() {
+            m_kernelApiTables[set] = new KernelApiTable(filename);
+            m_copyApiTables[set] = new CopyApiTable(filename);
+            m_opTables[set] = new OpTable(filename);
+            m_apiTables[set] = new ApiTable(filename);
+        });
+        for (auto table : setTables(set))
+            table->pinWriter(m_numa->writerCpus(set));
+    }
 
     // Offset primary keys so they do not collide between sessions
     sqlite3_int64 offset = m_metadataTable->sessionId() * (sqlite3_int64(1) << 32);
     m_metadataTable->setIdOffset(offset);
     m_stringTable->setIdOffset(offset);
-    m_kernelApiTable->setIdOffset(offset);
-    m_copyApiTable->setIdOffset(offset);
-    m_opTable->setIdOffset(offset);
-    m_apiTable->setIdOffset(offset);
+    for (int set = 0; set < sets; ++set)
+        for (auto table : setTables(set))
+            table->setIdOffset(offset);
+
+    // Wall clock / monotonic pair so traces from different hosts can be aligned (rocpd.merge).
+    //   The monotonic reading brackets the wall clock one.
+    {
+        const timestamp_t before = clocktime_ns();
+        timespec wall;
+        clock_gettime(CLOCK_REALTIME, &wall);
+        const timestamp_t after = clocktime_ns();
+        const sqlite3_int64 wall_ns = sqlite3_int64(wall.tv_sec) * 1000000000 + wall.tv_nsec;
+        m_metadataTable->set("Clock::Anchor", fmt::format("{} {}", wall_ns, before + (after - before) / 2));
+        char host[256];
+        if (gethostname(host, sizeof(host)) == 0) {
+            host[sizeof(host) - 1] = '\0';
+            m_metadataTable->set("Node::Hostname", host);
+        }
+    }
 
     // Create one instance of each available datasource
     std::list<std::string> factories = {
         "RoctracerDataSourceFactory",
         "CuptiDataSourceFactory",
-        "RocmSmiDataSourceFactory"
+        "RocmSmiDataSourceFactory",
+        "SysfsDataSourceFactory"
         };
 
     void (*dl) = dlopen("librpd_tracer.so", RTLD_LAZY);
@@ -257,8 +408,45 @@ void Logger::init()
             m_period = 1000000 / frequency;  // usecs
             m_done = false;
             m_worker = new std::thread(&Logger::autoflushWorker, this);
+            Numa::pin(m_worker->native_handle(), m_numa->writerCpus(-1));
+        }
+    }
+}
+
+std::vector<BufferedTable*> Logger::setTables(int set)
+{
+    return { m_kernelApiTables[set], m_copyApiTables[set], m_opTables[set], m_apiTables[set] };
+}
+
+// Same statements as rocpd_python/rocpd/schema_data/timeIndexSchema.cmd
+static const char *TIME_INDEXES[] = {
+    "CREATE INDEX IF NOT EXISTS \"rocpd_api_start_idx\" ON \"rocpd_api\" (\"start\")",
+    "CREATE INDEX IF NOT EXISTS \"rocpd_op_start_idx\" ON \"rocpd_op\" (\"start\")",
+    "CREATE INDEX IF NOT EXISTS \"rocpd_op_gpuId_start_idx\" ON \"rocpd_op\" (\"gpuId\", \"start\")",
+    "CREATE INDEX IF NOT EXISTS \"rocpd_monitor_start_idx\" ON \"rocpd_monitor\" (\"start\")",
+    "CREATE INDEX IF NOT EXISTS \"rocpd_api_ops_api_id_f87632ad\" ON \"rocpd_api_ops\" (\"api_id\")",
+    "CREATE INDEX IF NOT EXISTS \"rocpd_api_ops_op_id_b35ab7c9\" ON \"rocpd_api_ops\" (\"op_id\")",
+};
+
+static void buildTimeIndexes(const std::string &filename)
+{
+    const timestamp_t begin_time = clocktime_ns();
+    sqlite3 *connection = nullptr;
+    if (sqlite3_open(filename.c_str(), &connection) != SQLITE_OK) {
+        sqlite3_close(connection);
+        return;
+    }
+    sqlite3_busy_timeout(connection, 10000);
+    for (auto sql : TIME_INDEXES) {
+        char *error_msg = nullptr;
+        if (sqlite3_exec(connection, sql, NULL, NULL, &error_msg) != SQLITE_OK) {
+            fprintf(stderr, "rpd_tracer: index failed: %s\n", error_msg);
+            sqlite3_free(error_msg);
         }
     }
+    sqlite3_close(connection);
+    const timestamp_t end_time = clocktime_ns();
+    fprintf(stderr, "rpd_tracer: indexed in %f ms\n", 1.0 * (end_time - begin_time) / 1000000);
 }
 
 static bool doFinalize = true;
@@ -274,24 +462,42 @@ void Logger::finalize()
         if (m_worker != nullptr)
             m_worker->join();	// deadlock in here.  try skipping if needed
 
+        FlightRecorder::singleton().finalize();
+
         for (auto it = m_sources.begin(); it != m_sources.end(); ++it)
             (*it)->stopTracing();
 
         for (auto it = m_sources.begin(); it != m_sources.end(); ++it)
             (*it)->end();
 
+        // Flight recorder: keep whatever the window holds at a normal exit
+        if (FlightRecorder::singleton().active()) {
+            fprintf(stderr, "rpd_tracer: flight recorder dump (exit)\n");
+            dumpWindows();
+        }
+
         // Flush recorders
         const timestamp_t begin_time = clocktime_ns();
-        m_opTable->finalize();		// OpTable before subclassOpTables
-        m_kernelApiTable->finalize();
-        m_copyApiTable->finalize();
+        for (auto table : m_opTables)
+            table->finalize();		// OpTable before subclassOpTables
+        for (auto table : m_kernelApiTables)
+            table->finalize();
+        for (auto table : m_copyApiTables)
+            table->finalize();
         m_monitorTable->finalize();
         m_writeOverheadRecords = false;	// Don't make any new overhead records (api calls)
-        m_apiTable->finalize();
+        for (auto table : m_apiTables)
+            table->finalize();
+        m_telemetryTable->finalize();
         m_stringTable->finalize();	// String table last
 
         const timestamp_t end_time = clocktime_ns();
         fprintf(stderr, "rpd_tracer: finalized in %f ms\n", 1.0 * (end_time - begin_time) / 1000000);
+
+        // Optional time-range indexes for windowed queries, see tools/rpd_index.py
+        const char *index = getenv("RPDT_INDEX");
+        if (index != nullptr && atoi(index) > 0)
+            buildTimeIndexes(m_filename);
     }
 }
 
@@ -303,6 +509,22 @@ void Logger::autoflushWorker()
     }
 }
 
+void Logger::createTelemetryRecord(const char *component, uint64_t start, uint64_t end, int64_t rows, int64_t queueDepth, int64_t blocked)
+{
+    if (m_writeOverheadRecords == false)
+        return;
+    TelemetryTable::row row;
+    row.pid = GetPid();
+    row.tid = GetTid();
+    row.component = component;
+    row.start = start;
+    row.end = end;
+    row.rows = rows;
+    row.queueDepth = queueDepth;
+    row.blocked = blocked;
+    m_telemetryTable->insert(row);
+}
+
 void Logger::createOverheadRecord(uint64_t start, uint64_t end, const std::string &name, const std::string &args)
 {
     if (m_writeOverheadRecords == false)
@@ -318,6 +540,6 @@ void Logger::createOverheadRecord(uint64_t start, uint64_t end, const std::strin
 
     //fprintf(stderr, "overhead: %s (%s) - %f usec\n", name.c_str(), args.c_str(), (end-start) / 1000.0);
 
-    m_apiTable->insertRoctx(row);
+    apiTable().insertRoctx(row);
 }
 
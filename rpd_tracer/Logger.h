@@ -25,9 +25,11 @@
 #include <mutex>
 #include <deque>
 #include <thread>
+#include <vector>
 
 #include "Table.h"
 #include "DataSource.h"
+#include "Numa.h"
 
 const sqlite_int64 EMPTY_STRING_ID = 1;
 
@@ -38,13 +40,16 @@ public:
     static Logger& singleton();
 
     // Table writer classes.  Used directly by DataSources
+    //   Op, kernelapi, copyapi and api tables have a ring set per NUMA node, these return the
+    //   calling thread's.  See Numa.h
     MetadataTable &metadataTable() { return *m_metadataTable; }
     StringTable &stringTable() { return *m_stringTable; }
-    OpTable &opTable() { return *m_opTable; }
-    KernelApiTable &kernelApiTable() { return *m_kernelApiTable; }
-    CopyApiTable &copyApiTable() { return *m_copyApiTable; }
-    ApiTable &apiTable() { return *m_apiTable; }
+    OpTable &opTable() { return *m_opTables[m_numa->set()]; }
+    KernelApiTable &kernelApiTable() { return *m_kernelApiTables[m_numa->set()]; }
+    CopyApiTable &copyApiTable() { return *m_copyApiTables[m_numa->set()]; }
+    ApiTable &apiTable() { return *m_apiTables[m_numa->set()]; }
     MonitorTable &monitorTable() { return *m_monitorTable; }
+    TelemetryTable &telemetryTable() { return *m_telemetryTable; }
 
 
     // External control to stop/stop logging
@@ -52,6 +57,15 @@ public:
     void rpdstop();
     void rpdflush();
 
+    // Swap api filters on the data sources while running.  See ApiIdList for the spec
+    bool setApiFilter(const std::string &spec);
+
+    // Flight recorder: write the recorded window.  See FlightRecorder
+    void dumpRecorder();
+
+    // Per-table counters, string cache and file size as a JSON object.  See TableStats
+    std::string getStats();
+
     // External maker api
     void rpd_rangePush(const char *domain, const char *apiName, const char* args);
     void rpd_rangePop();
@@ -59,6 +73,9 @@ public:
     // Insert an api event.  Used to log internal state or performance
     void createOverheadRecord(uint64_t start, uint64_t end, const std::string &name, const std::string &args);
 
+    // Tracer performance, see TelemetryTable.  component must be a string literal
+    void createTelemetryRecord(const char *component, uint64_t start, uint64_t end, int64_t rows, int64_t queueDepth, int64_t blocked);
+
 
     // Used on library load and unload.
     //  Needs assistance from DataSources to avoid shutdown corruption
@@ -75,11 +92,16 @@ private:
 
     MetadataTable *m_metadataTable {nullptr};
     StringTable *m_stringTable {nullptr};
-    OpTable *m_opTable {nullptr};
-    KernelApiTable *m_kernelApiTable {nullptr};
-    CopyApiTable *m_copyApiTable {nullptr};
-    ApiTable *m_apiTable {nullptr};
+    std::vector<OpTable*> m_opTables;
+    std::vector<KernelApiTable*> m_kernelApiTables;
+    std::vector<CopyApiTable*> m_copyApiTables;
+    std::vector<ApiTable*> m_apiTables;
     MonitorTable *m_monitorTable {nullptr};
+    TelemetryTable *m_telemetryTable {nullptr};
+    const Numa *m_numa {nullptr};
+
+    // The tables making up one ring set
+    std::vector<BufferedTable*> setTables(int set);
 
     void init();
     void finalize();
@@ -91,4 +113,5 @@ private:
     int m_period{1};
     std::thread *m_worker {nullptr};
     void autoflushWorker();
+    void dumpWindows();
 };
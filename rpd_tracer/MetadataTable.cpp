@@ -71,6 +71,23 @@ sqlite3_int64 MetadataTable::sessionId()
 	return d->sessionId;
 }
 
+void MetadataTable::set(const std::string &tag, const std::string &value)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    sqlite3_stmt *stmt;
+    sqlite3_exec(m_connection, "BEGIN EXCLUSIVE TRANSACTION", NULL, NULL, NULL);
+    sqlite3_prepare_v2(m_connection, "DELETE FROM rocpd_metadata WHERE tag = ?", -1, &stmt, NULL);
+    sqlite3_bind_text(stmt, 1, tag.c_str(), -1, SQLITE_STATIC);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    sqlite3_prepare_v2(m_connection, "INSERT into rocpd_metadata(tag, value) VALUES (?, ?)", -1, &stmt, NULL);
+    sqlite3_bind_text(stmt, 1, tag.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_STATIC);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    sqlite3_exec(m_connection, "END TRANSACTION", NULL, NULL, NULL);
+}
+
 
 void MetadataTablePrivate::createSession()
 {
@@ -22,9 +22,13 @@
 #include "Table.h"
 
 #include <thread>
-#include <map>
+#include <unordered_map>
+#include <vector>
 #include <array>
 #include <mutex>
+#include <cmath>
+
+#include <fmt/format.h>
 
 #include "rpd_tracer.h"
 #include "Utility.h"
@@ -32,29 +36,51 @@
 
 const char *SCHEMA_MONITOR = "CREATE TEMPORARY TABLE \"temp_rocpd_monitor\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"deviceType\" varchar(16) NOT NULL, \"deviceId\" integer NOT NULL, \"monitorType\" varchar(16) NOT NULL, \"start\" integer NOT NULL, \"end\" integer NOT NULL, \"value\" varchar(255) NOT NULL)";
 
+namespace {
+    // Interned monitor.  Never moved or freed while the table lives, ring entries point at these
+    struct MonitorKey {
+        std::string deviceType;
+        std::string monitorType;
+        sqlite3_int64 deviceId;
+        double deadband;
+    };
+
+    // Value currently being coalesced for a monitor
+    struct MonitorRun {
+        sqlite3_int64 start {0};
+        double value {0};
+        bool active {false};
+    };
+
+    struct MonitorRecord {
+        const MonitorKey *key;
+        sqlite3_int64 start;
+        sqlite3_int64 end;
+        double value;
+    };
+} // namespace
+
 class MonitorTablePrivate
 {
 public:
     MonitorTablePrivate(MonitorTable *cls) : p(cls) {} 
     static const int BUFFERSIZE = 4096 * 8;
     static const int BATCHSIZE = 4096;           // rows per transaction
-    std::array<MonitorTable::row, BUFFERSIZE> rows; // Circular buffer
+    std::array<MonitorRecord, BUFFERSIZE> rows; // Circular buffer
 
     sqlite3_stmt *monitorInsert;
 
-    class rowCompare
-    {
-    public:
-        bool operator() (const MonitorTable::row& lhs, const MonitorTable::row& rhs) const
-        {
-            return lhs.deviceId < rhs.deviceId
-                || lhs.monitorType < rhs.monitorType
-                || lhs.deviceType < rhs.deviceType;
-        }
-    };
+    // Run state, indexed by monitor id
+    std::mutex stateMutex;
+    std::unordered_map<std::string, uint32_t> typeIds;    // deviceType and monitorType names
+    std::unordered_map<uint64_t, int> monitorIds;         // packed (deviceType, monitorType, deviceId)
+    std::vector<MonitorKey*> keys;
+    std::vector<MonitorRun> runs;
+    std::unordered_map<std::string, double> deadbands;    // monitorType -> threshold
 
-    std::map<MonitorTable::row, bool, rowCompare> values;
-    void insertInternal(MonitorTable::row &row);
+    uint32_t typeId(const std::string &name);
+    int monitorIdLocked(const std::string &deviceType, sqlite3_int64 deviceId, const std::string &monitorType);
+    void insertInternal(const MonitorRecord &record);
 
     MonitorTable *p;
 };
@@ -75,34 +101,90 @@ MonitorTable::MonitorTable(const char *basefile)
 
 MonitorTable::~MonitorTable()
 {
+    for (auto it = d->keys.begin(); it != d->keys.end(); ++it)
+        delete *it;
     delete d;
 }
 
 
+uint32_t MonitorTablePrivate::typeId(const std::string &name)
+{
+    auto it = typeIds.find(name);
+    if (it == typeIds.end())
+        it = typeIds.insert({name, uint32_t(typeIds.size())}).first;
+    return it->second;
+}
+
+int MonitorTablePrivate::monitorIdLocked(const std::string &deviceType, sqlite3_int64 deviceId, const std::string &monitorType)
+{
+    uint64_t packed = (uint64_t(typeId(deviceType)) << 48)
+                    | (uint64_t(typeId(monitorType) & 0xffff) << 32)
+                    | (uint64_t(deviceId) & 0xffffffff);
+    auto it = monitorIds.find(packed);
+    if (it != monitorIds.end())
+        return it->second;
+
+    MonitorKey *key = new MonitorKey;
+    key->deviceType = deviceType;
+    key->monitorType = monitorType;
+    key->deviceId = deviceId;
+    auto dit = deadbands.find(monitorType);
+    key->deadband = (dit != deadbands.end()) ? dit->second : 0;
+
+    int id = keys.size();
+    keys.push_back(key);
+    runs.push_back(MonitorRun());
+    monitorIds.insert({packed, id});
+    return id;
+}
+
+int MonitorTable::monitorId(const std::string &deviceType, sqlite3_int64 deviceId, const std::string &monitorType)
+{
+    std::lock_guard<std::mutex> guard(d->stateMutex);
+    return d->monitorIdLocked(deviceType, deviceId, monitorType);
+}
+
+void MonitorTable::setDeadband(const std::string &monitorType, double threshold)
+{
+    std::lock_guard<std::mutex> guard(d->stateMutex);
+    d->deadbands[monitorType] = threshold;
+    for (auto it = d->keys.begin(); it != d->keys.end(); ++it)
+        if ((*it)->monitorType == monitorType)
+            (*it)->deadband = threshold;
+}
+
+
 void MonitorTable::insert(const MonitorTable::row &row)
 {
-    auto it = d->values.find(row);
-    if (it == d->values.end()) {
-        d->values.insert(std::pair<MonitorTable::row, bool>(row, true));
-        it = d->values.find(row);
-    }
-    MonitorTable::row &old = const_cast<MonitorTable::row&>((*it).first);  // Oh yes
-
-#if 0
-    static sqlite3_int64 prev = clocktime_ns();
-    fprintf(stderr, "      %lld   delta %lld\n", row.start, row.start - prev);
-    prev = row.start;
-#endif
-
-    if (old.value != row.value) {  // value changed, actually insert a row
-        old.end = row.start;
-        //fprintf(stderr, "+++++ %lld\n", row.start);
-        d->insertInternal(old);
-        old = row;
+    insert(monitorId(row.deviceType, row.deviceId, row.monitorType), row.start, row.value);
+}
+
+void MonitorTable::insert(int monitorId, sqlite3_int64 timestamp, double value)
+{
+    std::unique_lock<std::mutex> guard(d->stateMutex);
+    MonitorRun &run = d->runs[monitorId];
+    const MonitorKey *key = d->keys[monitorId];
+
+    if (run.active == false) {
+        run.start = timestamp;
+        run.value = value;
+        run.active = true;
+        return;
     }
+
+    if (std::fabs(value - run.value) <= key->deadband)
+        return;
+
+    // value changed, actually insert a row
+    MonitorRecord record {key, run.start, timestamp, run.value};
+    run.start = timestamp;
+    run.value = value;
+    guard.unlock();
+
+    d->insertInternal(record);
 }
 
-void MonitorTablePrivate::insertInternal(MonitorTable::row &row)
+void MonitorTablePrivate::insertInternal(const MonitorRecord &record)
 {
     std::unique_lock<std::mutex> lock(p->m_mutex);
     if (p->m_head - p->m_tail >= MonitorTablePrivate::BUFFERSIZE) {
@@ -112,12 +194,16 @@ void MonitorTablePrivate::insertInternal(MonitorTable::row &row)
         p->m_wait.wait(lock);
 
         const timestamp_t end = clocktime_ns();
+        p->countBlocked(end - start);
         lock.unlock();
-        createOverheadRecord(start, end, "BLOCKING", "rpd_tracer::MonitorTable::insert");
+        createTelemetryRecord("MonitorTable::insert", start, end, 0, MonitorTablePrivate::BUFFERSIZE, end - start);
         lock.lock();
+        if (p->m_head - p->m_tail >= MonitorTablePrivate::BUFFERSIZE)
+            p->countDropped();
     }
 
-    rows[(++(p->m_head)) % MonitorTablePrivate::BUFFERSIZE] = row;
+    rows[(++(p->m_head)) % MonitorTablePrivate::BUFFERSIZE] = record;
+    p->countInsert();
 
     if (p->workerRunning() == false && (p->m_head - p->m_tail) >= MonitorTablePrivate::BATCHSIZE) {
         lock.unlock();
@@ -127,13 +213,19 @@ void MonitorTablePrivate::insertInternal(MonitorTable::row &row)
 
 void MonitorTable::endCurrentRuns(sqlite3_int64 endTimestamp)
 {
-    for (auto it = d->values.begin(); it != d->values.end(); ++it) {
-        MonitorTable::row &old = const_cast<MonitorTable::row&>((*it).first);  // Oh yes
-        old.end = endTimestamp;
-        //fprintf(stderr, "final %lld\n", old.end);
-        d->insertInternal(old);
+    std::vector<MonitorRecord> records;
+    {
+        std::lock_guard<std::mutex> guard(d->stateMutex);
+        for (size_t i = 0; i < d->runs.size(); ++i) {
+            MonitorRun &run = d->runs[i];
+            if (run.active) {
+                records.push_back({d->keys[i], run.start, endTimestamp, run.value});
+                run.active = false;
+            }
+        }
     }
-    d->values.clear();
+    for (auto it = records.begin(); it != records.end(); ++it)
+        d->insertInternal(*it);
 }
 
 
@@ -164,26 +256,28 @@ void MonitorTable::writeRows()
 
     sqlite3_exec(m_connection, "BEGIN DEFERRED TRANSACTION", NULL, NULL, NULL);
 
+    uint64_t bytes = 0;
     for (int i = start; i <= end; ++i) {
         int index = 1;
-        MonitorTable::row &r = d->rows[i % BUFFERSIZE];
-        sqlite3_bind_text(d->monitorInsert, index++, r.deviceType.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_int64(d->monitorInsert, index++, r.deviceId);
-        sqlite3_bind_text(d->monitorInsert, index++, r.monitorType.c_str(), -1, SQLITE_STATIC);
+        MonitorRecord &r = d->rows[i % BUFFERSIZE];
+        const std::string value = fmt::format("{}", r.value);
+        sqlite3_bind_text(d->monitorInsert, index++, r.key->deviceType.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(d->monitorInsert, index++, r.key->deviceId);
+        sqlite3_bind_text(d->monitorInsert, index++, r.key->monitorType.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_int64(d->monitorInsert, index++, r.start);
         sqlite3_bind_int64(d->monitorInsert, index++, r.end);
-        sqlite3_bind_text(d->monitorInsert, index++, r.value.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(d->monitorInsert, index++, value.c_str(), -1, SQLITE_TRANSIENT);
+        bytes += sizeof(r.start) + sizeof(r.end) + value.size();
 
         int ret = sqlite3_step(d->monitorInsert);
         sqlite3_reset(d->monitorInsert);
     }
     lock.lock();
     m_tail = end;
+    countWritten(end - start + 1, bytes);
     lock.unlock();
 
     sqlite3_exec(m_connection, "END TRANSACTION", NULL, NULL, NULL);
     const timestamp_t cb_end_time = clocktime_ns();
-    char buff[4096];
-    std::snprintf(buff, 4096, "count=%d | remaining=%d", end - start + 1, m_head - m_tail);
-    createOverheadRecord(cb_begin_time, cb_end_time, "MonitorTable::writeRows", buff);
+    createTelemetryRecord("MonitorTable::writeRows", cb_begin_time, cb_end_time, end - start + 1, m_head - m_tail, 0);
 }
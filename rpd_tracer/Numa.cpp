@@ -0,0 +1,138 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#include "Numa.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <dirent.h>
+
+
+Numa& Numa::singleton()
+{
+    // Never destroyed.  Logger::finalize() runs after static destructors
+    static Numa *instance = nullptr;
+    if (instance == nullptr) {
+        const char *enable = getenv("RPDT_NUMA");
+        const char *writers = getenv("RPDT_WRITER_CPUS");
+        instance = new Numa("/sys/devices/system/node", !(enable && atoi(enable) == 0), writers ? writers : "");
+    }
+    return *instance;
+}
+
+Numa::Numa(const std::string &root, bool enable, const std::string &writerCpus)
+: m_writerCpus(parseCpuList(writerCpus))
+{
+    DIR *dir = enable ? opendir(root.c_str()) : nullptr;
+    if (dir != nullptr) {
+        std::vector<int> nodes;
+        while (struct dirent *entry = readdir(dir)) {
+            int node;
+            char extra;
+            if (sscanf(entry->d_name, "node%d%c", &node, &extra) == 1)
+                nodes.push_back(node);
+        }
+        closedir(dir);
+        std::sort(nodes.begin(), nodes.end());
+
+        for (int node : nodes) {
+            std::ifstream file(root + "/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            std::getline(file, list);
+            std::vector<int> cpus = parseCpuList(list);
+            if (cpus.empty())
+                continue;   // memory only node
+            for (int cpu : cpus) {
+                if (cpu >= int(m_cpuSet.size()))
+                    m_cpuSet.resize(cpu + 1, 0);
+                m_cpuSet[cpu] = m_sets.size();
+            }
+            m_sets.push_back({node, cpus});
+        }
+    }
+
+    if (m_sets.size() <= 1) {
+        m_sets.clear();
+        m_cpuSet.clear();
+        m_sets.push_back({0, {}});
+    }
+}
+
+std::vector<int> Numa::writerCpus(int set) const
+{
+    if (set < 0 || m_sets.size() <= 1)
+        return m_writerCpus;
+
+    std::vector<int> local;
+    for (int cpu : m_writerCpus)
+        if (cpu < int(m_cpuSet.size()) && m_cpuSet[cpu] == set)
+            local.push_back(cpu);
+    if (local.empty())
+        return m_writerCpus.empty() ? m_sets[set].cpus : m_writerCpus;
+    return local;
+}
+
+void Numa::runOn(int set, const std::function<void()> &fn) const
+{
+    if (m_sets.size() <= 1) {
+        fn();
+        return;
+    }
+    std::thread thread([&]() {
+        pin(pthread_self(), m_sets[set].cpus);
+        fn();
+    });
+    thread.join();
+}
+
+std::vector<int> Numa::parseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        int first, last;
+        const int count = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (count < 1 || first < 0)
+            continue;
+        if (count == 1)
+            last = first;
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+bool Numa::pin(pthread_t thread, const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+        return false;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &mask);
+    return pthread_setaffinity_np(thread, sizeof(mask), &mask) == 0;
+}
@@ -0,0 +1,75 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <pthread.h>
+#include <sched.h>
+
+
+// NUMA placement for the tracer's buffers and writer threads.
+//   With more than one node, the api, op, kernelapi and copyapi tables get one ring set per
+//   node.  Producers insert into the set for the cpu they are running on, and each set's
+//   buffers and writer thread are created on that node.
+//     RPDT_NUMA=0                  one ring set regardless of topology
+//     RPDT_WRITER_CPUS=<cpulist>   pin writer threads, e.g. '0-3,64-67'.  A set's writers use
+//                                  the listed cpus on its own node when there are any
+class Numa
+{
+public:
+    static Numa& singleton();
+
+    // Topology from <root>/node*/cpulist, normally /sys/devices/system/node
+    Numa(const std::string &root, bool enable, const std::string &writerCpus);
+
+    int sets() const { return int(m_sets.size()); }
+    int set() const
+    {
+        if (m_sets.size() <= 1)
+            return 0;
+        const int cpu = sched_getcpu();
+        return (cpu >= 0 && cpu < int(m_cpuSet.size())) ? m_cpuSet[cpu] : 0;
+    }
+    int node(int set) const { return m_sets[set].node; }
+    const std::vector<int> &cpus(int set) const { return m_sets[set].cpus; }
+
+    // Cpus for writer threads.  set < 0 for tables shared by all sets.  Empty means leave unpinned
+    std::vector<int> writerCpus(int set) const;
+
+    // Run fn on a thread bound to the set's node so what it allocates and touches is node local.
+    //   Threads it starts inherit the binding
+    void runOn(int set, const std::function<void()> &fn) const;
+
+    static std::vector<int> parseCpuList(const std::string &list);
+    static bool pin(pthread_t thread, const std::vector<int> &cpus);
+
+private:
+    struct Set {
+        int node;
+        std::vector<int> cpus;
+    };
+    std::vector<Set> m_sets;
+    std::vector<int> m_cpuSet;          // cpu -> set
+    std::vector<int> m_writerCpus;
+};
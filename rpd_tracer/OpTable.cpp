@@ -25,9 +25,11 @@
 #include <thread>
 #include <array>
 #include <mutex>
+#include <atomic>
 
 #include "rpd_tracer.h"
 #include "Utility.h"
+#include "FlightRecorder.h"
 
 
 const char *SCHEMA_OP = "CREATE TEMPORARY TABLE \"temp_rocpd_op\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"gpuId\" integer NOT NULL, \"queueId\" integer NOT NULL, \"sequenceId\" integer NOT NULL, \"completionSignal\" varchar(18) NOT NULL, \"start\" integer NOT NULL, \"end\" integer NOT NULL, \"description_id\" integer NOT NULL REFERENCES \"rocpd_string\" (\"id\") DEFERRABLE INITIALLY DEFERRED, \"opType_id\" integer NOT NULL REFERENCES \"rocpd_string\" (\"id\") DEFERRABLE INITIALLY DEFERRED)";
@@ -35,6 +37,9 @@ const char *SCHEMA_OP = "CREATE TEMPORARY TABLE \"temp_rocpd_op\" (\"id\" intege
 const char *SCHEMA_API_OPS = "CREATE TEMPORARY TABLE \"temp_rocpd_api_ops\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"api_id\" integer NOT NULL REFERENCES \"rocpd_api\" (\"id\") DEFERRABLE INITIALLY DEFERRED, \"op_id\" integer NOT NULL REFERENCES \"rocpd_op\" (\"id\") DEFERRABLE INITIALLY DEFERRED)";
 
 
+// Op ids are handed out in write order across all ring sets, see Numa.h
+static std::atomic<sqlite3_int64> opIds {0};
+
 class OpTablePrivate
 {
 public:
@@ -48,6 +53,9 @@ public:
     sqlite3_stmt *opInsert;
     sqlite3_stmt *apiOpInsert;
 
+    RecorderWindow<OpTable::row> window;     // flight recorder
+    void insertRow(const OpTable::row &row);
+
     OpTable *p;
 };
 
@@ -75,18 +83,37 @@ OpTable::~OpTable()
 
 void OpTable::insert(const OpTable::row &row)
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    while (m_head - m_tail >= OpTablePrivate::BUFFERSIZE) {
-        // buffer is full; insert in-line or wait
-        m_wait.notify_one();  // make sure working is running
-        m_wait.wait(lock);
+    if (d->window.active()) {
+        d->window.record(row);
+        return;
+    }
+    d->insertRow(row);
+}
+
+void OpTable::dumpWindow()
+{
+    d->window.drain([this](const OpTable::row &row) { d->insertRow(row); });
+}
+
+void OpTablePrivate::insertRow(const OpTable::row &row)
+{
+    std::unique_lock<std::mutex> lock(p->m_mutex);
+    if (p->m_head - p->m_tail >= OpTablePrivate::BUFFERSIZE) {
+        const timestamp_t start = clocktime_ns();
+        while (p->m_head - p->m_tail >= OpTablePrivate::BUFFERSIZE) {
+            // buffer is full; insert in-line or wait
+            p->m_wait.notify_one();  // make sure working is running
+            p->m_wait.wait(lock);
+        }
+        p->countBlocked(clocktime_ns() - start);
     }
 
-    d->rows[(++m_head) % OpTablePrivate::BUFFERSIZE] = row;
+    rows[(++p->m_head) % OpTablePrivate::BUFFERSIZE] = row;
+    p->countInsert();
 
-    if (workerRunning() == false && (m_head - m_tail) >= OpTablePrivate::BATCHSIZE) {
+    if (p->workerRunning() == false && (p->m_head - p->m_tail) >= OpTablePrivate::BATCHSIZE) {
         //lock.unlock();
-        m_wait.notify_one();
+        p->m_wait.notify_one();
     }
 }
 
@@ -130,11 +157,12 @@ void OpTable::writeRows()
 
     sqlite3_exec(m_connection, "BEGIN DEFERRED TRANSACTION", NULL, NULL, NULL);
 
+    const sqlite3_int64 firstId = opIds.fetch_add(end - start + 1) + 1 - start;
     for (int i = start; i <= end; ++i) {
         // insert rocpd_op
         int index = 1;
         OpTable::row &r = d->rows[i % BUFFERSIZE];
-        sqlite3_int64 primaryKey = i + m_idOffset;
+        sqlite3_int64 primaryKey = firstId + i + m_idOffset;
 
 // Disable this for now.  Getting kernel names from roctracer op records now.
 #if 0
@@ -164,17 +192,16 @@ void OpTable::writeRows()
         //sqlite_int64 rowId = sqlite3_last_insert_rowid(m_connection);
         index = 1;
         sqlite3_bind_int64(d->apiOpInsert, index++, sqlite3_int64(r.api_id) + m_idOffset);
-        sqlite3_bind_int64(d->apiOpInsert, index++, sqlite3_int64(i) + m_idOffset);
+        sqlite3_bind_int64(d->apiOpInsert, index++, primaryKey);
         ret = sqlite3_step(d->apiOpInsert);
         sqlite3_reset(d->apiOpInsert);
     }
     lock.lock();
     m_tail = end;
+    countWritten(end - start + 1, (end - start + 1) * sizeof(OpTable::row));
     lock.unlock();
 
     sqlite3_exec(m_connection, "END TRANSACTION", NULL, NULL, NULL);
     const timestamp_t cb_end_time = clocktime_ns() + 1;
-    char buff[4096];
-    std::snprintf(buff, 4096, "count=%d | remaining=%d", end - start + 1, m_head - m_tail);
-    createOverheadRecord(cb_begin_time, cb_end_time, "OpTable::writeRows", buff);
+    createTelemetryRecord("OpTable::writeRows", cb_begin_time, cb_end_time, end - start + 1, m_head - m_tail, 0);
 }
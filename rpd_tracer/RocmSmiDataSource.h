@@ -3,35 +3,22 @@
  **************************************************************************/
 #pragma once
 
-#include "DataSource.h"
-#include "DbResource.h"
+#include "SamplerDataSource.h"
 
-#include <sqlite3.h>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
 
-
-class RocmSmiDataSource : public DataSource
+// Sampler backend using librocm_smi.  Select with RPDT_MONITOR_BACKEND=smi
+class RocmSmiSamplerBackend : public SamplerBackend
 {
 public:
-    //RoctracerDataSource();
-    void init() override;
-    void end() override;
-    void startTracing() override;
-    void stopTracing() override;
-    virtual void flush() override;
+    const char *name() override { return "smi"; }
+    bool init() override;
+    void shutdown() override;
 
-private:
-    std::mutex m_mutex;
-    std::condition_variable m_wait;
-    bool m_loggingActive {false};
-    DbResource *m_resource {nullptr};
+    int deviceCount() override { return m_deviceCount; }
+    bool supports(int device, SamplerMetric metric) override;
+    void read(int device, const SamplerMetric *metrics, int count, double *values, bool *valid) override;
 
-    void work();                // work thread
-    std::thread *m_worker {nullptr};
-    volatile bool m_done {false};
-    bool m_workerRunning {false};
-    sqlite3_int64 m_period { 10000 };
+private:
+    int m_deviceCount {0};
+    bool readMetric(int device, SamplerMetric metric, double &value);
 };
-
@@ -29,6 +29,8 @@
 #include <sqlite3.h>
 #include <fmt/format.h>
 
+#include <unordered_map>
+
 #include "Logger.h"
 #include "Utility.h"
 
@@ -842,6 +844,7 @@ return;
 
 void RoctracerDataSource::hcc_activity_callback(const char* begin, const char* end, void* arg)
 {
+    RoctracerDataSource &source = *static_cast<RoctracerDataSource*>(arg);
     const roctracer_record_t* record = (const roctracer_record_t*)(begin);
     const roctracer_record_t* end_record = (const roctracer_record_t*)(end);
     const timestamp_t cb_begin_time = clocktime_ns();
@@ -860,38 +863,162 @@ void RoctracerDataSource::hcc_activity_callback(const char* begin, const char* e
 
     Logger &logger = Logger::singleton();
 
+    // Copy out only what we need.  String lookups and demangling happen on the processing threads.
+    const int queueCount = source.m_queues.size();
+    std::vector<ActivityBatch*> batches(queueCount, nullptr);
+
     while (record < end_record) {
-        const char *name = roctracer_op_string(record->domain, record->op, record->kind);
         if (record->op != HIP_OP_ID_BARRIER) { // Don't log markers
-            sqlite3_int64 name_id = logger.stringTable().getOrCreate(name);
-
-            OpTable::row row;
-            row.gpuId = mapDeviceId(record->device_id);
-            row.queueId = record->queue_id;
-            row.sequenceId = 0;
-            strncpy(row.completionSignal, "", 18);
-            row.start = record->begin_ns + toffset;
-            row.end = record->end_ns + toffset;
-            row.description_id = ((record->kind == HIP_OP_DISPATCH_KIND_KERNEL_)
-                               || (record->kind == HIP_OP_DISPATCH_KIND_TASK_))
-                ? logger.stringTable().getOrCreate(cxx_demangle(record->kernel_name))
-                : EMPTY_STRING_ID;
-            row.opType_id = name_id;
-            row.api_id = record->correlation_id;
-
-            logger.opTable().insert(row);
+            const int gpuId = mapDeviceId(record->device_id);
+            const int queue = (queueCount > 1) ? ((gpuId % queueCount) + queueCount) % queueCount : 0;
+            if (batches[queue] == nullptr) {
+                batches[queue] = new ActivityBatch;
+                batches[queue]->records.reserve((end_record - record) / queueCount + 1);
+            }
+            ActivityBatch &batch = *batches[queue];
+
+            ActivityRecord r;
+            r.domain = record->domain;
+            r.op = record->op;
+            r.kind = record->kind;
+            r.gpuId = gpuId;
+            r.queueId = record->queue_id;
+            r.correlationId = record->correlation_id;
+            r.start = record->begin_ns + toffset;
+            r.end = record->end_ns + toffset;
+            r.kernelName = -1;
+            if (((record->kind == HIP_OP_DISPATCH_KIND_KERNEL_) || (record->kind == HIP_OP_DISPATCH_KIND_TASK_))
+                && record->kernel_name != nullptr) {
+                r.kernelName = batch.names.size();
+                batch.names.insert(batch.names.end(), record->kernel_name, record->kernel_name + strlen(record->kernel_name) + 1);
+            }
+            batch.records.push_back(r);
         }
         roctracer_next_record(record, &record);
         ++batchSize;
     }
+
+    // Hand off to the processing threads
+    std::unique_lock<std::mutex> lock(source.m_queueMutex);
+    for (int i = 0; i < queueCount; ++i) {
+        if (batches[i] == nullptr)
+            continue;
+        if (source.m_done) {
+            // Processing threads are gone.  Do it inline.
+            lock.unlock();
+            source.processBatch(*batches[i]);
+            delete batches[i];
+            lock.lock();
+            continue;
+        }
+        while (source.m_queuedRecords >= source.m_maxQueuedRecords && source.m_done == false)
+            source.m_queueWait.wait(lock);
+        source.m_queues[i].batches.push_back(batches[i]);
+        source.m_queuedRecords += batches[i]->records.size();
+        if (source.m_queuedRecords > source.m_queuedHighWater)
+            source.m_queuedHighWater = source.m_queuedRecords;
+    }
+    const size_t queued = source.m_queuedRecords;
+    source.m_queueWait.notify_all();
+    lock.unlock();
+
     const timestamp_t cb_end_time = clocktime_ns();
-    char buff[4096];
-    std::snprintf(buff, 4096, "count=%d", batchSize);
-    logger.createOverheadRecord(cb_begin_time, cb_end_time, "hcc_activity_callback", buff);
+    logger.createTelemetryRecord("hcc_activity_callback", cb_begin_time, cb_end_time, batchSize, queued, 0);
 
     std::call_once(registerAgain_once, atexit, Logger::rpdFinalize);
 }
 
+void RoctracerDataSource::work(int index)
+{
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    ActivityQueue &queue = m_queues[index];
+    while (true) {
+        while (queue.batches.empty() == false) {
+            ActivityBatch *batch = queue.batches.front();
+            queue.batches.pop_front();
+            queue.processing = true;
+            lock.unlock();
+
+            processBatch(*batch);
+
+            lock.lock();
+            queue.processing = false;
+            m_queuedRecords -= batch->records.size();
+            delete batch;
+            m_queueWait.notify_all();
+        }
+        if (m_done)
+            break;
+        m_queueWait.wait(lock);
+    }
+}
+
+void RoctracerDataSource::processBatch(ActivityBatch &batch)
+{
+    Logger &logger = Logger::singleton();
+
+    // Per thread caches, op names and kernel names repeat constantly
+    thread_local std::unordered_map<uint64_t, sqlite3_int64> opTypes;
+    thread_local std::unordered_map<std::string, sqlite3_int64> kernelNames;
+
+    for (auto it = batch.records.begin(); it != batch.records.end(); ++it) {
+        const ActivityRecord &r = *it;
+
+        const uint64_t opKey = (uint64_t(r.domain) << 48) ^ (uint64_t(r.op) << 32) ^ r.kind;
+        auto oit = opTypes.find(opKey);
+        if (oit == opTypes.end()) {
+            const char *name = roctracer_op_string(r.domain, r.op, r.kind);
+            oit = opTypes.insert({opKey, logger.stringTable().getOrCreate(name)}).first;
+        }
+
+        sqlite3_int64 description_id = EMPTY_STRING_ID;
+        if (r.kernelName >= 0) {
+            std::string mangled(&batch.names[r.kernelName]);
+            auto kit = kernelNames.find(mangled);
+            if (kit == kernelNames.end())
+                kit = kernelNames.insert({mangled, logger.stringTable().getOrCreate(cxx_demangle(mangled.c_str()))}).first;
+            description_id = kit->second;
+        }
+
+        OpTable::row row;
+        row.gpuId = r.gpuId;
+        row.queueId = r.queueId;
+        row.sequenceId = 0;
+        strncpy(row.completionSignal, "", 18);
+        row.start = r.start;
+        row.end = r.end;
+        row.description_id = description_id;
+        row.opType_id = oit->second;
+        row.api_id = r.correlationId;
+
+        logger.opTable().insert(row);
+    }
+}
+
+void RoctracerDataSource::waitForQueues()
+{
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    while (true) {
+        bool idle = true;
+        for (auto it = m_queues.begin(); it != m_queues.end(); ++it)
+            idle = idle && it->batches.empty() && (it->processing == false);
+        if (idle)
+            break;
+        m_queueWait.wait(lock);
+    }
+}
+
+void RoctracerDataSource::reportQueueStats()
+{
+    Logger &logger = Logger::singleton();
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    const size_t highWater = m_queuedHighWater;
+    lock.unlock();
+    logger.metadataTable().set(
+        fmt::format("roctracer_queue_highwater::{}", logger.metadataTable().sessionId()),
+        fmt::format("{}", highWater));
+}
+
 
 
 void RoctracerDataSource::init() {
@@ -911,6 +1038,9 @@ void RoctracerDataSource::init() {
     m_apiList.add("hipModuleGetFunction");
     m_apiList.add("hipEventCreateWithFlags");
 
+    // RPDT_API_FILTER_FILE / RPDT_API_FILTER
+    m_apiList.loadUserPrefs();
+
     // roctracer properties
     //    Whatever the hell that means.  Magic encantation, thanks.
     roctracer_set_properties(ACTIVITY_DOMAIN_HIP_API, NULL);
@@ -921,17 +1051,17 @@ void RoctracerDataSource::init() {
     if (m_apiList.invertMode() == true) {
         // exclusion list - enable entire domain and turn off things in list
         roctracer_enable_domain_callback(ACTIVITY_DOMAIN_HIP_API, api_callback, NULL);
-        const std::unordered_map<uint32_t, uint32_t> &filter = m_apiList.filterList();
+        const std::vector<uint32_t> filter = m_apiList.filterList();
         for (auto it = filter.begin(); it != filter.end(); ++it) {
-            roctracer_disable_op_callback(ACTIVITY_DOMAIN_HIP_API, it->first);
+            roctracer_disable_op_callback(ACTIVITY_DOMAIN_HIP_API, *it);
         }
     }
     else {
         // inclusion list - only enable things in the list
         roctracer_disable_domain_callback(ACTIVITY_DOMAIN_HIP_API);
-        const std::unordered_map<uint32_t, uint32_t> &filter = m_apiList.filterList();
+        const std::vector<uint32_t> filter = m_apiList.filterList();
         for (auto it = filter.begin(); it != filter.end(); ++it) {
-            roctracer_enable_op_callback(ACTIVITY_DOMAIN_HIP_API, it->first, api_callback, NULL);
+            roctracer_enable_op_callback(ACTIVITY_DOMAIN_HIP_API, *it, api_callback, NULL);
         }
     }
 
@@ -945,12 +1075,33 @@ void RoctracerDataSource::init() {
 #endif
 
 #if 1
+    // Activity processing threads
+    int threads = 1;
+    const char *val = getenv("RPDT_ROCTRACER_THREADS");
+    if (val != nullptr && atoi(val) > 0)
+        threads = atoi(val);
+    val = getenv("RPDT_ROCTRACER_QUEUE_DEPTH");
+    if (val != nullptr && atoll(val) > 0)
+        m_maxQueuedRecords = atoll(val);
+    m_done = false;
+    m_queues.resize(threads);
+    const Numa &numa = Numa::singleton();
+    for (int i = 0; i < threads; ++i) {
+        m_queues[i].worker = new std::thread(&RoctracerDataSource::work, this, i);
+        // Spread over the ring sets so each thread's inserts stay on one node
+        Numa::pin(m_queues[i].worker->native_handle(), numa.writerCpus(i % numa.sets()));
+    }
+
     // Log hcc
     roctracer_properties_t hcc_cb_properties;
     memset(&hcc_cb_properties, 0, sizeof(roctracer_properties_t));
     //hcc_cb_properties.buffer_size = 0x1000; //0x40000;
     hcc_cb_properties.buffer_size = 0x40000;
+    val = getenv("RPDT_ROCTRACER_POOL_SIZE");
+    if (val != nullptr && strtoll(val, nullptr, 0) > 0)
+        hcc_cb_properties.buffer_size = strtoll(val, nullptr, 0);
     hcc_cb_properties.buffer_callback_fun = hcc_activity_callback;
+    hcc_cb_properties.buffer_callback_arg = this;
     roctracer_open_pool_expl(&hcc_cb_properties, &m_hccPool);
     roctracer_enable_domain_activity_expl(ACTIVITY_DOMAIN_HCC_OPS, m_hccPool);
 #endif
@@ -972,6 +1123,27 @@ void RoctracerDataSource::stopTracing() {
 void RoctracerDataSource::flush() {
     roctracer_flush_activity();
     roctracer_flush_activity_expl(m_hccPool);
+    waitForQueues();
+}
+
+bool RoctracerDataSource::setApiFilter(const std::string &spec) {
+    std::unique_lock<std::mutex> lock(m_apiListMutex);
+    RocmApiIdList apiList = m_apiList;
+    if (apiList.addSpec(spec) == false)
+        return false;
+
+    // Only touch the ops that changed
+    for (uint32_t cid = HIP_API_ID_FIRST; cid <= HIP_API_ID_LAST; ++cid) {
+        const bool enable = apiList.contains(cid);
+        if (enable == m_apiList.contains(cid))
+            continue;
+        if (enable)
+            roctracer_enable_op_callback(ACTIVITY_DOMAIN_HIP_API, cid, api_callback, NULL);
+        else
+            roctracer_disable_op_callback(ACTIVITY_DOMAIN_HIP_API, cid);
+    }
+    m_apiList = apiList;
+    return true;
 }
 
 void RoctracerDataSource::end() {
@@ -985,6 +1157,19 @@ void RoctracerDataSource::end() {
     roctracer_flush_activity();
     roctracer_flush_activity_expl(m_hccPool);
     m_hccPool = nullptr;
+
+    // Drain and stop the processing threads
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_done = true;
+    m_queueWait.notify_all();
+    lock.unlock();
+    for (auto it = m_queues.begin(); it != m_queues.end(); ++it) {
+        it->worker->join();
+        delete it->worker;
+        it->worker = nullptr;
+    }
+
+    reportQueueStats();
 }
 
 uint32_t RocmApiIdList::mapName(const std::string &apiName)
@@ -995,3 +1180,12 @@ uint32_t RocmApiIdList::mapName(const std::string &apiName)
     else
         return 0;
 }
+
+void RocmApiIdList::listNames(std::vector<std::pair<std::string, uint32_t>> &names)
+{
+    for (uint32_t cid = HIP_API_ID_FIRST; cid <= HIP_API_ID_LAST; ++cid) {
+        const char *name = roctracer_op_string(ACTIVITY_DOMAIN_HIP_API, cid, 0);
+        if (name != nullptr)
+            names.push_back({name, cid});
+    }
+}
@@ -24,6 +24,11 @@
 #include <roctracer.h>
 
 #include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 
@@ -35,6 +40,7 @@ class RocmApiIdList : public ApiIdList
 public:
     RocmApiIdList() { ; }
     uint32_t mapName(const std::string &apiName) override;
+    void listNames(std::vector<std::pair<std::string, uint32_t>> &names) override;
 };
 
 
@@ -47,12 +53,52 @@ public:
     void startTracing() override;
     void stopTracing() override;
     void flush() override;
+    bool setApiFilter(const std::string &spec) override;
 
 private:
     RocmApiIdList m_apiList;
+    std::mutex m_apiListMutex;
 
     roctracer_pool_t *m_hccPool{nullptr};
     static void api_callback(uint32_t domain, uint32_t cid, const void* callback_data, void* arg);
     static void hcc_activity_callback(const char* begin, const char* end, void* arg);
 
+    // Activity records are copied out of the roctracer pool and handed to processing threads,
+    //   partitioned by device, which turn them into OpTable rows.
+    //     RPDT_ROCTRACER_POOL_SIZE     activity pool bytes (default 0x40000)
+    //     RPDT_ROCTRACER_THREADS       processing threads (default 1)
+    //     RPDT_ROCTRACER_QUEUE_DEPTH   queued records before the callback waits (default 1M)
+    struct ActivityRecord {
+        uint32_t domain;
+        uint32_t op;
+        uint32_t kind;
+        int gpuId;
+        uint64_t queueId;
+        uint64_t correlationId;
+        uint64_t start;
+        uint64_t end;
+        int64_t kernelName;        // offset into ActivityBatch::names, -1 if none
+    };
+    struct ActivityBatch {
+        std::vector<ActivityRecord> records;
+        std::vector<char> names;
+    };
+    struct ActivityQueue {
+        std::deque<ActivityBatch*> batches;
+        bool processing {false};
+        std::thread *worker {nullptr};
+    };
+
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueWait;
+    std::vector<ActivityQueue> m_queues;
+    size_t m_queuedRecords {0};
+    size_t m_queuedHighWater {0};
+    size_t m_maxQueuedRecords {1024 * 1024};
+    bool m_done {false};
+
+    void work(int queue);
+    void processBatch(ActivityBatch &batch);
+    void waitForQueues();
+    void reportQueueStats();
 };
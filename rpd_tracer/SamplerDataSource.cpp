@@ -0,0 +1,241 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#include "SamplerDataSource.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <chrono>
+
+#include "SysfsSampler.h"
+#include "Logger.h"
+#include "Utility.h"
+
+
+// Create a factory for the Logger to locate and use
+//   The sysfs backend has no library dependencies so it is always built
+extern "C" {
+    DataSource *SysfsDataSourceFactory() { return new SamplerDataSource(new SysfsSamplerBackend()); }
+}  // extern "C"
+
+
+SamplerDataSource::SamplerDataSource(SamplerBackend *backend)
+: m_backend(backend)
+{
+}
+
+SamplerDataSource::~SamplerDataSource()
+{
+    delete m_backend;
+}
+
+bool SamplerDataSource::parseConfig(const char *config)
+{
+    // "name[:period_ms[:deadband]],..."
+    std::string spec(config);
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t next = spec.find(',', pos);
+        if (next == std::string::npos)
+            next = spec.size();
+        std::string item = spec.substr(pos, next - pos);
+        pos = next + 1;
+        if (item.empty())
+            continue;
+
+        size_t colon = item.find(':');
+        Metric m;
+        if (samplerMetricFromName(item.substr(0, colon), m.metric) == false) {
+            fprintf(stderr, "rpd_tracer: unknown monitor metric '%s'\n", item.substr(0, colon).c_str());
+            continue;
+        }
+        double period = 1.0;
+        m.deadband = 0;
+        if (colon != std::string::npos) {
+            std::string rest = item.substr(colon + 1);
+            size_t colon2 = rest.find(':');
+            period = atof(rest.substr(0, colon2).c_str());
+            if (colon2 != std::string::npos)
+                m.deadband = atof(rest.substr(colon2 + 1).c_str());
+        }
+        m.period = (period > 0) ? sqlite3_int64(period * 1000) : 1000;
+        m_metrics.push_back(m);
+    }
+    return m_metrics.empty() == false;
+}
+
+void SamplerDataSource::init()
+{
+    // Only the selected backend samples.  Everything else stays idle.
+    const char *backendName = getenv("RPDT_MONITOR_BACKEND");
+    if (backendName == nullptr)
+        backendName = "sysfs";
+    if (strcmp(backendName, m_backend->name()) != 0)
+        return;
+
+    const char *config = getenv("RPDT_MONITOR");
+    if (config == nullptr || parseConfig(config) == false)
+        return;
+
+    if (m_backend->init() == false) {
+        fprintf(stderr, "rpd_tracer: %s monitor backend unavailable\n", m_backend->name());
+        return;
+    }
+
+    // Intern every (device, metric) up front so samples carry no strings
+    MonitorTable &monitor = Logger::singleton().monitorTable();
+    const int devices = m_backend->deviceCount();
+    for (auto it = m_metrics.begin(); it != m_metrics.end(); ++it) {
+        const char *name = samplerMetricName(it->metric);
+        if (it->deadband > 0)
+            monitor.setDeadband(name, it->deadband);
+        for (int i = 0; i < devices; ++i)
+            it->monitorIds.push_back(m_backend->supports(i, it->metric) ? monitor.monitorId("gpu", i, name) : -1);
+    }
+
+    m_done = false;
+    m_resource = new DbResource(Logger::singleton().filename(), std::string("smi_logger_active"));
+    m_worker = new std::thread(&SamplerDataSource::work, this);
+}
+
+void SamplerDataSource::end()
+{
+    if (m_worker == nullptr)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done = true;
+    m_wait.notify_all();
+    lock.unlock();
+    m_worker->join();
+    delete m_worker;
+    m_worker = nullptr;
+
+    m_resource->unlock();
+    m_backend->shutdown();
+}
+
+void SamplerDataSource::startTracing()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_loggingActive = true;
+}
+
+void SamplerDataSource::stopTracing()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_loggingActive = false;
+
+    if (m_worker == nullptr)
+        return;
+
+    // Tell the monitor table that it should terminate any outstanding ranges...
+    //    since we are paused/stopped.
+    Logger &logger = Logger::singleton();
+    logger.monitorTable().endCurrentRuns(clocktime_ns());
+}
+
+void SamplerDataSource::flush()
+{
+    if (m_worker == nullptr)
+        return;
+    Logger &logger = Logger::singleton();
+    logger.monitorTable().endCurrentRuns(clocktime_ns());
+}
+
+
+void SamplerDataSource::work()
+{
+    MonitorTable &monitor = Logger::singleton().monitorTable();
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    bool haveResource = m_resource->tryLock();
+
+    const int devices = m_backend->deviceCount();
+    const size_t count = m_metrics.size();
+    std::vector<size_t> due;
+    std::vector<size_t> slots;
+    std::vector<SamplerMetric> metrics;
+    std::vector<double> values(count);
+    std::unique_ptr<bool[]> valid(new bool[count]);
+
+    sqlite3_int64 minPeriod = m_metrics[0].period;
+    for (auto it = m_metrics.begin(); it != m_metrics.end(); ++it)
+        minPeriod = (it->period < minPeriod) ? it->period : minPeriod;
+
+    while (m_done == false) {
+        sqlite3_int64 now = clocktime_ns() / 1000;
+        sqlite3_int64 wakeTime = now + minPeriod;
+
+        if (haveResource && m_loggingActive) {
+            lock.unlock();
+
+            due.clear();
+            for (size_t i = 0; i < count; ++i) {
+                Metric &m = m_metrics[i];
+                if (now >= m.nextSample) {
+                    due.push_back(i);
+                    m.nextSample += m.period;
+                    if (m.nextSample <= now)
+                        m.nextSample = now + m.period;
+                }
+                wakeTime = (m.nextSample < wakeTime) ? m.nextSample : wakeTime;
+            }
+
+            // One backend read per device covering every metric that is due
+            for (int dev = 0; dev < devices && due.empty() == false; ++dev) {
+                metrics.clear();
+                slots.clear();
+                for (auto it = due.begin(); it != due.end(); ++it) {
+                    if (m_metrics[*it].monitorIds[dev] >= 0) {
+                        metrics.push_back(m_metrics[*it].metric);
+                        slots.push_back(*it);
+                    }
+                }
+                if (metrics.empty())
+                    continue;
+
+                m_backend->read(dev, metrics.data(), metrics.size(), values.data(), valid.get());
+                sqlite3_int64 timestamp = clocktime_ns();
+                for (size_t k = 0; k < metrics.size(); ++k) {
+                    if (valid[k])
+                        monitor.insert(m_metrics[slots[k]].monitorIds[dev], timestamp, values[k]);
+                }
+            }
+            lock.lock();
+        }
+
+        sqlite3_int64 sleepTime = wakeTime - clocktime_ns() / 1000;
+        sleepTime = (sleepTime > 0) ? sleepTime : 0;
+        // sleep longer if we aren't the active instance
+        if (haveResource == false)
+            sleepTime += minPeriod * 10;
+        if (m_done == false)
+            m_wait.wait_for(lock, std::chrono::microseconds(sleepTime));
+
+        // Try to become the active logging instance
+        if (haveResource == false) {
+            haveResource = m_resource->tryLock();
+        }
+    }
+}
@@ -0,0 +1,116 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#pragma once
+
+#include "DataSource.h"
+#include "DbResource.h"
+
+#include <sqlite3.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+// Device metrics a sampler backend can provide.  Names are the rocpd_monitor monitorType.
+enum class SamplerMetric {
+    sclk,       // MHz
+    mclk,       // MHz
+    power,      // W
+    temp,       // C
+    busy,       // percent
+    vram,       // MiB used
+    count
+};
+
+static inline const char *samplerMetricName(SamplerMetric metric)
+{
+    static const char *names[] = {"sclk", "mclk", "power", "temp", "busy", "vram"};
+    return names[static_cast<int>(metric)];
+}
+
+static inline bool samplerMetricFromName(const std::string &name, SamplerMetric &metric)
+{
+    for (int i = 0; i < static_cast<int>(SamplerMetric::count); ++i) {
+        if (name == samplerMetricName(static_cast<SamplerMetric>(i))) {
+            metric = static_cast<SamplerMetric>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+class SamplerBackend
+{
+public:
+    virtual ~SamplerBackend() {}
+    virtual const char *name() = 0;
+    virtual bool init() = 0;        // false if the backend can not be used on this system
+    virtual void shutdown() {}
+
+    virtual int deviceCount() = 0;
+    virtual bool supports(int device, SamplerMetric metric) = 0;
+
+    // Read several metrics from one device in one pass.  valid[i] is set for each value read.
+    virtual void read(int device, const SamplerMetric *metrics, int count, double *values, bool *valid) = 0;
+};
+
+
+// Polls a backend for a configurable list of metrics and feeds MonitorTable.
+//   RPDT_MONITOR="name[:period_ms[:deadband]],..."   e.g. "sclk,power:10:0.5,temp:100"
+//   RPDT_MONITOR_BACKEND=sysfs|smi                     (default sysfs)
+class SamplerDataSource : public DataSource
+{
+public:
+    SamplerDataSource(SamplerBackend *backend);
+    virtual ~SamplerDataSource();
+
+    void init() override;
+    void end() override;
+    void startTracing() override;
+    void stopTracing() override;
+    void flush() override;
+
+private:
+    SamplerBackend *m_backend {nullptr};
+
+    struct Metric {
+        SamplerMetric metric;
+        sqlite3_int64 period;            // usec
+        double deadband;
+        sqlite3_int64 nextSample {0};
+        std::vector<int> monitorIds;    // per device, -1 if unsupported
+    };
+    std::vector<Metric> m_metrics;
+    bool parseConfig(const char *config);
+
+    std::mutex m_mutex;
+    std::condition_variable m_wait;
+    bool m_loggingActive {false};
+    DbResource *m_resource {nullptr};
+
+    void work();                // work thread
+    std::thread *m_worker {nullptr};
+    volatile bool m_done {false};
+};
@@ -25,9 +25,11 @@
 #include <unordered_map>
 #include <array>
 #include <mutex>
+#include <vector>
 
 #include "rpd_tracer.h"
 #include "Utility.h"
+#include "FlightRecorder.h"
 
 
 const char *SCHEMA_STRING = "CREATE TEMPORARY TABLE \"temp_rocpd_string\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"string\" varchar(4096) NOT NULL)";
@@ -47,6 +49,13 @@ public:
     void insert(StringTable::row&);
 
     std::mutex cacheMutex;
+    sqlite3_int64 nextId {0};                  // guarded by cacheMutex
+    // Flight recorder: new strings are held until a dump.  They are never evicted since
+    //   the cache hands out their ids for the life of the process.
+    std::vector<StringTable::row> held;
+    std::atomic<uint64_t> lookups {0};
+    std::atomic<uint64_t> hits {0};
+    std::atomic<uint64_t> cacheSize {0};
 
     StringTable *p;
 };
@@ -77,20 +86,41 @@ StringTable::~StringTable()
 sqlite3_int64 StringTable::getOrCreate(const std::string &key)
 {
     std::lock_guard<std::mutex> guard(d->cacheMutex);
+    d->lookups.fetch_add(1, std::memory_order_relaxed);
     auto it = d->cache.find(key);
     if (it == d->cache.end()) {
         // new string, create a row
         StringTable::row row;
-        row.string_id = 0;
+        row.string_id = ++d->nextId;
         row.string = key;
-        d->insert(row);		// string_id gets updated with id
+        if (FlightRecorder::singleton().active())
+            d->held.push_back(row);
+        else
+            d->insert(row);
         // update cache
         d->cache.insert({row.string, row.string_id});
+        d->cacheSize.store(d->cache.size(), std::memory_order_relaxed);
         return row.string_id;
     }
+    d->hits.fetch_add(1, std::memory_order_relaxed);
     return it->second;
 }
 
+void StringTable::cacheStats(uint64_t &size, uint64_t &lookups, uint64_t &hits) const
+{
+    size = d->cacheSize.load(std::memory_order_relaxed);
+    lookups = d->lookups.load(std::memory_order_relaxed);
+    hits = d->hits.load(std::memory_order_relaxed);
+}
+
+void StringTable::dumpWindow()
+{
+    std::lock_guard<std::mutex> guard(d->cacheMutex);
+    for (auto &row : d->held)
+        d->insert(row);
+    d->held.clear();
+}
+
 void StringTablePrivate::insert(StringTable::row &row)
 {
     std::unique_lock<std::mutex> lock(p->m_mutex);
@@ -104,13 +134,17 @@ void StringTablePrivate::insert(StringTable::row &row)
         //const timestamp_t end = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
 	//FIXME
         const timestamp_t end = clocktime_ns();
+        p->countBlocked(end - start);
         lock.unlock();
-        //createOverheadRecord(start, end, "BLOCKING", "rpd_tracer::StringTable::insert");
+        //createTelemetryRecord("StringTable::insert", start, end, 0, StringTablePrivate::BUFFERSIZE, end - start);
         lock.lock();
+        if (p->m_head - p->m_tail >= StringTablePrivate::BUFFERSIZE)
+            p->countDropped();
     }
 
-    row.string_id = ++(p->m_head);
+    ++(p->m_head);
     rows[p->m_head % StringTablePrivate::BUFFERSIZE] = row;
+    p->countInsert();
 
     if (p->workerRunning() == false && (p->m_head - p->m_tail) >= StringTablePrivate::BATCHSIZE) {
         //lock.unlock();	// FIXME: okay to comment out?
@@ -149,6 +183,7 @@ void StringTable::writeRows()
 
     sqlite3_exec(m_connection, "BEGIN DEFERRED TRANSACTION", NULL, NULL, NULL);
 
+    uint64_t bytes = 0;
     for (int i = start; i <= end; ++i) {
         // insert rocpd_string
         int index = 1;
@@ -156,11 +191,13 @@ void StringTable::writeRows()
         //printf("%lld %s\n", r.string_id, r.string.c_str());
         sqlite3_bind_int64(d->stringInsert, index++, r.string_id + m_idOffset);
         sqlite3_bind_text(d->stringInsert, index++, r.string.c_str(), -1, SQLITE_STATIC);	// FIXME SQLITE_TRANSIENT?
+        bytes += sizeof(r.string_id) + r.string.size();
         int ret = sqlite3_step(d->stringInsert);
         sqlite3_reset(d->stringInsert);
     }
     lock.lock();
     m_tail = end;
+    countWritten(end - start + 1, bytes);
     lock.unlock();
 
     //const timestamp_t cb_mid_time = util::HsaTimer::clocktime_ns(util::HsaTimer::TIME_ID_CLOCK_MONOTONIC);
@@ -171,9 +208,7 @@ void StringTable::writeRows()
 #if 0
     // FIXME
     if (done == false) {
-        char buff[4096];
-        std::snprintf(buff, 4096, "count=%d | remaining=%d", end - start + 1, m_head - m_tail);
-        createOverheadRecord(cb_begin_time, cb_end_time, "StringTable::writeRows", buff);
+        createTelemetryRecord("StringTable::writeRows", cb_begin_time, cb_end_time, end - start + 1, m_head - m_tail, 0);
     }
 #endif
 }
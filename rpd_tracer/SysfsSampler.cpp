@@ -0,0 +1,189 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#include "SysfsSampler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <algorithm>
+
+
+namespace {
+    const char *AMD_VENDOR_ID = "0x1002";
+
+    // Attribute file for each metric, relative to the device or its hwmon directory.
+    //   Scale converts the sysfs units to the SamplerMetric units.
+    struct Attribute {
+        const char *file;
+        bool hwmon;
+        double scale;
+    };
+
+    const Attribute attributes[][2] = {
+        {{"freq1_input", true, 1e-6}, {nullptr, false, 0}},                     // sclk, Hz
+        {{"freq2_input", true, 1e-6}, {nullptr, false, 0}},                     // mclk, Hz
+        {{"power1_average", true, 1e-6}, {"power1_input", true, 1e-6}},         // power, uW
+        {{"temp1_input", true, 1e-3}, {nullptr, false, 0}},                     // temp, mC
+        {{"gpu_busy_percent", false, 1}, {nullptr, false, 0}},                  // busy, %
+        {{"mem_info_vram_used", false, 1.0 / (1024 * 1024)}, {nullptr, false, 0}},  // vram, bytes
+    };
+
+    bool readFile(const std::string &path, std::string &contents)
+    {
+        char buff[64];
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        ssize_t len = ::read(fd, buff, sizeof(buff) - 1);
+        close(fd);
+        if (len <= 0)
+            return false;
+        buff[len] = '\0';
+        contents = buff;
+        contents.erase(contents.find_last_not_of(" \n") + 1);
+        return true;
+    }
+
+    std::string findHwmon(const std::string &devicePath)
+    {
+        std::string result;
+        DIR *dir = opendir((devicePath + "/hwmon").c_str());
+        if (dir == nullptr)
+            return result;
+        while (struct dirent *entry = readdir(dir)) {
+            if (strncmp(entry->d_name, "hwmon", 5) == 0) {
+                result = devicePath + "/hwmon/" + entry->d_name;
+                break;
+            }
+        }
+        closedir(dir);
+        return result;
+    }
+
+    // "cardN" only, not connectors like "card0-DP-1"
+    int cardNumber(const char *name)
+    {
+        if (strncmp(name, "card", 4) != 0 || name[4] == '\0')
+            return -1;
+        for (const char *c = name + 4; *c; ++c)
+            if (*c < '0' || *c > '9')
+                return -1;
+        return atoi(name + 4);
+    }
+} // namespace
+
+
+SysfsSamplerBackend::SysfsSamplerBackend(const std::string &root)
+: m_root(root)
+{
+    const char *override = getenv("RPDT_MONITOR_SYSFS_ROOT");
+    if (override != nullptr)
+        m_root = override;
+}
+
+SysfsSamplerBackend::~SysfsSamplerBackend()
+{
+    shutdown();
+}
+
+bool SysfsSamplerBackend::init()
+{
+    std::vector<std::pair<int, std::string>> cards;
+    const std::string drm = m_root + "/class/drm";
+    DIR *dir = opendir(drm.c_str());
+    if (dir == nullptr)
+        return false;
+    while (struct dirent *entry = readdir(dir)) {
+        int number = cardNumber(entry->d_name);
+        if (number < 0)
+            continue;
+        std::string devicePath = drm + "/" + entry->d_name + "/device";
+        std::string vendor;
+        if (readFile(devicePath + "/vendor", vendor) && vendor == AMD_VENDOR_ID)
+            cards.push_back({number, devicePath});
+    }
+    closedir(dir);
+
+    // Device ids follow card order
+    std::sort(cards.begin(), cards.end());
+
+    for (auto it = cards.begin(); it != cards.end(); ++it) {
+        Device device;
+        device.path = it->second;
+        const std::string hwmon = findHwmon(device.path);
+        for (int m = 0; m < static_cast<int>(SamplerMetric::count); ++m) {
+            device.fds[m] = -1;
+            for (int alt = 0; alt < 2 && device.fds[m] < 0; ++alt) {
+                const Attribute &attr = attributes[m][alt];
+                if (attr.file == nullptr || (attr.hwmon && hwmon.empty()))
+                    continue;
+                std::string path = (attr.hwmon ? hwmon : device.path) + "/" + attr.file;
+                device.fds[m] = open(path.c_str(), O_RDONLY);
+            }
+        }
+        m_devices.push_back(device);
+    }
+    return m_devices.empty() == false;
+}
+
+void SysfsSamplerBackend::shutdown()
+{
+    for (auto it = m_devices.begin(); it != m_devices.end(); ++it) {
+        for (int m = 0; m < static_cast<int>(SamplerMetric::count); ++m) {
+            if (it->fds[m] >= 0)
+                close(it->fds[m]);
+            it->fds[m] = -1;
+        }
+    }
+    m_devices.clear();
+}
+
+bool SysfsSamplerBackend::supports(int device, SamplerMetric metric)
+{
+    return m_devices[device].fds[static_cast<int>(metric)] >= 0;
+}
+
+void SysfsSamplerBackend::read(int device, const SamplerMetric *metrics, int count, double *values, bool *valid)
+{
+    Device &dev = m_devices[device];
+    char buff[64];
+    for (int i = 0; i < count; ++i) {
+        const int m = static_cast<int>(metrics[i]);
+        valid[i] = false;
+        if (dev.fds[m] < 0)
+            continue;
+        ssize_t len = pread(dev.fds[m], buff, sizeof(buff) - 1, 0);
+        if (len <= 0)
+            continue;
+        buff[len] = '\0';
+        char *end;
+        double value = strtod(buff, &end);
+        if (end == buff)
+            continue;
+        // Both alternates of an attribute share a scale
+        values[i] = value * attributes[m][0].scale;
+        valid[i] = true;
+    }
+}
@@ -0,0 +1,54 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#pragma once
+
+#include "SamplerDataSource.h"
+
+#include <string>
+#include <vector>
+
+
+// Reads amdgpu hwmon and drm attributes straight from sysfs.  Attribute files are opened
+//   once and re-read with pread(), so a sample costs one syscall per metric.
+class SysfsSamplerBackend : public SamplerBackend
+{
+public:
+    SysfsSamplerBackend(const std::string &root = "/sys");
+    ~SysfsSamplerBackend();
+
+    const char *name() override { return "sysfs"; }
+    bool init() override;
+    void shutdown() override;
+
+    int deviceCount() override { return m_devices.size(); }
+    bool supports(int device, SamplerMetric metric) override;
+    void read(int device, const SamplerMetric *metrics, int count, double *values, bool *valid) override;
+
+private:
+    std::string m_root;
+
+    struct Device {
+        std::string path;       // .../class/drm/cardN/device
+        int fds[static_cast<int>(SamplerMetric::count)];
+    };
+    std::vector<Device> m_devices;
+};
@@ -7,6 +7,9 @@
 #include <string>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 class Table
 {
@@ -27,6 +30,19 @@ protected:
     sqlite3_int64 m_idOffset;
 };
 
+// Counters behind rpd_getStats().  Producers bump them with the table lock already held and
+//   the writer bumps them once per batch, so relaxed ordering is enough.
+struct TableStats
+{
+    std::atomic<uint64_t> inserted {0};
+    std::atomic<uint64_t> written {0};
+    std::atomic<uint64_t> highWater {0};
+    std::atomic<uint64_t> blockedNs {0};
+    std::atomic<uint64_t> blockedCount {0};
+    std::atomic<uint64_t> dropped {0};
+    std::atomic<uint64_t> bytesWritten {0};     // bound column payload, not file growth
+};
+
 class BufferedTablePrivate;
 class BufferedTable: public Table
 {
@@ -34,6 +50,15 @@ public:
     void flush() override;
     void finalize() override;
 
+    // Flight recorder: move the recorded window into the buffer.  See FlightRecorder.h
+    virtual void dumpWindow() { }
+
+    const TableStats &stats() const { return m_stats; }
+    int capacity() const { return BUFFERSIZE; }
+
+    // Bind the writer thread, see Numa.h.  No-op for an empty list
+    void pinWriter(const std::vector<int> &cpus);
+
 protected:
     BufferedTablePrivate *d;
     friend class BufferedTablePrivate;
@@ -52,6 +77,24 @@ protected:
 
     bool workerRunning();
 
+    TableStats m_stats;
+    // Call with m_mutex held, after advancing m_head
+    void countInsert() {
+        m_stats.inserted.fetch_add(1, std::memory_order_relaxed);
+        const uint64_t depth = m_head - m_tail;
+        if (depth > m_stats.highWater.load(std::memory_order_relaxed))
+            m_stats.highWater.store(depth, std::memory_order_relaxed);
+    }
+    void countBlocked(uint64_t ns) {
+        m_stats.blockedNs.fetch_add(ns, std::memory_order_relaxed);
+        m_stats.blockedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    void countDropped() { m_stats.dropped.fetch_add(1, std::memory_order_relaxed); }
+    void countWritten(uint64_t rows, uint64_t bytes) {
+        m_stats.written.fetch_add(rows, std::memory_order_relaxed);
+        m_stats.bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
     virtual void writeRows() = 0;	// "write" to buffers (cache db)
     virtual void flushRows() = 0;	// "flush" to disk (main db)
 };
@@ -71,6 +114,9 @@ public:
 
     //void insert(const row&);
     sqlite3_int64 getOrCreate(const std::string&);
+    void cacheStats(uint64_t &size, uint64_t &lookups, uint64_t &hits) const;
+
+    void dumpWindow() override;
 
 private:
     StringTablePrivate *d;
@@ -105,6 +151,8 @@ public:
     void suspendRoctx(sqlite3_int64 atTime);
     void resumeRoctx(sqlite3_int64 atTime);
 
+    void dumpWindow() override;
+
 private:
     ApiTablePrivate *d;
     friend class ApiTablePrivate;
@@ -141,6 +189,8 @@ public:
 
     void insert(const row&);
 
+    void dumpWindow() override;
+
 private:
     KernelApiTablePrivate *d;
     friend class KernelApiTablePrivate;
@@ -173,6 +223,8 @@ public:
     };
     void insert(const row&);
 
+    void dumpWindow() override;
+
 private:
     CopyApiTablePrivate *d;
     friend class CopyApiTablePrivate;
@@ -228,6 +280,8 @@ public:
     void insert(const row&);
     void associateDescription(const sqlite3_int64 &api_id, const sqlite3_int64 &string_id);
 
+    void dumpWindow() override;
+
 private:
     OpTablePrivate *d;
     friend class OpTablePrivate;
@@ -245,6 +299,9 @@ public:
 
     sqlite3_int64 sessionId();
 
+    // Insert or replace a rocpd_metadata tag
+    void set(const std::string &tag, const std::string &value);
+
     void flush();
     void finalize();
 
@@ -267,10 +324,18 @@ public:
         sqlite3_int64 deviceId;
         sqlite3_int64 start;
         sqlite3_int64 end;
-        std::string value;
+        double value;
     };
 
+    // Intern a (deviceType, deviceId, monitorType) triple.  Samplers look this up once
+    //   and pass the id with each sample to avoid any per-sample string handling.
+    int monitorId(const std::string &deviceType, sqlite3_int64 deviceId, const std::string &monitorType);
+
+    // Changes no larger than threshold extend the current run instead of starting a new one
+    void setDeadband(const std::string &monitorType, double threshold);
+
     void insert(const row&);
+    void insert(int monitorId, sqlite3_int64 timestamp, double value);
     void endCurrentRuns(sqlite3_int64 endTimestamp);
 
 private:
@@ -280,3 +345,35 @@ private:
     virtual void writeRows() override;
     virtual void flushRows() override;
 };
+
+
+// The tracer's own performance: batch writes, callbacks and time spent blocked on full buffers.
+//   Numeric rows in rocpd_telemetry.  The 'overhead' view presents them as the old rocpd_api records.
+class TelemetryTablePrivate;
+class TelemetryTable: public BufferedTable
+{
+public:
+    TelemetryTable(const char *basefile);
+    virtual ~TelemetryTable();
+
+    struct row {
+        int pid;
+        int tid;
+        const char *component;      // string literal
+        sqlite3_int64 start;
+        sqlite3_int64 end;
+        sqlite3_int64 rows;         // rows written or records handled
+        sqlite3_int64 queueDepth;   // rows still buffered
+        sqlite3_int64 blocked;      // ns spent waiting on a full buffer
+    };
+
+    // Never blocks.  Rows are dropped if the buffer is full
+    void insert(const row&);
+
+private:
+    TelemetryTablePrivate *d;
+    friend class TelemetryTablePrivate;
+
+    virtual void writeRows() override;
+    virtual void flushRows() override;
+};
@@ -0,0 +1,144 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#include "Table.h"
+
+#include <thread>
+#include <array>
+#include <mutex>
+#include <atomic>
+
+#include "rpd_tracer.h"
+#include "Utility.h"
+
+
+const char *SCHEMA_TELEMETRY = "CREATE TABLE IF NOT EXISTS \"rocpd_telemetry\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"pid\" integer NOT NULL, \"tid\" integer NOT NULL, \"component\" varchar(64) NOT NULL, \"start\" integer NOT NULL, \"end\" integer NOT NULL, \"rows\" integer NOT NULL, \"queueDepth\" integer NOT NULL, \"blocked\" integer NOT NULL)";
+
+const char *SCHEMA_TEMP_TELEMETRY = "CREATE TEMPORARY TABLE \"temp_rocpd_telemetry\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"pid\" integer NOT NULL, \"tid\" integer NOT NULL, \"component\" varchar(64) NOT NULL, \"start\" integer NOT NULL, \"end\" integer NOT NULL, \"rows\" integer NOT NULL, \"queueDepth\" integer NOT NULL, \"blocked\" integer NOT NULL)";
+
+// Compatibility, matches the api view for the string records the tracer used to write into rocpd_api
+const char *SCHEMA_OVERHEAD_VIEW = "CREATE VIEW IF NOT EXISTS overhead AS SELECT id, pid, tid, start, end, CASE WHEN blocked > 0 THEN 'BLOCKING' ELSE component END AS apiName, CASE WHEN blocked > 0 THEN 'rpd_tracer::' || component WHEN component = 'rpdflush' THEN '' WHEN component = 'hcc_activity_callback' THEN 'count=' || rows || ' | queued=' || queueDepth ELSE 'count=' || rows || ' | remaining=' || queueDepth END AS args FROM rocpd_telemetry";
+
+
+class TelemetryTablePrivate
+{
+public:
+    TelemetryTablePrivate(TelemetryTable *cls) : p(cls) {}
+    static const int BUFFERSIZE = 4096 * 4;
+    static const int BATCHSIZE = 1024;           // rows per transaction
+    std::array<TelemetryTable::row, BUFFERSIZE> rows; // Circular buffer
+
+    sqlite3_stmt *telemetryInsert;
+
+    TelemetryTable *p;
+};
+
+
+TelemetryTable::TelemetryTable(const char *basefile)
+: BufferedTable(basefile, TelemetryTablePrivate::BUFFERSIZE, TelemetryTablePrivate::BATCHSIZE)
+, d(new TelemetryTablePrivate(this))
+{
+    int ret;
+    // Files created by older schemas won't have these
+    ret = sqlite3_exec(m_connection, SCHEMA_TELEMETRY, NULL, NULL, NULL);
+    ret = sqlite3_exec(m_connection, SCHEMA_OVERHEAD_VIEW, NULL, NULL, NULL);
+
+    // set up tmp tables
+    ret = sqlite3_exec(m_connection, SCHEMA_TEMP_TELEMETRY, NULL, NULL, NULL);
+
+    // prepare queries to insert row
+    ret = sqlite3_prepare_v2(m_connection, "insert into temp_rocpd_telemetry(pid, tid, component, start, end, rows, queueDepth, blocked) values (?,?,?,?,?,?,?,?)", -1, &d->telemetryInsert, NULL);
+}
+
+
+TelemetryTable::~TelemetryTable()
+{
+    delete d;
+}
+
+
+void TelemetryTable::insert(const TelemetryTable::row &row)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_head - m_tail >= TelemetryTablePrivate::BUFFERSIZE) {
+        // Don't stall the writers we are measuring
+        countDropped();
+        return;
+    }
+
+    d->rows[(++m_head) % TelemetryTablePrivate::BUFFERSIZE] = row;
+    countInsert();
+
+    if (workerRunning() == false && (m_head - m_tail) >= TelemetryTablePrivate::BATCHSIZE) {
+        lock.unlock();
+        m_wait.notify_one();
+    }
+}
+
+
+void TelemetryTable::flushRows()
+{
+    int ret = 0;
+    ret = sqlite3_exec(m_connection, "begin transaction", NULL, NULL, NULL);
+    ret = sqlite3_exec(m_connection, "insert into rocpd_telemetry(pid, tid, component, start, end, rows, queueDepth, blocked) select pid, tid, component, start, end, rows, queueDepth, blocked from temp_rocpd_telemetry", NULL, NULL, NULL);
+    ret = sqlite3_exec(m_connection, "delete from temp_rocpd_telemetry", NULL, NULL, NULL);
+    ret = sqlite3_exec(m_connection, "commit", NULL, NULL, NULL);
+}
+
+
+void TelemetryTable::writeRows()
+{
+    std::unique_lock<std::mutex> wlock(m_writeMutex);
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_head == m_tail)
+        return;
+
+    int start = m_tail + 1;
+    int end = m_tail + BATCHSIZE;
+    end = (end > m_head) ? m_head : end;
+    lock.unlock();
+
+    sqlite3_exec(m_connection, "BEGIN DEFERRED TRANSACTION", NULL, NULL, NULL);
+
+    for (int i = start; i <= end; ++i) {
+        int index = 1;
+        TelemetryTable::row &r = d->rows[i % BUFFERSIZE];
+
+        sqlite3_bind_int(d->telemetryInsert, index++, r.pid);
+        sqlite3_bind_int(d->telemetryInsert, index++, r.tid);
+        sqlite3_bind_text(d->telemetryInsert, index++, r.component, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(d->telemetryInsert, index++, r.start);
+        sqlite3_bind_int64(d->telemetryInsert, index++, r.end);
+        sqlite3_bind_int64(d->telemetryInsert, index++, r.rows);
+        sqlite3_bind_int64(d->telemetryInsert, index++, r.queueDepth);
+        sqlite3_bind_int64(d->telemetryInsert, index++, r.blocked);
+        int ret = sqlite3_step(d->telemetryInsert);
+        sqlite3_reset(d->telemetryInsert);
+    }
+    lock.lock();
+    m_tail = end;
+    countWritten(end - start + 1, (end - start + 1) * sizeof(TelemetryTable::row));
+    lock.unlock();
+
+    sqlite3_exec(m_connection, "END TRANSACTION", NULL, NULL, NULL);
+    // No telemetry about telemetry
+}
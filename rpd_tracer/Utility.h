@@ -44,3 +44,4 @@ static timestamp_t clocktime_ns() {
 }
 
 void createOverheadRecord(uint64_t start, uint64_t end, const std::string &name, const std::string &args);
+void createTelemetryRecord(const char *component, uint64_t start, uint64_t end, int64_t rows, int64_t queueDepth, int64_t blocked);
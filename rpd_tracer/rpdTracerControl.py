@@ -21,7 +21,7 @@
 # THE SOFTWARE.
 ################################################################################
 
-from ctypes import CDLL
+from ctypes import CDLL, create_string_buffer
 from ctypes.util import find_library
 import platform
 import multiprocessing
@@ -29,6 +29,7 @@ import threading
 import os
 import sys
 import sqlite3
+import json
 from rocpd.schema import RocpdSchema
 
 def isChildProcess() -> bool:
@@ -124,6 +125,29 @@ class rpdTracerControl:
         if rpdTracerControl.__rpd:
             rpdTracerControl.__rpd.rpdflush()
 
+    # Change which apis are traced without restarting, e.g. "hipEvent*,-hipEventRecord".
+    #   See rpd_tracer/README.md for the spec syntax
+    #   Returns False if the spec was rejected
+    def setApiFilter(self, spec: str):
+        if rpdTracerControl.__rpd:
+            return rpdTracerControl.__rpd.rpd_setApiFilter(bytes(spec, encoding='utf-8')) == 0
+        return False
+
+    # Write out the flight recorder window (RPDT_RECORDER)
+    def dumpRecorder(self):
+        if rpdTracerControl.__rpd:
+            rpdTracerControl.__rpd.rpd_recorderDump()
+
+    # Tracer counters as a dict: per-table inserted/written/occupancy/highWater/blockedNs/dropped/
+    #   bytesWritten, string cache size and hit rate, and the trace file size
+    def getStats(self) -> dict:
+        if rpdTracerControl.__rpd is None:
+            return {}
+        size = rpdTracerControl.__rpd.rpd_getStats(None, 0) + 1024  # room to grow between calls
+        buffer = create_string_buffer(size)
+        rpdTracerControl.__rpd.rpd_getStats(buffer, size)
+        return json.loads(buffer.value.decode('utf-8'))
+
     def __enter__(self):
         self.start()
 
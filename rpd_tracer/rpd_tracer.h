@@ -27,6 +27,11 @@ extern "C" {
     void rpdstart();
     void rpdstop();
     void rpdflush();
+    // Returns 0 if a data source applied the spec, -1 if it was rejected
+    int rpd_setApiFilter(const char *spec);
+    void rpd_recorderDump();
+    // Tracer statistics as a JSON object.  Returns the full length, like snprintf
+    int rpd_getStats(char *buffer, int size);
     void rpd_mark(const char *domain, const char *apiName, const char* args);
     void rpd_rangePush(const char *domain, const char *apiName, const char* args);
     void rpd_rangePop();
@@ -21,12 +21,21 @@
 # THE SOFTWARE.
 ################################################################################
 OUTPUT_FILE="trace.rpd"
+COMPRESS=""
 
-if [ "$1" = "-o" ] ; then
-  OUTPUT_FILE=$2
-  shift
-  shift
-fi
+while true ; do
+  if [ "$1" = "-o" ] ; then
+    OUTPUT_FILE=$2
+    shift
+    shift
+  elif [ "$1" = "-z" ] ; then
+    # Pack to <name>.rpdz once every traced process has exited.  See rocpd/compress.py
+    COMPRESS=1
+    shift
+  else
+    break
+  fi
+done
  
 if [ -e ${OUTPUT_FILE} ] ; then
   rm ${OUTPUT_FILE}
@@ -40,3 +49,9 @@ fi
 
 export RPDT_FILENAME=${OUTPUT_FILE}
 LD_PRELOAD=librpd_tracer.so "$@"
+STATUS=$?
+
+if [ -n "${COMPRESS}" ] ; then
+  python3 -m rocpd.compress pack ${OUTPUT_FILE}
+fi
+exit ${STATUS}
@@ -0,0 +1,106 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+// Api filter specs: exact names, globs, regexes, removal and mode switches
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../ApiIdList.h"
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    if (condition == false) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+class TestApiIdList : public ApiIdList
+{
+public:
+    TestApiIdList() {
+        const char *apis[] = {"hipMalloc", "hipFree", "hipEventRecord", "hipEventQuery",
+            "hipEventCreateWithFlags", "hipGetDevice", "hipGetDeviceProperties", "hipMemcpyAsync"};
+        for (uint32_t i = 0; i < sizeof(apis) / sizeof(apis[0]); ++i)
+            m_names.push_back({apis[i], i + 1});
+    }
+    uint32_t mapName(const std::string &apiName) override {
+        for (auto it = m_names.begin(); it != m_names.end(); ++it)
+            if (it->first == apiName)
+                return it->second;
+        return 0;
+    }
+    void listNames(std::vector<std::pair<std::string, uint32_t>> &names) override {
+        ++listCalls;
+        names = m_names;
+    }
+    int listCalls {0};
+private:
+    std::vector<std::pair<std::string, uint32_t>> m_names;
+};
+
+enum { hipMalloc = 1, hipFree, hipEventRecord, hipEventQuery, hipEventCreateWithFlags,
+       hipGetDevice, hipGetDeviceProperties, hipMemcpyAsync };
+
+int main(int argc, char *argv[])
+{
+    TestApiIdList list;
+
+    // Default is an exclusion list
+    list.add("hipGetDevice");
+    check(list.contains(hipMalloc), "unlisted api traced");
+    check(!list.contains(hipGetDevice), "excluded api not traced");
+    check(list.listCalls == 0, "exact names do not enumerate");
+
+    check(list.addSpec("hipEvent*, /Properties$/"), "glob and regex spec");
+    check(!list.contains(hipEventRecord) && !list.contains(hipEventQuery) && !list.contains(hipEventCreateWithFlags), "glob");
+    check(!list.contains(hipGetDeviceProperties), "regex");
+    check(list.contains(hipMemcpyAsync), "unmatched api traced");
+
+    check(list.addSpec("-hipEventRecord # keep this one\n-/^hipGet/"), "removal spec");
+    check(list.contains(hipEventRecord), "removed exact name");
+    check(list.contains(hipGetDevice) && list.contains(hipGetDeviceProperties), "removed regex");
+    check(!list.contains(hipEventQuery), "comment ignored");
+    check(list.listCalls == 1, "names enumerated once");
+
+    check(list.addSpec("include: hipMalloc hipMemcpy*"), "include spec");
+    check(list.invertMode() == false, "include mode");
+    check(list.contains(hipMalloc) && list.contains(hipMemcpyAsync), "included apis");
+    check(!list.contains(hipEventQuery) && !list.contains(hipFree), "list cleared on mode switch");
+    check(list.filterList().size() == 2, "filter list");
+
+    check(list.addSpec("exclude:"), "exclude spec");
+    check(list.contains(hipEventQuery) && list.contains(999), "everything traced");
+
+    check(!list.addSpec("/[unterminated/"), "bad regex rejected");
+    check(!list.addSpec("/hip"), "unterminated regex rejected");
+
+    if (failures) {
+        fprintf(stderr, "ApiIdListTest: %d failures\n", failures);
+        return 1;
+    }
+    printf("ApiIdListTest: passed\n");
+    return 0;
+}
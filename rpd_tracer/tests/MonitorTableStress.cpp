@@ -0,0 +1,155 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+// Stress MonitorTable run coalescing with millions of samples over many devices and counters.
+//   Usage: MonitorTableStress [samples_per_monitor]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../Table.h"
+#include "../Utility.h"
+
+// The table classes report blocking through the logger.  Not under test here.
+void createOverheadRecord(uint64_t start, uint64_t end, const std::string &name, const std::string &args)
+{
+}
+void createTelemetryRecord(const char *component, uint64_t start, uint64_t end, int64_t rows, int64_t queueDepth, int64_t blocked)
+{
+}
+
+static const char *SCHEMA = "CREATE TABLE IF NOT EXISTS \"rocpd_monitor\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"deviceType\" varchar(16) NOT NULL, \"deviceId\" integer NOT NULL, \"monitorType\" varchar(16) NOT NULL, \"start\" integer NOT NULL, \"end\" integer NOT NULL, \"value\" varchar(255) NOT NULL)";
+
+static sqlite3_int64 queryInt(sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *stmt;
+    sqlite3_int64 result = -1;
+    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    const int devices = 64;
+    const char *deviceTypes[] = {"gpu", "cpu"};
+    const char *counters[] = {"sclk", "mclk", "fclk", "socclk", "power", "temp", "busy", "vram"};
+    const int counterCount = sizeof(counters) / sizeof(counters[0]);
+    const int samples = (argc > 1) ? atoi(argv[1]) : 4000;    // per monitor
+    const double noisyDeadband = 0.5;
+
+    char filename[] = "/tmp/monitor_stress_XXXXXX";
+    int fd = mkstemp(filename);
+    close(fd);
+    sqlite3 *db;
+    sqlite3_open(filename, &db);
+    sqlite3_exec(db, SCHEMA, NULL, NULL, NULL);
+
+    MonitorTable *table = new MonitorTable(filename);
+    table->setDeadband("power", noisyDeadband);
+    table->setDeadband("temp", noisyDeadband);
+
+    struct Monitor {
+        int id;
+        double deadband;
+        double runValue;
+        bool active;
+    };
+    std::vector<Monitor> monitors;
+    for (int t = 0; t < 2; ++t)
+        for (int dev = 0; dev < devices; ++dev)
+            for (int c = 0; c < counterCount; ++c) {
+                std::string type(counters[c]);
+                double deadband = (type == "power" || type == "temp") ? noisyDeadband : 0;
+                monitors.push_back({table->monitorId(deviceTypes[t], dev, type), deadband, 0, false});
+            }
+
+    // Reference model of the expected coalescing
+    sqlite3_int64 expected = 0;
+    uint32_t rng = 12345;
+    const timestamp_t begin = clocktime_ns();
+    for (int s = 0; s < samples; ++s) {
+        for (size_t m = 0; m < monitors.size(); ++m) {
+            Monitor &mon = monitors[m];
+            rng = rng * 1664525 + 1013904223;
+            // Step the level every 16 samples, plus +-0.4 noise the deadband should absorb
+            double value = double((s / 16 + m) % 8) * 100;
+            if (mon.deadband > 0)
+                value += (double(rng >> 8) / double(1 << 24) - 0.5) * 0.8;
+            if (mon.active == false) {
+                mon.active = true;
+                mon.runValue = value;
+            }
+            else if (std::fabs(value - mon.runValue) > mon.deadband) {
+                ++expected;
+                mon.runValue = value;
+            }
+            table->insert(mon.id, sqlite3_int64(s) * 1000, value);
+        }
+    }
+    table->endCurrentRuns(sqlite3_int64(samples) * 1000);
+    expected += monitors.size();
+    const timestamp_t end = clocktime_ns();
+
+    table->finalize();
+    const sqlite3_int64 inserted = table->stats().inserted;
+    const sqlite3_int64 written = table->stats().written;
+    const sqlite3_int64 dropped = table->stats().dropped;
+    const int highWater = table->stats().highWater;
+    const int capacity = table->capacity();
+    delete table;
+
+    const sqlite3_int64 total = sqlite3_int64(samples) * monitors.size();
+    sqlite3_int64 rows = queryInt(db, "select count(*) from rocpd_monitor");
+    sqlite3_int64 keys = queryInt(db, "select count(*) from (select distinct deviceType, deviceId, monitorType from rocpd_monitor)");
+    sqlite3_int64 gaps = queryInt(db, "select count(*) from (select start, lag(end) over (partition by deviceType, deviceId, monitorType order by start) as prev from rocpd_monitor) where prev is not null and prev != start");
+    sqlite3_close(db);
+    unlink(filename);
+
+    fprintf(stderr, "MonitorTableStress: %lld samples, %zu monitors, %lld rows, %.1f Msamples/sec\n",
+        total, monitors.size(), rows, total / ((end - begin) / 1000.0));
+
+    int failures = 0;
+    if (rows != expected) {
+        fprintf(stderr, "FAIL: expected %lld rows, got %lld\n", expected, rows);
+        ++failures;
+    }
+    if (keys != sqlite3_int64(monitors.size())) {
+        fprintf(stderr, "FAIL: expected %zu distinct monitors, got %lld\n", monitors.size(), keys);
+        ++failures;
+    }
+    if (inserted != rows || written != rows || dropped != 0 || highWater > capacity) {
+        fprintf(stderr, "FAIL: stats inserted=%lld written=%lld dropped=%lld highWater=%d for %lld rows\n",
+            inserted, written, dropped, highWater, rows);
+        ++failures;
+    }
+    if (gaps != 0) {
+        fprintf(stderr, "FAIL: %lld runs do not start where the previous one ended\n", gaps);
+        ++failures;
+    }
+    return failures ? 1 : 0;
+}
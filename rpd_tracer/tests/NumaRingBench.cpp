@@ -0,0 +1,148 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+// Producers on every node inserting api rows, into one shared ring vs a ring set per node.
+//   Reports throughput, time producers spent blocked, and inserts that landed in a ring
+//   homed on another node (each one is remote traffic for the row and the ring's lock).
+//   Usage: NumaRingBench [rows_per_producer] [producers_per_node]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Table.h"
+#include "../Logger.h"
+#include "../Numa.h"
+#include "../Utility.h"
+
+// The tables report through the logger.  Not under test here, and the flight recorder is off
+void createTelemetryRecord(const char *component, uint64_t start, uint64_t end, int64_t rows, int64_t queueDepth, int64_t blocked)
+{
+}
+void createOverheadRecord(uint64_t start, uint64_t end, const std::string &name, const std::string &args)
+{
+}
+Logger &Logger::singleton()
+{
+    abort();
+}
+void Logger::dumpRecorder()
+{
+}
+
+static const char *SCHEMA = "CREATE TABLE IF NOT EXISTS \"rocpd_api\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"pid\" integer NOT NULL, \"tid\" integer NOT NULL, \"start\" integer NOT NULL, \"end\" integer NOT NULL, \"apiName_id\" integer NOT NULL, \"args_id\" integer NOT NULL)";
+
+static sqlite3_int64 queryInt(sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *stmt;
+    sqlite3_int64 result = -1;
+    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+static bool run(bool perNode, int rowsPerProducer, int producersPerNode)
+{
+    const Numa &numa = Numa::singleton();
+    const int sets = numa.sets();
+
+    char filename[] = "/tmp/numa_ring_bench_XXXXXX";
+    int fd = mkstemp(filename);
+    close(fd);
+    sqlite3 *db;
+    sqlite3_open(filename, &db);
+    sqlite3_exec(db, SCHEMA, NULL, NULL, NULL);
+
+    std::vector<ApiTable*> tables(perNode ? sets : 1);
+    std::vector<int> home(tables.size());
+    for (size_t set = 0; set < tables.size(); ++set) {
+        numa.runOn(set, [&]() { tables[set] = new ApiTable(filename); home[set] = numa.set(); });
+        tables[set]->pinWriter(numa.writerCpus(perNode ? set : -1));
+    }
+
+    std::atomic<sqlite3_int64> nextId {1};
+    std::atomic<sqlite3_int64> crossNode {0};
+    std::vector<std::thread> producers;
+    const timestamp_t begin = clocktime_ns();
+    for (int set = 0; set < sets; ++set) {
+        for (int p = 0; p < producersPerNode; ++p) {
+            producers.emplace_back([&, set]() {
+                if (sets > 1)
+                    Numa::pin(pthread_self(), numa.cpus(set));
+                sqlite3_int64 remote = 0;
+                ApiTable::row row {0, 0, 0, 0, 1, 1, 0};
+                row.pid = getpid();
+                row.tid = GetTid();
+                for (int i = 0; i < rowsPerProducer; ++i) {
+                    const int current = numa.set();
+                    const int index = perNode ? current : 0;
+                    remote += (home[index] != current);
+                    row.api_id = nextId++;
+                    row.start = row.end = i;
+                    tables[index]->insert(row);
+                }
+                crossNode += remote;
+            });
+        }
+    }
+    for (auto &t : producers)
+        t.join();
+    const timestamp_t end = clocktime_ns();
+
+    uint64_t blockedNs = 0;
+    for (auto table : tables) {
+        table->finalize();
+        blockedNs += table->stats().blockedNs;
+        delete table;
+    }
+    const timestamp_t drained = clocktime_ns();
+
+    const sqlite3_int64 expected = sqlite3_int64(rowsPerProducer) * producersPerNode * sets;
+    const sqlite3_int64 rows = queryInt(db, "select count(*) from rocpd_api");
+    sqlite3_close(db);
+    unlink(filename);
+
+    fprintf(stderr, "NumaRingBench: %-8s %d node(s) %lld rows, insert %.2f Mrows/sec, drained %.2f Mrows/sec, blocked %.1f ms, cross-node inserts %.1f%%\n",
+        perNode ? "per-node" : "shared", sets, rows, expected / ((end - begin) / 1000.0),
+        expected / ((drained - begin) / 1000.0), blockedNs / 1e6, 100.0 * crossNode / expected);
+
+    if (rows != expected) {
+        fprintf(stderr, "FAIL: expected %lld rows, got %lld\n", expected, rows);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const int rowsPerProducer = (argc > 1) ? atoi(argv[1]) : 50000;
+    const int producersPerNode = (argc > 2) ? atoi(argv[2]) : 2;
+
+    bool ok = run(false, rowsPerProducer, producersPerNode);
+    ok = run(true, rowsPerProducer, producersPerNode) && ok;
+    return ok ? 0 : 1;
+}
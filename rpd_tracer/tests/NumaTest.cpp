@@ -0,0 +1,89 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+// Numa topology parsing, ring set lookup and writer cpu selection against a fake sysfs tree
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "../Numa.h"
+
+static std::string root;
+static int failures = 0;
+
+static void writeFile(const std::string &path, const std::string &contents)
+{
+    system(("mkdir -p $(dirname " + path + ")").c_str());
+    FILE *f = fopen(path.c_str(), "w");
+    fputs(contents.c_str(), f);
+    fclose(f);
+}
+
+static void check(bool condition, const char *what)
+{
+    if (condition == false) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    check(Numa::parseCpuList("0-3,8,10-11\n") == std::vector<int>({0, 1, 2, 3, 8, 10, 11}), "cpulist ranges");
+    check(Numa::parseCpuList("").empty(), "empty cpulist");
+    check(Numa::parseCpuList("x,5").size() == 1, "bad entries skipped");
+
+    char dir[] = "/tmp/numa_nodes_XXXXXX";
+    root = mkdtemp(dir);
+    writeFile(root + "/node0/cpulist", "0-3,8-11\n");
+    writeFile(root + "/node1/cpulist", "4-7,12-15\n");
+    writeFile(root + "/node2/cpulist", "\n");       // memory only, e.g. HBM or CXL
+    writeFile(root + "/online", "0-2\n");
+
+    Numa numa(root, true, "");
+    check(numa.sets() == 2, "memory only node has no ring set");
+    check(numa.node(1) == 1 && numa.cpus(1).size() == 8, "node cpus");
+    check(numa.writerCpus(1) == numa.cpus(1), "writers default to their node");
+    check(numa.writerCpus(-1).empty(), "shared writers unpinned by default");
+
+    Numa pinned(root, true, "2-3,14-15");
+    check(pinned.writerCpus(0) == std::vector<int>({2, 3}), "writer cpus on node 0");
+    check(pinned.writerCpus(1) == std::vector<int>({14, 15}), "writer cpus on node 1");
+    check(pinned.writerCpus(-1).size() == 4, "shared writers use the whole list");
+
+    Numa remote(root, true, "3");
+    check(remote.writerCpus(1) == std::vector<int>({3}), "no local writer cpus falls back to the list");
+
+    Numa disabled(root, false, "5");
+    check(disabled.sets() == 1 && disabled.set() == 0, "RPDT_NUMA=0 gives one set");
+    check(disabled.writerCpus(0) == std::vector<int>({5}), "writer cpus without ring sets");
+
+    Numa missing(root + "/nothing", true, "");
+    check(missing.sets() == 1, "no topology gives one set");
+
+    system(("rm -rf " + root).c_str());
+
+    if (failures == 0)
+        fprintf(stderr, "NumaTest: passed\n");
+    return failures ? 1 : 0;
+}
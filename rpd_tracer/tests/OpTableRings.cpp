@@ -0,0 +1,124 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+// Several OpTables (one per ring set) flushing into one file.  Op ids come from a
+//   counter shared by every ring set, and each rocpd_api_ops row has to point at the
+//   op that was inserted with it.
+//   Usage: OpTableRings [ring_sets] [rows_per_set]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Table.h"
+#include "../Logger.h"
+
+// The tables report through the logger.  Not under test here, and the flight recorder is off
+void createTelemetryRecord(const char *component, uint64_t start, uint64_t end, int64_t rows, int64_t queueDepth, int64_t blocked)
+{
+}
+void createOverheadRecord(uint64_t start, uint64_t end, const std::string &name, const std::string &args)
+{
+}
+Logger &Logger::singleton()
+{
+    abort();
+}
+void Logger::dumpRecorder()
+{
+}
+
+static const char *SCHEMA[] = {
+    "CREATE TABLE IF NOT EXISTS \"rocpd_op\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"gpuId\" integer NOT NULL, \"queueId\" integer NOT NULL, \"sequenceId\" integer NOT NULL, \"completionSignal\" varchar(18) NOT NULL, \"start\" integer NOT NULL, \"end\" integer NOT NULL, \"description_id\" integer NOT NULL, \"opType_id\" integer NOT NULL)",
+    "CREATE TABLE IF NOT EXISTS \"rocpd_api_ops\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"api_id\" integer NOT NULL, \"op_id\" integer NOT NULL)",
+};
+
+static sqlite3_int64 queryInt(sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *stmt;
+    sqlite3_int64 result = -1;
+    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    const int sets = (argc > 1) ? atoi(argv[1]) : 4;
+    const int rowsPerSet = (argc > 2) ? atoi(argv[2]) : 20000;
+
+    char filename[] = "/tmp/op_table_rings_XXXXXX";
+    int fd = mkstemp(filename);
+    close(fd);
+    sqlite3 *db;
+    sqlite3_open(filename, &db);
+    for (auto sql : SCHEMA)
+        sqlite3_exec(db, sql, NULL, NULL, NULL);
+
+    std::vector<OpTable*> tables(sets);
+    for (int set = 0; set < sets; ++set) {
+        tables[set] = new OpTable(filename);
+        tables[set]->setIdOffset(0);
+    }
+
+    // Interleaved api ids, so every ring set's writer is flushing at the same time.
+    //   Each op carries its api id in start to check the link against.
+    std::vector<std::thread> producers;
+    for (int set = 0; set < sets; ++set) {
+        producers.emplace_back([&, set]() {
+            OpTable::row row {};
+            for (int i = 0; i < rowsPerSet; ++i) {
+                row.api_id = sqlite3_int64(i) * sets + set + 1;
+                row.gpuId = set;
+                row.start = row.end = row.api_id;
+                row.description_id = row.opType_id = 1;
+                tables[set]->insert(row);
+            }
+        });
+    }
+    for (auto &t : producers)
+        t.join();
+    for (auto table : tables) {
+        table->finalize();
+        delete table;
+    }
+
+    const sqlite3_int64 expected = sqlite3_int64(sets) * rowsPerSet;
+    const sqlite3_int64 ops = queryInt(db, "select count(*) from rocpd_op");
+    const sqlite3_int64 links = queryInt(db, "select count(*) from rocpd_api_ops");
+    const sqlite3_int64 joined = queryInt(db, "select count(*) from rocpd_api_ops A join rocpd_op B on B.id = A.op_id where B.start = A.api_id");
+    const sqlite3_int64 distinctOps = queryInt(db, "select count(distinct op_id) from rocpd_api_ops");
+    sqlite3_close(db);
+    unlink(filename);
+
+    fprintf(stderr, "OpTableRings: %d ring sets, %lld ops, %lld api_ops, %lld linked to their op\n", sets, ops, links, joined);
+    if (ops != expected || links != expected || joined != expected || distinctOps != expected) {
+        fprintf(stderr, "FAIL: expected %lld ops each linked to its api, got %lld ops, %lld links, %lld matching, %lld distinct\n",
+            expected, ops, links, joined, distinctOps);
+        return 1;
+    }
+    return 0;
+}
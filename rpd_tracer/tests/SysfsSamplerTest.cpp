@@ -0,0 +1,107 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+// Exercise the sysfs sampler backend against a fake sysfs tree
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cmath>
+#include <string>
+
+#include "../SysfsSampler.h"
+
+static std::string root;
+static int failures = 0;
+
+static void writeFile(const std::string &path, const std::string &contents)
+{
+    system(("mkdir -p $(dirname " + path + ")").c_str());
+    FILE *f = fopen(path.c_str(), "w");
+    fputs(contents.c_str(), f);
+    fclose(f);
+}
+
+static void check(bool condition, const char *what)
+{
+    if (condition == false) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static void makeGpu(const std::string &card, const char *vendor, int sclkMhz, bool hwmon)
+{
+    std::string device = root + "/class/drm/" + card + "/device";
+    writeFile(device + "/vendor", std::string(vendor) + "\n");
+    writeFile(device + "/gpu_busy_percent", "42\n");
+    writeFile(device + "/mem_info_vram_used", "2147483648\n");
+    if (hwmon) {
+        writeFile(device + "/hwmon/hwmon7/freq1_input", std::to_string(sclkMhz * 1000000LL) + "\n");
+        writeFile(device + "/hwmon/hwmon7/power1_input", "350000000\n");
+        writeFile(device + "/hwmon/hwmon7/temp1_input", "65000\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char dir[] = "/tmp/sysfs_sampler_XXXXXX";
+    root = mkdtemp(dir);
+
+    makeGpu("card2", "0x1002", 2100, true);
+    makeGpu("card0", "0x1002", 1500, false);
+    makeGpu("card1", "0x10de", 1000, true);                 // not ours
+    writeFile(root + "/class/drm/card0-DP-1/device/vendor", "0x1002\n");   // connector
+
+    SysfsSamplerBackend backend(root);
+    check(backend.init(), "init");
+    check(backend.deviceCount() == 2, "two amd gpus found");
+
+    // card0 -> device 0, no hwmon
+    check(backend.supports(0, SamplerMetric::busy), "card0 busy");
+    check(backend.supports(0, SamplerMetric::sclk) == false, "card0 has no sclk");
+    check(backend.supports(1, SamplerMetric::sclk), "card2 sclk");
+    check(backend.supports(1, SamplerMetric::power), "card2 power falls back to power1_input");
+    check(backend.supports(1, SamplerMetric::mclk) == false, "card2 has no mclk");
+
+    SamplerMetric metrics[] = {SamplerMetric::sclk, SamplerMetric::power, SamplerMetric::temp, SamplerMetric::busy, SamplerMetric::vram, SamplerMetric::mclk};
+    double values[6];
+    bool valid[6];
+    backend.read(1, metrics, 6, values, valid);
+    check(valid[0] && std::fabs(values[0] - 2100) < 1e-6, "sclk MHz");
+    check(valid[1] && std::fabs(values[1] - 350) < 1e-6, "power W");
+    check(valid[2] && std::fabs(values[2] - 65) < 1e-6, "temp C");
+    check(valid[3] && values[3] == 42, "busy percent");
+    check(valid[4] && values[4] == 2048, "vram MiB");
+    check(valid[5] == false, "mclk not read");
+
+    // Values are re-read through the open descriptors
+    writeFile(root + "/class/drm/card2/device/hwmon/hwmon7/freq1_input", "800000000\n");
+    backend.read(1, metrics, 1, values, valid);
+    check(valid[0] && std::fabs(values[0] - 800) < 1e-6, "sclk re-read");
+
+    backend.shutdown();
+    system(("rm -rf " + root).c_str());
+
+    if (failures == 0)
+        fprintf(stderr, "SysfsSamplerTest: passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,588 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#include "RpdTrace.h"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace rpdtrace {
+
+void appendDouble(std::string &out, double v)
+{
+    if (std::isnan(v)) { out += "nan"; return; }
+    if (std::isinf(v)) { out += (v < 0) ? "-inf" : "inf"; return; }
+
+    // Shortest round-trip digits, laid out the way python's repr() does
+    char buf[40];
+    auto res = std::to_chars(buf, buf + sizeof(buf) - 1, v, std::chars_format::scientific);
+    *res.ptr = '\0';
+    const char *p = buf;
+    if (*p == '-') {
+        out += '-';
+        ++p;
+    }
+    const char *e = strchr(p, 'e');
+    std::string digits;
+    for (const char *c = p; c < e; ++c)
+        if (*c != '.')
+            digits += *c;
+    int exp = atoi(e + 1);
+
+    if (exp >= -4 && exp < 16) {
+        if (exp < 0) {
+            out += "0.";
+            out.append(-exp - 1, '0');
+            out += digits;
+        }
+        else if (digits.size() > size_t(exp + 1)) {
+            out.append(digits, 0, exp + 1);
+            out += '.';
+            out.append(digits, exp + 1, std::string::npos);
+        }
+        else {
+            out += digits;
+            out.append(exp + 1 - digits.size(), '0');
+            out += ".0";
+        }
+    }
+    else {
+        out += digits[0];
+        if (digits.size() > 1) {
+            out += '.';
+            out.append(digits, 1, std::string::npos);
+        }
+        char ebuf[16];      // "e-" and up to 10 digits; the exponent is an int
+        snprintf(ebuf, sizeof(ebuf), "e%c%02d", exp < 0 ? '-' : '+', std::abs(exp));
+        out += ebuf;
+    }
+}
+
+void appendInt(std::string &out, sqlite3_int64 v)
+{
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, res.ptr - buf);
+}
+
+void appendStripped(std::string &out, const std::string &s, const char *strip)
+{
+    for (char c : s)
+        if (strchr(strip, c) == nullptr)
+            out += c;
+}
+
+
+Statement::Statement(sqlite3 *db, const std::string &sql)
+{
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &m_stmt, nullptr) != SQLITE_OK) {
+        m_error = sqlite3_errmsg(db);
+        sqlite3_finalize(m_stmt);
+        m_stmt = nullptr;
+    }
+}
+
+Statement::~Statement()
+{
+    sqlite3_finalize(m_stmt);
+}
+
+std::string Statement::text(int col)
+{
+    const char *t = reinterpret_cast<const char*>(sqlite3_column_text(m_stmt, col));
+    return t ? std::string(t, sqlite3_column_bytes(m_stmt, col)) : std::string();
+}
+
+void Statement::append(std::string &out, int col)
+{
+    switch (sqlite3_column_type(m_stmt, col)) {
+        case SQLITE_INTEGER: appendInt(out, i64(col)); break;
+        case SQLITE_FLOAT: appendDouble(out, dbl(col)); break;
+        case SQLITE_NULL: out += "None"; break;
+        default: out.append(reinterpret_cast<const char*>(sqlite3_column_text(m_stmt, col)), sqlite3_column_bytes(m_stmt, col)); break;
+    }
+}
+
+
+void StringMap::load(sqlite3 *db)
+{
+    Statement max(db, "select max(id) from rocpd_string");
+    if (max.ok() && max.step() && !max.isNull(0)) {
+        m_strings.resize(max.i64(0) + 1);
+        m_present.resize(max.i64(0) + 1, false);
+    }
+    Statement s(db, "select id, string from rocpd_string");
+    while (s.ok() && s.step()) {
+        sqlite3_int64 id = s.i64(0);
+        if (id < 0 || size_t(id) >= m_strings.size())
+            continue;
+        m_strings[id] = s.text(1);
+        m_present[id] = true;
+    }
+}
+
+const std::string *StringMap::get(sqlite3_int64 id) const
+{
+    if (id < 0 || size_t(id) >= m_strings.size() || !m_present[id])
+        return nullptr;
+    return &m_strings[id];
+}
+
+std::string StringMap::idsOf(const char *value) const
+{
+    std::string ids;
+    for (size_t i = 0; i < m_strings.size(); ++i) {
+        if (m_present[i] && m_strings[i] == value) {
+            if (!ids.empty())
+                ids += ",";
+            ids += std::to_string(i);
+        }
+    }
+    return ids;
+}
+
+
+bool parseArgs(int argc, char **argv, Options &opts, const char *suffix, bool allowFormat)
+{
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](std::string &dest) {
+            size_t eq = arg.find('=');
+            if (eq != std::string::npos) {
+                dest = arg.substr(eq + 1);
+                return true;
+            }
+            if (i + 1 >= argc)
+                return false;
+            dest = argv[++i];
+            return true;
+        };
+        auto is = [&](const char *name) {
+            return arg == name || arg.rfind(std::string(name) + "=", 0) == 0;
+        };
+        std::string threads;
+        if (arg == "-h" || arg == "--help")
+            return false;
+        else if (is("--start")) { if (!value(opts.start)) return false; }
+        else if (is("--end")) { if (!value(opts.end)) return false; }
+        else if (allowFormat && is("--format")) { if (!value(opts.format)) return false; }
+        else if (is("--threads")) {
+            if (!value(threads)) return false;
+            opts.threads = atoi(threads.c_str());
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+            return false;
+        else
+            positional.push_back(arg);
+    }
+    if (positional.empty() || positional.size() > 2)
+        return false;
+    opts.input = positional[0];
+    if (positional.size() > 1)
+        opts.output = positional[1];
+    else {
+        // pathlib.PurePath.with_suffix()
+        std::string path = positional[0];
+        size_t slash = path.rfind('/');
+        size_t dot = path.rfind('.');
+        size_t base = (slash == std::string::npos) ? 0 : slash + 1;
+        if (dot != std::string::npos && dot > base)
+            path.erase(dot);
+        opts.output = path + suffix;
+    }
+    return true;
+}
+
+
+// Time argument as either absolute us or a percentage of the api span
+static bool parseTime(const std::string &arg, sqlite3_int64 minTime, sqlite3_int64 maxTime, PyNum &result)
+{
+    std::string number = arg;
+    bool percent = false;
+    size_t pos;
+    while ((pos = number.find('%')) != std::string::npos) {
+        number.erase(pos, 1);
+        percent = true;
+    }
+    char *end = nullptr;
+    long long value = strtoll(number.c_str(), &end, 10);
+    if (number.empty() || *end != '\0') {
+        fprintf(stderr, "invalid time: %s\n", arg.c_str());
+        return false;
+    }
+    if (percent)
+        result = PyNum::fromDouble((double(maxTime - minTime) * (value / 100.0) + double(minTime)) / 1000);
+    else
+        result = PyNum::fromInt(value);
+    return true;
+}
+
+bool TimeRange::load(sqlite3 *db, const Options &opts)
+{
+    Statement s(db, "select MIN(start), MAX(end) from rocpd_api");
+    if (!s.ok()) {
+        fprintf(stderr, "%s\n", s.error().c_str());
+        return false;
+    }
+    if (!s.step() || s.isNull(0)) {
+        fprintf(stderr, "Trace file is empty.\n");
+        return false;
+    }
+    minTime = s.i64(0);
+    maxTime = s.i64(1);
+    lastEnd = maxTime;
+    Statement o(db, "select MAX(end) from rocpd_op");
+    if (o.ok() && o.step() && !o.isNull(0) && o.i64(0) > lastEnd)
+        lastEnd = o.i64(0);
+
+    printf("Timestamps:\n");
+    std::string t;
+    appendDouble(t, minTime / 1000.0);
+    printf("\t    first: \t%s us\n", t.c_str());
+    t.clear();
+    appendDouble(t, maxTime / 1000.0);
+    printf("\t     last: \t%s us\n", t.c_str());
+    t.clear();
+    appendDouble(t, (maxTime - minTime) / 1000000000.0);
+    printf("\t duration: \t%s seconds\n", t.c_str());
+
+    start = PyNum::fromDouble(minTime / 1000.0);
+    end = PyNum::fromDouble(maxTime / 1000.0);
+    hasStart = !opts.start.empty();
+    hasEnd = !opts.end.empty();
+    // Compare raw ns (same rows as start/1000 against the us bounds) so the
+    // start indexes from rpd_index.py apply
+    if (hasStart) {
+        if (!parseTime(opts.start, minTime, maxTime, start))
+            return false;
+        const std::string ns = std::to_string(sqlite3_int64(std::ceil(start.value())) * 1000);
+        api = "where rocpd_api.start >= " + ns;
+        op = "where rocpd_op.start >= " + ns;
+        monitor = "where start >= " + ns;
+    }
+    if (hasEnd) {
+        if (!parseTime(opts.end, minTime, maxTime, end))
+            return false;
+        const std::string ns = std::to_string(sqlite3_int64(std::floor(end.value())) * 1000 + 999);
+        const std::string join = hasStart ? " and " : "where ";
+        api += join + "rocpd_api.start <= " + ns;
+        op += join + "rocpd_op.start <= " + ns;
+        monitor += join + "start <= " + ns;
+    }
+
+    printf("\nFilter: %s\n", api.c_str());
+    t.clear();
+    if (start.isInt && end.isInt)
+        appendDouble(t, (end.i - start.i) / 1000000.0);
+    else
+        appendDouble(t, (end.value() - start.value()) / 1000000);
+    printf("Output duration: %s seconds\n", t.c_str());
+    fflush(stdout);
+    return true;
+}
+
+
+bool isCompressed(const std::string &path)
+{
+    char magic[4] = {0};
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr)
+        return false;
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    return n == sizeof(magic) && memcmp(magic, "RPDZ", 4) == 0;
+}
+
+sqlite3 *openDb(const std::string &path)
+{
+    if (isCompressed(path)) {
+        fprintf(stderr, "%s is a compressed trace, unpack it first: python3 -m rocpd.compress unpack %s\n", path.c_str(), path.c_str());
+        return nullptr;
+    }
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", path.c_str(), db ? sqlite3_errmsg(db) : "cannot open");
+        sqlite3_close(db);
+        return nullptr;
+    }
+    return db;
+}
+
+
+sqlite3 *openDbForWrite(const std::string &path)
+{
+    if (isCompressed(path)) {
+        fprintf(stderr, "%s is a compressed trace, unpack it first: python3 -m rocpd.compress unpack %s\n", path.c_str(), path.c_str());
+        return nullptr;
+    }
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", path.c_str(), db ? sqlite3_errmsg(db) : "cannot open");
+        sqlite3_close(db);
+        return nullptr;
+    }
+    sqlite3_busy_timeout(db, 10000);
+    return db;
+}
+
+bool exec(sqlite3 *db, const std::string &sql)
+{
+    char *err = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
+        fprintf(stderr, "%s\n  %s\n", err ? err : "error", sql.c_str());
+        sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+
+static const size_t s_flushSize = 1 << 20;
+
+Chunk::Chunk(int fd)
+: m_fd(fd)
+{
+    m_buffer.reserve(s_flushSize + 4096);
+}
+
+void Chunk::endEvent(bool newline)
+{
+    if (newline)
+        m_buffer += '\n';
+    ++m_events;
+    if (m_buffer.size() >= s_flushSize)
+        flush();
+}
+
+void Chunk::flush()
+{
+    const char *p = m_buffer.data();
+    size_t left = m_buffer.size();
+    while (left > 0) {
+        ssize_t n = ::write(m_fd, p, left);
+        if (n <= 0) {
+            m_failed = true;
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    m_buffer.clear();
+}
+
+
+static bool writeAll(int fd, const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = ::write(fd, p, n);
+        if (w <= 0)
+            return false;
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+static bool copyChunk(int from, int to)
+{
+    std::vector<char> buffer(4 << 20);
+    if (lseek(from, 0, SEEK_SET) < 0)
+        return false;
+    ssize_t n;
+    while ((n = ::read(from, buffer.data(), buffer.size())) > 0)
+        if (!writeAll(to, buffer.data(), n))
+            return false;
+    return n == 0;
+}
+
+bool runSections(const Options &opts, std::vector<Section> &sections,
+                 const std::string &header, const std::string &footer)
+{
+    const auto wallStart = std::chrono::steady_clock::now();
+
+    // Each section streams into its own temporary chunk next to the output
+    std::string dir = ".";
+    size_t slash = opts.output.rfind('/');
+    if (slash != std::string::npos)
+        dir = opts.output.substr(0, slash + 1);
+    std::vector<int> chunkFds(sections.size(), -1);
+    std::vector<size_t> chunkEvents(sections.size(), 0);
+    std::vector<char> chunkOk(sections.size(), 1);
+    for (size_t i = 0; i < sections.size(); ++i) {
+        std::string tmpl = dir + "/.rpdtrace.XXXXXX";
+        chunkFds[i] = mkstemp(&tmpl[0]);
+        if (chunkFds[i] < 0) {
+            fprintf(stderr, "cannot create temporary file in %s\n", dir.c_str());
+            return false;
+        }
+        unlink(tmpl.c_str());
+    }
+
+    int threads = opts.threads > 0 ? opts.threads : std::thread::hardware_concurrency();
+    if (threads < 1)
+        threads = 1;
+    if (size_t(threads) > sections.size())
+        threads = sections.size();
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < threads; ++w) {
+        workers.emplace_back([&]() {
+            sqlite3 *conn = openDb(opts.input);
+            if (conn == nullptr) {
+                failed = true;
+                return;
+            }
+            size_t i;
+            while ((i = next++) < sections.size()) {
+                Chunk chunk(chunkFds[i]);
+                chunkOk[i] = sections[i].run(conn, chunk);
+                chunk.flush();
+                chunkEvents[i] = chunk.events();
+                if (chunk.failed()) {
+                    fprintf(stderr, "write failed for section %s\n", sections[i].name);
+                    failed = true;
+                }
+            }
+            sqlite3_close(conn);
+        });
+    }
+    for (auto &w : workers)
+        w.join();
+
+    int out = open(opts.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        fprintf(stderr, "cannot open %s\n", opts.output.c_str());
+        return false;
+    }
+    if (!writeAll(out, header.data(), header.size()))
+        failed = true;
+
+    size_t events = 0;
+    for (size_t i = 0; i < sections.size(); ++i) {
+        if (!chunkOk[i]) {
+            if (sections[i].missingMessage)
+                printf("%s\n", sections[i].missingMessage);
+            if (!sections[i].optional) {
+                fprintf(stderr, "section %s failed\n", sections[i].name);
+                failed = true;
+            }
+        }
+        if (!copyChunk(chunkFds[i], out))
+            failed = true;
+        close(chunkFds[i]);
+        events += chunkEvents[i];
+    }
+
+    if (!writeAll(out, footer.data(), footer.size()))
+        failed = true;
+    if (close(out) != 0)
+        failed = true;
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    fprintf(stderr, "Wrote %zu events in %.2f seconds (%.0f events/sec, %d threads)\n",
+        events, seconds, seconds > 0 ? events / seconds : 0.0, threads);
+
+    return !failed;
+}
+
+
+bool markerFrames(sqlite3 *db, const StringMap &strings, const std::string &userMarkerIds,
+                  const std::string &rangeApi, const std::function<void(const GpuFrame &)> &emit)
+{
+    const std::string markers = "rocpd_api.apiName_id in (" + userMarkerIds + ") AND rocpd_api.start/1000.0 != rocpd_api.end/1000.0";
+    const std::string where = rangeApi.empty() ? "where " + markers : rangeApi + " and " + markers;
+    Statement s(db, "SELECT 0, start/1000.0, pid, tid, args_id, 0, 0, 0, 0 from rocpd_api " + where
+        + " UNION ALL SELECT 1, end/1000.0, pid, tid, args_id, 0, 0, 0, 0 from rocpd_api " + where
+        + " UNION ALL SELECT 2, rocpd_api.start/1000.0, pid, tid, 0, gpuId, queueId, rocpd_op.start/1000.0, rocpd_op.end/1000.0 from rocpd_api_ops INNER JOIN rocpd_api ON rocpd_api_ops.api_id = rocpd_api.id INNER JOIN rocpd_op ON rocpd_api_ops.op_id = rocpd_op.id " + rangeApi
+        + " ORDER BY start/1000.0 asc");
+    if (!s.ok())
+        return false;
+
+    typedef std::pair<sqlite3_int64, sqlite3_int64> Key;
+    std::map<Key, std::vector<std::pair<double, std::string>>> stacks;
+    std::map<Key, GpuFrame> currentFrame;
+    while (s.step()) {
+        const Key key(s.i64(2), s.i64(3));
+        const int kind = s.i64(0);
+        if (kind == 0) {    // Frame start
+            const std::string *label = strings.get(s.i64(4));
+            if (label != nullptr)
+                stacks[key].emplace_back(s.dbl(1), *label);
+        }
+        else if (kind == 1) {    // Frame end
+            auto it = stacks.find(key);
+            if (strings.get(s.i64(4)) != nullptr && it != stacks.end() && !it->second.empty())
+                it->second.pop_back();
+        }
+        else {    // API + Op
+            auto it = stacks.find(key);
+            if (it == stacks.end() || it->second.empty())
+                continue;
+            const auto &frame = it->second.back();
+            const std::pair<sqlite3_int64, sqlite3_int64> dest(s.i64(5), s.i64(6));
+            const double opStart = s.dbl(7);
+            const double opEnd = s.dbl(8);
+            auto cf = currentFrame.find(key);
+            if (cf != currentFrame.end()) {
+                GpuFrame &gpuFrame = cf->second;
+                // Another op under the same frame -> union them (but only if they are butt together)
+                if (gpuFrame.id == frame.first && gpuFrame.name == frame.second
+                    && (std::fabs(opStart - gpuFrame.end) < 200 || std::fabs(gpuFrame.start - opEnd) < 200)) {
+                    if (opStart < gpuFrame.start) gpuFrame.start = opStart;
+                    if (opEnd > gpuFrame.end) gpuFrame.end = opEnd;
+                    bool seen = false;
+                    for (auto &g : gpuFrame.gpus)
+                        seen = seen || g == dest;
+                    if (!seen)
+                        gpuFrame.gpus.push_back(dest);
+                    ++gpuFrame.totalOps;
+                    continue;
+                }
+                // This is a new frame - dump the last and make new
+                emit(gpuFrame);
+            }
+            GpuFrame &gpuFrame = currentFrame[key];
+            gpuFrame.id = frame.first;
+            gpuFrame.name = frame.second;
+            gpuFrame.start = opStart;
+            gpuFrame.end = opEnd;
+            gpuFrame.gpus.assign(1, dest);
+            gpuFrame.totalOps = 1;
+        }
+    }
+    return true;
+}
+
+}  // namespace rpdtrace
@@ -0,0 +1,182 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+#pragma once
+
+#include <sqlite3.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Shared plumbing for the native trace tools (rpd2tracing, rpd2perfetto, ...)
+namespace rpdtrace {
+
+// Python "%s" formatting of numbers, so output matches the python tools
+void appendDouble(std::string &out, double v);
+void appendInt(std::string &out, sqlite3_int64 v);
+// Remove every occurrence of the given characters (python str.replace(c, ''))
+void appendStripped(std::string &out, const std::string &s, const char *strip);
+
+// An int or a float, mirroring how the python tools carry times around
+struct PyNum
+{
+    bool isInt {true};
+    sqlite3_int64 i {0};
+    double d {0};
+
+    static PyNum fromInt(sqlite3_int64 v) { PyNum n; n.i = v; return n; }
+    static PyNum fromDouble(double v) { PyNum n; n.isInt = false; n.d = v; return n; }
+    double value() const { return isInt ? double(i) : d; }
+    void append(std::string &out) const { if (isInt) appendInt(out, i); else appendDouble(out, d); }
+    std::string str() const { std::string s; append(s); return s; }
+};
+
+class Statement
+{
+public:
+    Statement(sqlite3 *db, const std::string &sql);
+    ~Statement();
+
+    bool ok() const { return m_stmt != nullptr; }
+    const std::string &error() const { return m_error; }
+    bool step() { return sqlite3_step(m_stmt) == SQLITE_ROW; }
+    sqlite3_stmt *get() { return m_stmt; }
+
+    sqlite3_int64 i64(int col) { return sqlite3_column_int64(m_stmt, col); }
+    double dbl(int col) { return sqlite3_column_double(m_stmt, col); }
+    bool isNull(int col) { return sqlite3_column_type(m_stmt, col) == SQLITE_NULL; }
+    bool isText(int col) { return sqlite3_column_type(m_stmt, col) == SQLITE_TEXT; }
+    std::string text(int col);
+    // Column formatted the way python prints whatever sqlite3 handed back
+    void append(std::string &out, int col);
+
+private:
+    sqlite3_stmt *m_stmt {nullptr};
+    std::string m_error;
+};
+
+// rocpd_string preloaded by id so no query has to join against it
+class StringMap
+{
+public:
+    void load(sqlite3 *db);
+    // Returns nullptr for ids an INNER JOIN on rocpd_string would have dropped
+    const std::string *get(sqlite3_int64 id) const;
+    // Comma separated ids holding value, for use in an "in (...)" predicate
+    std::string idsOf(const char *value) const;
+
+private:
+    std::vector<std::string> m_strings;
+    std::vector<bool> m_present;
+};
+
+struct Options
+{
+    std::string input;
+    std::string output;
+    std::string start;
+    std::string end;
+    std::string format {"object"};
+    int threads {0};
+};
+
+// Parses [--start] [--end] [--format] [--threads] input [output].  The output
+// defaults to the input with its suffix replaced.
+bool parseArgs(int argc, char **argv, Options &opts, const char *suffix, bool allowFormat);
+
+// Trace bounds and the --start/--end filter, as rpd2tracing.py computes them
+struct TimeRange
+{
+    sqlite3_int64 minTime {0};
+    sqlite3_int64 maxTime {0};
+    sqlite3_int64 lastEnd {0};          // last api or op end, in ns
+    PyNum start;
+    PyNum end;
+    bool hasStart {false};
+    bool hasEnd {false};
+    std::string api;                    // "where ..." clauses, or empty
+    std::string op;
+    std::string monitor;
+
+    // Prints the same summary as the python tool
+    bool load(sqlite3 *db, const Options &opts);
+};
+
+bool isCompressed(const std::string &path);
+sqlite3 *openDb(const std::string &path);
+// For the tools that add tables to the trace
+sqlite3 *openDbForWrite(const std::string &path);
+// sqlite3_exec, printing the error and statement on failure
+bool exec(sqlite3 *db, const std::string &sql);
+
+// Buffered writer for one section's temporary chunk
+class Chunk
+{
+public:
+    Chunk(int fd);
+
+    std::string &buffer() { return m_buffer; }
+    // Finish one event
+    void endEvent(bool newline = true);
+    void flush();
+    size_t events() const { return m_events; }
+    bool failed() const { return m_failed; }
+
+private:
+    int m_fd;
+    std::string m_buffer;
+    size_t m_events {0};
+    bool m_failed {false};
+};
+
+struct Section
+{
+    const char *name;
+    // Returns false if the section's query could not run
+    std::function<bool(sqlite3 *, Chunk &)> run;
+    bool optional;
+    const char *missingMessage;
+};
+
+// Runs the sections on a pool of threads, each with its own connection and
+// chunk file, then writes header, the chunks in order and footer to output.
+bool runSections(const Options &opts, std::vector<Section> &sections,
+                 const std::string &header, const std::string &footer);
+
+// "Faux calling stack frame" on gpu ops built from UserMarker ranges
+struct GpuFrame
+{
+    double id {0};
+    std::string name;
+    double start {0};
+    double end {0};
+    std::vector<std::pair<sqlite3_int64, sqlite3_int64>> gpus;
+    sqlite3_int64 totalOps {0};
+};
+
+// Walks UserMarker ranges and their ops, calling emit for each completed frame
+bool markerFrames(sqlite3 *db, const StringMap &strings, const std::string &userMarkerIds,
+                  const std::string &rangeApi, const std::function<void(const GpuFrame &)> &emit);
+
+}  // namespace rpdtrace
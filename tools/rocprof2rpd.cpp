@@ -0,0 +1,659 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+
+//
+// Create an rpd file from rocprofiler text traces
+//
+// Native counterpart of rocpd/rocprofiler_import.py.  Each trace is streamed
+// a line at a time and parsed in place; strings are interned in memory and
+// written once at the end, keeping only the ones still referenced.  Kernel
+// and copy info is extracted while the api trace is read instead of in
+// separate passes over the database, and ops pick up their kernel names as
+// they are inserted.  Everything lands in one transaction, with the tables'
+// indexes dropped for the load and rebuilt afterwards.
+//
+
+#include "RpdTrace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace rpdtrace;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-h] [--ops_input_file F] [--api_input_file F] [--roctx_input_file F] [--input_dir D] output_rpd\n\n"
+        "Import rocprofiler hcc_ops_trace.txt, hip_api_trace.txt and roctx_trace.txt into output_rpd,\n"
+        "which must already hold the (empty) rpd schema: python3 -m rocpd.schema --create output_rpd\n", prog);
+}
+
+namespace {
+
+const char *kernelApis[] = {"hipHccModuleLaunchKernel", "hipLaunchKernel", "hipExtModuleLaunchKernel"};
+const char *copyApis[] = {"hipMemcpy", "hipMemcpy2D", "hipMemcpy2DAsync", "hipMemcpyAsync", "hipMemcpyDtoD",
+    "hipMemcpyDtoDAsync", "hipMemcpyDtoH", "hipMemcpyDtoHAsync", "hipMemcpyFromSymbol", ".hipMemcpyFromSymbolAsync",
+    "hipMemcpyHtoD", "hipMemcpyHtoDAsync", "hipMemcpyPeer", "hipMemcpyPeerAsync", "hipMemcpyToSymbol",
+    "hipMemcpyToSymbolAsync", "hipMemcpyWithStream"};
+// Args the python importer blanks out
+const char *clearedArgs = "hipGetDevice";
+
+const char *loadedTables[] = {"rocpd_string", "rocpd_api", "rocpd_op", "rocpd_api_ops", "rocpd_kernelapi", "rocpd_copyapi"};
+
+// Python re \s and \w
+bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+bool isWord(char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (c & 0x80); }
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+std::string_view strip(std::string_view s)
+{
+    while (!s.empty() && isSpace(s.front()))
+        s.remove_prefix(1);
+    while (!s.empty() && isSpace(s.back()))
+        s.remove_suffix(1);
+    return s;
+}
+
+// Hand-rolled matchers for the importer's regular expressions
+class Cursor
+{
+public:
+    Cursor(std::string_view s) : m_s(s) {}
+
+    std::string_view rest() const { return m_s.substr(m_pos); }
+    size_t pos() const { return m_pos; }
+
+    // \d*, or \d+ when nonEmpty
+    bool digits(std::string_view &out, bool nonEmpty = false) { return span(isDigit, out, nonEmpty); }
+    // \w+
+    bool word(std::string_view &out) { return span(isWord, out, true); }
+    // \s+
+    bool space() { std::string_view s; return span(isSpace, s, true); }
+    bool lit(char c)
+    {
+        if (m_pos < m_s.size() && m_s[m_pos] == c) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    bool span(bool (*pred)(char), std::string_view &out, bool nonEmpty)
+    {
+        size_t b = m_pos;
+        while (m_pos < m_s.size() && pred(m_s[m_pos]))
+            ++m_pos;
+        out = m_s.substr(b, m_pos - b);
+        return !nonEmpty || m_pos > b;
+    }
+
+    std::string_view m_s;
+    size_t m_pos {0};
+};
+
+// ^(\d*):(\d*)\s+(\d*):(\d*)\s+ shared by the op and api traces
+bool timesAndIds(Cursor &c, std::string_view g[4])
+{
+    return c.digits(g[0]) && c.lit(':') && c.digits(g[1]) && c.space()
+        && c.digits(g[2]) && c.lit(':') && c.digits(g[3]) && c.space();
+}
+
+// key=value pairs of a comma separated args string, later keys winning
+struct Args
+{
+    std::vector<std::pair<std::string_view, std::string_view>> fields;
+
+    void parse(std::string_view s)
+    {
+        fields.clear();
+        for (;;) {
+            size_t comma = s.find(',');
+            std::string_view item = s.substr(0, comma);
+            size_t eq = item.find('=');
+            std::string_view key = strip(item.substr(0, eq));
+            std::string_view value = eq == std::string_view::npos ? std::string_view() : strip(item.substr(eq + 1));
+            fields.emplace_back(key, value);
+            if (comma == std::string_view::npos)
+                break;
+            s.remove_prefix(comma + 1);
+        }
+    }
+
+    const std::string_view *get(const char *key) const
+    {
+        for (auto it = fields.rbegin(); it != fields.rend(); ++it)
+            if (it->first == key)
+                return &it->second;
+        return nullptr;
+    }
+};
+
+void bindText(sqlite3_stmt *stmt, int col, std::string_view s)
+{
+    sqlite3_bind_text(stmt, col, s.data(), int(s.size()), SQLITE_TRANSIENT);
+}
+
+// Value if present, else the python default
+void bindArg(sqlite3_stmt *stmt, int col, const Args &args, const char *key, int dflt)
+{
+    if (auto v = args.get(key))
+        bindText(stmt, col, *v);
+    else
+        sqlite3_bind_int(stmt, col, dflt);
+}
+
+void bindArg(sqlite3_stmt *stmt, int col, const Args &args, const char *key, const char *dflt)
+{
+    if (auto v = args.get(key))
+        bindText(stmt, col, *v);
+    else
+        sqlite3_bind_text(stmt, col, dflt, -1, SQLITE_STATIC);
+}
+
+class Importer
+{
+public:
+    Importer(sqlite3 *db) : m_db(db) {}
+
+    bool prepare();
+    bool importApis(FILE *f);
+    bool importRoctx(FILE *f);
+    bool importOps(FILE *f);
+    // Drops subclass rows whose api never launched an op, then writes the strings
+    bool finish();
+
+    size_t apis {0};
+    size_t ops {0};
+    size_t kernels {0};
+    size_t copies {0};
+
+private:
+    sqlite3_int64 intern(std::string_view s);
+    void ref(sqlite3_int64 id) { ++m_refs[id]; }
+    bool step(sqlite3_stmt *stmt);
+    bool insertApi(std::string_view g[4], std::string_view name, std::string_view args);
+    void kernelInfo(sqlite3_int64 apiId, std::string_view args);
+    void copyInfo(sqlite3_int64 apiId, std::string_view args);
+
+    sqlite3 *m_db;
+    bool m_ok {true};
+    std::unique_ptr<Statement> m_api;
+    std::unique_ptr<Statement> m_op;
+    std::unique_ptr<Statement> m_apiOps;
+    std::unique_ptr<Statement> m_kernel;
+    std::unique_ptr<Statement> m_copy;
+
+    std::unordered_map<std::string, sqlite3_int64> m_ids;
+    std::vector<const std::string *> m_strings {nullptr};
+    std::vector<sqlite3_int64> m_refs {0};
+    sqlite3_int64 m_empty {0};
+    std::unordered_set<std::string_view> m_kernelApis;
+    std::unordered_set<std::string_view> m_copyApis;
+
+    sqlite3_int64 m_apiId {1};
+    sqlite3_int64 m_opId {1};
+    // Per api id: kernel name string id (0 if none), and whether an op refers to it
+    std::vector<sqlite3_int64> m_kernelName {0};
+    std::vector<bool> m_copyApi {false};
+    std::vector<bool> m_hasOps {false};
+    Args m_args;
+};
+
+sqlite3_int64 Importer::intern(std::string_view s)
+{
+    auto it = m_ids.find(std::string(s));
+    if (it == m_ids.end()) {
+        it = m_ids.emplace(std::string(s), sqlite3_int64(m_strings.size())).first;
+        m_strings.push_back(&it->first);
+        m_refs.push_back(0);
+    }
+    return it->second;
+}
+
+bool Importer::step(sqlite3_stmt *stmt)
+{
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        fprintf(stderr, "%s\n", sqlite3_errmsg(m_db));
+        m_ok = false;
+    }
+    sqlite3_reset(stmt);
+    return m_ok;
+}
+
+bool Importer::prepare()
+{
+    m_api.reset(new Statement(m_db, "insert into rocpd_api(id, pid, tid, start, end, apiName_id, args_id) values (?,?,?,?,?,?,?)"));
+    m_op.reset(new Statement(m_db, "insert into rocpd_op(id, gpuId, queueId, sequenceId, completionSignal, start, end, description_id, opType_id) values (?,?,?,'','',?,?,?,?)"));
+    m_apiOps.reset(new Statement(m_db, "insert into rocpd_api_ops(api_id, op_id) values (?,?)"));
+    m_kernel.reset(new Statement(m_db, "insert into rocpd_kernelapi(api_ptr_id, stream, gridX, gridY, gridZ, workgroupX, workgroupY, workgroupZ, groupSegmentSize, privateSegmentSize, codeObject_id, kernelName_id, kernelArgAddress, aquireFence, releaseFence) values (?,?,?,?,?,?,?,?,?,0,0,?,?,'','')"));
+    m_copy.reset(new Statement(m_db, "insert into rocpd_copyapi(api_ptr_id, stream, size, width, height, kind, src, dst, srcDevice, dstDevice, sync, pinned) values (?,?,?,?,?,?,?,?,?,?,?,0)"));
+    for (auto *s : {m_api.get(), m_op.get(), m_apiOps.get(), m_kernel.get(), m_copy.get()}) {
+        if (!s->ok()) {
+            fprintf(stderr, "%s\n", s->error().c_str());
+            return false;
+        }
+    }
+    for (auto name : kernelApis)
+        m_kernelApis.insert(name);
+    for (auto name : copyApis)
+        m_copyApis.insert(name);
+    m_empty = intern("");
+    return true;
+}
+
+void Importer::kernelInfo(sqlite3_int64 apiId, std::string_view args)
+{
+    std::string_view input = args;
+    std::string_view kernel;
+    size_t k = args.find("kernel=");
+    if (k != std::string_view::npos) {
+        input = args.substr(0, k);
+        kernel = args.substr(k + strlen("kernel="));
+    }
+    m_args.parse(input);
+    const sqlite3_int64 name = intern(kernel);
+    sqlite3_stmt *stmt = m_kernel->get();
+    sqlite3_bind_int64(stmt, 1, apiId);
+    bindArg(stmt, 2, m_args, "stream", 0);
+    bindArg(stmt, 3, m_args, "gridDimX", 0);
+    bindArg(stmt, 4, m_args, "gridDimY", 0);
+    bindArg(stmt, 5, m_args, "gridDimZ", 0);
+    bindArg(stmt, 6, m_args, "blockDimX", 0);
+    bindArg(stmt, 7, m_args, "blockDimY", 0);
+    bindArg(stmt, 8, m_args, "blockDimZ", 0);
+    bindArg(stmt, 9, m_args, "sharedMemBytes", 0);
+    sqlite3_bind_int64(stmt, 10, name);
+    bindArg(stmt, 11, m_args, "args", "");
+    if (step(stmt)) {
+        m_kernelName[apiId] = name;
+        ref(name);
+        ++kernels;
+    }
+}
+
+void Importer::copyInfo(sqlite3_int64 apiId, std::string_view args)
+{
+    m_args.parse(args);
+    sqlite3_stmt *stmt = m_copy->get();
+    sqlite3_bind_int64(stmt, 1, apiId);
+    bindArg(stmt, 2, m_args, "stream", "");
+    bindArg(stmt, 3, m_args, "sizeBytes", 0);
+    bindArg(stmt, 4, m_args, "width", 0);
+    bindArg(stmt, 5, m_args, "height", 0);
+    bindArg(stmt, 6, m_args, "kind", 0);
+    bindArg(stmt, 7, m_args, "src", "");
+    bindArg(stmt, 8, m_args, "dst", "");
+    bindArg(stmt, 9, m_args, "srcDevice", 0);
+    bindArg(stmt, 10, m_args, "dstDevice", 0);
+    sqlite3_bind_int(stmt, 11, m_args.get("stream") == nullptr);
+    if (step(stmt)) {
+        m_copyApi[apiId] = true;
+        ++copies;
+    }
+}
+
+// g holds start, end, pid, tid as text; the column affinity makes them integers
+bool Importer::insertApi(std::string_view g[4], std::string_view name, std::string_view args)
+{
+    const sqlite3_int64 nameId = intern(name);
+    const sqlite3_int64 argsId = intern(args);
+    sqlite3_stmt *stmt = m_api->get();
+    sqlite3_bind_int64(stmt, 1, m_apiId);
+    bindText(stmt, 2, g[2]);
+    bindText(stmt, 3, g[3]);
+    bindText(stmt, 4, g[0]);
+    bindText(stmt, 5, g[1]);
+    sqlite3_bind_int64(stmt, 6, nameId);
+    sqlite3_bind_int64(stmt, 7, argsId);
+    if (!step(stmt))
+        return false;
+    ref(nameId);
+    ref(argsId);
+    m_kernelName.push_back(0);
+    m_copyApi.push_back(false);
+    m_hasOps.push_back(false);
+    ++m_apiId;
+    ++apis;
+    return true;
+}
+
+// Reads one line at a time into a reusable buffer, without the newline
+class LineReader
+{
+public:
+    LineReader(FILE *f) : m_f(f) {}
+    ~LineReader() { free(m_buf); }
+    bool next(std::string_view &line)
+    {
+        ssize_t n = getline(&m_buf, &m_cap, m_f);
+        if (n < 0)
+            return false;
+        if (n > 0 && m_buf[n - 1] == '\n')
+            --n;
+        line = std::string_view(m_buf, size_t(n));
+        return true;
+    }
+
+private:
+    FILE *m_f;
+    char *m_buf {nullptr};
+    size_t m_cap {0};
+};
+
+bool Importer::importApis(FILE *f)
+{
+    LineReader reader(f);
+    std::string_view line;
+    std::string kernstring;
+    while (m_ok && reader.next(line)) {
+        Cursor c(line);
+        std::string_view g[4], name;
+        if (!timesAndIds(c, g) || !c.word(name) || !c.lit('('))
+            continue;
+        std::string_view r = c.rest();
+        std::string_view args;
+        bool matched = false;
+
+        // (.*)\)( kernel=.*)\s+:(\d*)$
+        size_t colon = r.size();
+        while (colon > 0 && isDigit(r[colon - 1]))
+            --colon;
+        if (colon >= 2 && r[colon - 1] == ':' && isSpace(r[colon - 2])) {
+            size_t k = r.substr(0, colon - 2).rfind(") kernel=");
+            if (k != std::string_view::npos) {
+                kernstring.assign(r.data(), k);
+                kernstring += ", ";
+                kernstring.append(r.data() + k + 1, colon - 2 - (k + 1));
+                args = kernstring;
+                matched = true;
+            }
+        }
+        // (.*)\)\s+:.*$
+        for (size_t p = r.size(); !matched && p-- > 0;) {
+            if (r[p] != ')')
+                continue;
+            size_t q = p + 1;
+            while (q < r.size() && isSpace(r[q]))
+                ++q;
+            if (q > p + 1 && q < r.size() && r[q] == ':') {
+                args = r.substr(0, p);
+                matched = true;
+            }
+        }
+        if (!matched)
+            continue;
+
+        const sqlite3_int64 apiId = m_apiId;
+        if (name == clearedArgs)
+            args = std::string_view();
+        if (!insertApi(g, name, args))
+            break;
+        if (m_kernelApis.count(name))
+            kernelInfo(apiId, args);
+        else if (m_copyApis.count(name))
+            copyInfo(apiId, args);
+    }
+    return m_ok;
+}
+
+bool Importer::importRoctx(FILE *f)
+{
+    LineReader reader(f);
+    std::string_view line;
+    // Open ranges share one stack across threads, as in the python importer
+    std::vector<std::pair<std::string, std::string>> stack;
+    while (m_ok && reader.next(line)) {
+        // ^(\d*)\s+(\d*):(\d*)\s+(\d+):\d+:\"(.*)\".*$
+        Cursor c(line);
+        std::string_view g[4], type, skip;
+        if (!(c.digits(g[0]) && c.space() && c.digits(g[2]) && c.lit(':') && c.digits(g[3]) && c.space()
+              && c.digits(type, true) && c.lit(':') && c.digits(skip, true) && c.lit(':') && c.lit('"')))
+            continue;
+        std::string_view r = c.rest();
+        size_t quote = r.rfind('"');
+        if (quote == std::string_view::npos)
+            continue;
+        std::string_view message = r.substr(0, quote);
+
+        const long entryType = strtol(std::string(type).c_str(), nullptr, 10);
+        if (entryType == 0) {
+            g[1] = g[0];
+            insertApi(g, "UserMarker", message);
+        }
+        else if (entryType == 1)
+            stack.emplace_back(std::string(g[0]), std::string(message));
+        else if (entryType == 2 && !stack.empty()) {
+            auto entry = std::move(stack.back());
+            stack.pop_back();
+            g[1] = g[0];
+            g[0] = entry.first;
+            insertApi(g, "UserMarker", entry.second);
+        }
+    }
+    return m_ok;
+}
+
+bool Importer::importOps(FILE *f)
+{
+    LineReader reader(f);
+    std::string_view line;
+    sqlite3_stmt *stmt = m_op->get();
+    while (m_ok && reader.next(line)) {
+        // ^(\d*):(\d*)\s+(\d*):(\d*)\s+(\w+):(\d*):(\d*).*$
+        Cursor c(line);
+        std::string_view g[4], name, correlation, skip;
+        if (!(timesAndIds(c, g) && c.word(name) && c.lit(':') && c.digits(correlation) && c.lit(':') && c.digits(skip)))
+            continue;
+
+        sqlite3_int64 apiId = 0;
+        if (!correlation.empty())
+            apiId = strtoll(std::string(correlation).c_str(), nullptr, 10);
+        const bool known = apiId > 0 && apiId < sqlite3_int64(m_kernelName.size());
+        // The kernel name doubles as the op description
+        const sqlite3_int64 desc = known && m_kernelName[apiId] ? m_kernelName[apiId] : m_empty;
+        const sqlite3_int64 opType = intern(name);
+
+        sqlite3_bind_int64(stmt, 1, m_opId);
+        bindText(stmt, 2, g[2]);
+        bindText(stmt, 3, g[3]);
+        bindText(stmt, 4, g[0]);
+        bindText(stmt, 5, g[1]);
+        sqlite3_bind_int64(stmt, 6, desc);
+        sqlite3_bind_int64(stmt, 7, opType);
+        if (!step(stmt))
+            break;
+        ref(desc);
+        ref(opType);
+
+        if (!correlation.empty()) {
+            sqlite3_bind_int64(m_apiOps->get(), 1, apiId);
+            sqlite3_bind_int64(m_apiOps->get(), 2, m_opId);
+            if (!step(m_apiOps->get()))
+                break;
+            if (known)
+                m_hasOps[apiId] = true;
+        }
+        ++m_opId;
+        ++ops;
+    }
+    return m_ok;
+}
+
+bool Importer::finish()
+{
+    // Subclass rows are only kept for apis that launched something
+    Statement delKernel(m_db, "delete from rocpd_kernelapi where api_ptr_id = ?");
+    Statement delCopy(m_db, "delete from rocpd_copyapi where api_ptr_id = ?");
+    for (size_t id = 1; m_ok && id < m_hasOps.size(); ++id) {
+        if (m_hasOps[id])
+            continue;
+        if (m_kernelName[id]) {
+            sqlite3_bind_int64(delKernel.get(), 1, sqlite3_int64(id));
+            step(delKernel.get());
+            --m_refs[m_kernelName[id]];
+            --kernels;
+        }
+        if (m_copyApi[id]) {
+            sqlite3_bind_int64(delCopy.get(), 1, sqlite3_int64(id));
+            step(delCopy.get());
+            --copies;
+        }
+    }
+
+    Statement ins(m_db, "insert into rocpd_string(id, string) values (?,?)");
+    for (size_t id = 1; m_ok && id < m_strings.size(); ++id) {
+        if (m_refs[id] == 0)
+            continue;
+        sqlite3_bind_int64(ins.get(), 1, sqlite3_int64(id));
+        sqlite3_bind_text(ins.get(), 2, m_strings[id]->data(), int(m_strings[id]->size()), SQLITE_STATIC);
+        step(ins.get());
+    }
+    return m_ok;
+}
+
+FILE *openInput(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+        perror(path.c_str());
+    return f;
+}
+
+bool fileExists(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (f)
+        fclose(f);
+    return f != nullptr;
+}
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+    std::string opsFile, apiFile, roctxFile, inputDir, output;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ops_input_file" && i + 1 < argc)
+            opsFile = argv[++i];
+        else if (arg == "--api_input_file" && i + 1 < argc)
+            apiFile = argv[++i];
+        else if (arg == "--roctx_input_file" && i + 1 < argc)
+            roctxFile = argv[++i];
+        else if (arg == "--input_dir" && i + 1 < argc)
+            inputDir = argv[++i];
+        else if (arg.size() > 1 && arg[0] == '-') {
+            usage(argv[0]);
+            return 2;
+        }
+        else if (output.empty())
+            output = arg;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (output.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!inputDir.empty()) {
+        auto pick = [&](std::string &file, const char *name) {
+            std::string p = inputDir + "/" + name;
+            if (file.empty() && fileExists(p))
+                file = p;
+        };
+        pick(opsFile, "hcc_ops_trace.txt");
+        pick(apiFile, "hip_api_trace.txt");
+        pick(roctxFile, "roctx_trace.txt");
+    }
+
+    sqlite3 *db = openDbForWrite(output);
+    if (db == nullptr)
+        return 1;
+    {
+        Statement s(db, "select (select count(*) from rocpd_api) + (select count(*) from rocpd_op) + (select count(*) from rocpd_string)");
+        if (!s.ok() || !s.step() || s.i64(0) != 0) {
+            fprintf(stderr, "%s: expected an empty rpd, create one with: python3 -m rocpd.schema --create %s\n", output.c_str(), output.c_str());
+            sqlite3_close(db);
+            return 1;
+        }
+    }
+
+    // Indexes are rebuilt once after the load rather than maintained per row
+    std::vector<std::pair<std::string, std::string>> indexes;
+    {
+        std::string tables;
+        for (auto t : loadedTables)
+            tables += std::string(tables.empty() ? "" : ",") + "'" + t + "'";
+        Statement s(db, "select name, sql from sqlite_master where type = 'index' and sql is not null and tbl_name in (" + tables + ")");
+        while (s.step())
+            indexes.emplace_back(s.text(0), s.text(1));
+    }
+
+    exec(db, "pragma journal_mode = off");
+    exec(db, "pragma synchronous = off");
+    bool ok = exec(db, "begin");
+    for (auto &index : indexes)
+        ok = ok && exec(db, "drop index \"" + index.first + "\"");
+
+    Importer imp(db);
+    ok = ok && imp.prepare();
+    // Apis first so ops can take their kernel names as they are inserted.
+    // Ids come out as the python importer numbers them.
+    auto run = [&](const std::string &path, const char *what, bool (Importer::*fn)(FILE *)) {
+        if (!ok || path.empty())
+            return;
+        fprintf(stderr, "Importing %s from %s\n", what, path.c_str());
+        FILE *f = openInput(path);
+        ok = f != nullptr && (imp.*fn)(f);
+        if (f)
+            fclose(f);
+    };
+    run(apiFile, "hip api calls", &Importer::importApis);
+    run(roctxFile, "markers", &Importer::importRoctx);
+    run(opsFile, "hcc ops", &Importer::importOps);
+    ok = ok && imp.finish();
+
+    for (auto &index : indexes)
+        ok = ok && exec(db, index.second);
+    ok = ok && exec(db, "commit");
+    if (!ok)
+        exec(db, "rollback");
+    sqlite3_close(db);
+    if (!ok)
+        return 1;
+
+    fprintf(stderr, "%zu apis, %zu ops, %zu kernel launches, %zu copies\n", imp.apis, imp.ops, imp.kernels, imp.copies);
+    return 0;
+}
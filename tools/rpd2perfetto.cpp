@@ -0,0 +1,564 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+
+//
+// Write sqlite trace data as a Perfetto protobuf trace
+//
+// Same timeline as rpd2tracing (gpu queues, hip/hsa threads, api->op flows,
+// QueueDepth/Idle and rocpd_monitor counters, UserMarker frames) encoded as
+// perfetto TracePackets.  Event names are interned per packet sequence, so
+// every section writes its own sequence and the chunks concatenate into a
+// valid trace.
+//
+
+#include "RpdTrace.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace rpdtrace;
+
+
+namespace {
+
+// Protobuf wire encoding, just what TracePacket needs
+void putVarint(std::string &out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out += char((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+void putTag(std::string &out, int field, int wireType)
+{
+    putVarint(out, (uint64_t(field) << 3) | wireType);
+}
+
+void putInt(std::string &out, int field, uint64_t v)
+{
+    putTag(out, field, 0);
+    putVarint(out, v);
+}
+
+void putFixed64(std::string &out, int field, uint64_t v)
+{
+    putTag(out, field, 1);
+    for (int i = 0; i < 8; ++i)
+        out += char((v >> (8 * i)) & 0xff);
+}
+
+void putDouble(std::string &out, int field, double d)
+{
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    putFixed64(out, field, v);
+}
+
+void putBytes(std::string &out, int field, const char *p, size_t n)
+{
+    putTag(out, field, 2);
+    putVarint(out, n);
+    out.append(p, n);
+}
+
+void putBytes(std::string &out, int field, const std::string &s)
+{
+    putBytes(out, field, s.data(), s.size());
+}
+
+// Field numbers from perfetto's trace proto definitions
+enum {
+    kTracePacket = 1,
+
+    kPacketTimestamp = 8,
+    kPacketSequenceId = 10,
+    kPacketTrackEvent = 11,
+    kPacketInternedData = 12,
+    kPacketSequenceFlags = 13,
+    kPacketTrackDescriptor = 60,
+
+    kSeqIncrementalStateCleared = 1,
+    kSeqNeedsIncrementalState = 2,
+
+    kTrackUuid = 1,
+    kTrackName = 2,
+    kTrackProcess = 3,
+    kTrackThread = 4,
+    kTrackParentUuid = 5,
+    kTrackCounter = 8,
+
+    kProcessPid = 1,
+    kThreadPid = 1,
+    kThreadTid = 2,
+    kThreadName = 5,
+
+    kEventCategoryIids = 3,
+    kEventDebugAnnotations = 4,
+    kEventType = 9,
+    kEventNameIid = 10,
+    kEventTrackUuid = 11,
+    kEventCounterValue = 30,
+    kEventDoubleCounterValue = 44,
+    kEventFlowIds = 47,
+    kEventTerminatingFlowIds = 48,
+
+    kTypeSliceBegin = 1,
+    kTypeSliceEnd = 2,
+    kTypeInstant = 3,
+    kTypeCounter = 4,
+
+    kAnnotationNameIid = 1,
+    kAnnotationIntValue = 4,
+    kAnnotationStringValue = 6,
+
+    kInternedCategories = 1,
+    kInternedEventNames = 2,
+    kInternedAnnotationNames = 3,
+    kInternedIid = 1,
+    kInternedName = 2,
+};
+
+// Track uuids: kind in the top byte, then two ids (gpu/queue, pid/tid, ...)
+enum TrackKind { kGpu = 1, kQueue, kGraph, kFrame, kDepth, kIdle, kMonitor, kThread, kProcess, kHsa, kLane };
+
+uint64_t trackUuid(TrackKind kind, uint64_t a, uint64_t b)
+{
+    return (uint64_t(kind) << 56) | ((a & 0xffffff) << 32) | (b & 0xffffffff);
+}
+
+// One packet sequence: owns the interning state for a section's chunk
+class Sequence
+{
+public:
+    Sequence(Chunk &out, uint32_t id) : m_out(out), m_id(id) {}
+
+    uint64_t name(const std::string &s) { return intern(m_names, kInternedEventNames, s); }
+    uint64_t category(const std::string &s) { return intern(m_categories, kInternedCategories, s); }
+    uint64_t annotation(const std::string &s) { return intern(m_annotations, kInternedAnnotationNames, s); }
+
+    // TrackEvent under construction; fields are appended by the caller
+    std::string &event(int type, uint64_t track) {
+        m_event.clear();
+        putInt(m_event, kEventType, type);
+        putInt(m_event, kEventTrackUuid, track);
+        return m_event;
+    }
+    void emit(uint64_t ts) {
+        m_packet.clear();
+        putInt(m_packet, kPacketTimestamp, ts);
+        putInt(m_packet, kPacketSequenceId, m_id);
+        putBytes(m_packet, kPacketTrackEvent, m_event);
+        if (!m_interned.empty()) {
+            putBytes(m_packet, kPacketInternedData, m_interned);
+            m_interned.clear();
+        }
+        putInt(m_packet, kPacketSequenceFlags, m_started ? kSeqNeedsIncrementalState : kSeqIncrementalStateCleared | kSeqNeedsIncrementalState);
+        m_started = true;
+        write();
+    }
+
+    // Track descriptors are written once per sequence that uses the track
+    void track(uint64_t uuid, uint64_t parent, const std::string &name, bool counter) {
+        if (!m_tracks.insert(uuid).second)
+            return;
+        std::string td;
+        putInt(td, kTrackUuid, uuid);
+        if (parent)
+            putInt(td, kTrackParentUuid, parent);
+        putBytes(td, kTrackName, name);
+        if (counter)
+            putBytes(td, kTrackCounter, "", 0);
+        descriptor(td);
+    }
+    void gpuTrack(sqlite3_int64 gpuId) {
+        track(trackUuid(kGpu, gpuId, 0), 0, "GPU" + std::to_string(gpuId), false);
+    }
+    void processTrack(sqlite3_int64 pid) {
+        const uint64_t uuid = trackUuid(kProcess, pid, 0);
+        if (!m_tracks.insert(uuid).second)
+            return;
+        std::string td, process;
+        putInt(td, kTrackUuid, uuid);
+        putInt(process, kProcessPid, pid);
+        putBytes(td, kTrackProcess, process);
+        descriptor(td);
+    }
+    void threadTrack(sqlite3_int64 pid, sqlite3_int64 tid) {
+        const uint64_t uuid = trackUuid(kThread, pid, tid);
+        if (!m_tracks.insert(uuid).second)
+            return;
+        std::string td, thread;
+        putInt(td, kTrackUuid, uuid);
+        putInt(thread, kThreadPid, pid);
+        putInt(thread, kThreadTid, tid);
+        putBytes(thread, kThreadName, "Hip " + std::to_string(tid));
+        putBytes(td, kTrackThread, thread);
+        descriptor(td);
+    }
+
+private:
+    uint64_t intern(std::unordered_map<std::string, uint64_t> &table, int field, const std::string &s) {
+        auto it = table.find(s);
+        if (it != table.end())
+            return it->second;
+        const uint64_t iid = table.size() + 1;
+        table.emplace(s, iid);
+        std::string entry;
+        putInt(entry, kInternedIid, iid);
+        putBytes(entry, kInternedName, s);
+        putBytes(m_interned, field, entry);
+        return iid;
+    }
+    void descriptor(const std::string &td) {
+        m_packet.clear();
+        putInt(m_packet, kPacketSequenceId, m_id);
+        putBytes(m_packet, kPacketTrackDescriptor, td);
+        write();
+    }
+    void write() {
+        putBytes(m_out.buffer(), kTracePacket, m_packet);
+        m_out.endEvent(false);
+    }
+
+    Chunk &m_out;
+    uint32_t m_id;
+    bool m_started {false};
+    std::string m_event;
+    std::string m_packet;
+    std::string m_interned;
+    std::unordered_map<std::string, uint64_t> m_names;
+    std::unordered_map<std::string, uint64_t> m_categories;
+    std::unordered_map<std::string, uint64_t> m_annotations;
+    std::unordered_set<uint64_t> m_tracks;
+};
+
+void putAnnotation(std::string &event, uint64_t nameIid, const std::string &value)
+{
+    std::string a;
+    putInt(a, kAnnotationNameIid, nameIid);
+    putBytes(a, kAnnotationStringValue, value);
+    putBytes(event, kEventDebugAnnotations, a);
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-h] [--start START] [--end END] [--threads N] input_rpd [output_pftrace]\n\n"
+        "convert RPD to a perfetto protobuf trace\n\n"
+        "  --start START    start time - default us or percentage %%. Number only is interpreted as us. Number with %% is interpreted as percentage\n"
+        "  --end END        end time - default us or percentage %%. See help for --start\n"
+        "  --threads N      sections converted concurrently (default: number of cpus)\n", prog);
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    if (!parseArgs(argc, argv, opts, ".pftrace", false)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    sqlite3 *db = openDb(opts.input);
+    if (db == nullptr)
+        return 1;
+
+    TimeRange range;
+    if (!range.load(db, opts))
+        return 1;
+
+    // Counters should extend to the last event in the trace
+    const sqlite3_int64 tEnd = range.hasEnd ? sqlite3_int64(std::llround(range.end.value() * 1000)) : range.lastEnd;
+
+    std::vector<sqlite3_int64> gpuIds;
+    {
+        Statement s(db, "select distinct gpuId from rocpd_op");
+        while (s.ok() && s.step())
+            gpuIds.push_back(s.i64(0));
+    }
+
+    StringMap strings;
+    strings.load(db);
+    const std::string userMarkerIds = strings.idsOf("UserMarker");
+    sqlite3_close(db);
+
+    std::vector<Section> sections;
+    auto add = [&](const char *name, std::function<bool(sqlite3 *, Sequence &)> run, bool optional, const char *missing) {
+        const uint32_t id = sections.size() + 1;
+        sections.push_back({name, [run, id](sqlite3 *conn, Chunk &out) {
+            Sequence seq(out, id);
+            return run(conn, seq);
+        }, optional, missing});
+    };
+
+    add("ops", [&](sqlite3 *conn, Sequence &seq) {
+        Statement s(conn, "select opType_id, description_id, gpuId, queueId, rocpd_op.start, rocpd_op.end, rocpd_api_ops.id from rocpd_op LEFT JOIN rocpd_api_ops on rocpd_api_ops.op_id = rocpd_op.id " + range.op + " order by rocpd_op.start");
+        if (!s.ok())
+            return false;
+        const uint64_t desc = seq.annotation("desc");
+        // A slice end closes the newest open slice on its track, so ops that overlap on a
+        //   queue go to child lanes: each op takes the lowest lane free by its start
+        std::map<std::pair<sqlite3_int64, sqlite3_int64>, std::vector<sqlite3_int64>> laneEnds;
+        while (s.step()) {
+            const std::string *opType = strings.get(s.i64(0));
+            const std::string *description = strings.get(s.i64(1));
+            if (opType == nullptr || description == nullptr)
+                continue;
+            const sqlite3_int64 gpuId = s.i64(2);
+            const sqlite3_int64 queueId = s.i64(3);
+            const uint64_t queueTrack = trackUuid(kQueue, gpuId, queueId);
+            seq.gpuTrack(gpuId);
+            seq.track(queueTrack, trackUuid(kGpu, gpuId, 0), "Queue " + std::to_string(queueId), false);
+
+            std::vector<sqlite3_int64> &ends = laneEnds[{gpuId, queueId}];
+            size_t lane = 0;
+            while (lane < ends.size() && ends[lane] > s.i64(4))
+                ++lane;
+            if (lane == ends.size())
+                ends.push_back(0);
+            ends[lane] = s.i64(5);
+            uint64_t track = queueTrack;
+            if (lane > 0) {
+                track = trackUuid(kLane, gpuId, (uint64_t(queueId) << 16) | lane);
+                seq.track(track, queueTrack, "Queue " + std::to_string(queueId) + " overlap " + std::to_string(lane), false);
+            }
+            std::string &ev = seq.event(kTypeSliceBegin, track);
+            putInt(ev, kEventNameIid, seq.name(description->empty() ? *opType : *description));
+            putInt(ev, kEventCategoryIids, seq.category(*opType));
+            if (!description->empty())
+                putAnnotation(ev, desc, *opType);
+            if (!s.isNull(6))
+                putFixed64(ev, kEventTerminatingFlowIds, s.i64(6));
+            seq.emit(s.i64(4));
+            seq.event(kTypeSliceEnd, track);
+            seq.emit(s.i64(5));
+        }
+        return true;
+    }, false, nullptr);
+
+    add("graphs", [&](sqlite3 *conn, Sequence &seq) {
+        Statement s(conn, "select graphExec, gpuId, queueId, min(start), max(end), count(*) from rocpd_graphLaunchapi A join rocpd_api_ops B on B.api_id = A.api_ptr_id join rocpd_op C on C.id = B.op_id " + range.monitor + " group by api_ptr_id");
+        if (!s.ok())
+            return false;
+        const uint64_t kernels = seq.annotation("kernels");
+        while (s.step()) {
+            const sqlite3_int64 gpuId = s.i64(1);
+            const uint64_t track = trackUuid(kGraph, gpuId, s.i64(2));
+            seq.gpuTrack(gpuId);
+            seq.track(track, trackUuid(kGpu, gpuId, 0), "Graphs " + std::to_string(s.i64(2)), false);
+            std::string name = "Graph ";
+            s.append(name, 0);
+            std::string &ev = seq.event(kTypeSliceBegin, track);
+            putInt(ev, kEventNameIid, seq.name(name));
+            std::string a;
+            putInt(a, kAnnotationNameIid, kernels);
+            putInt(a, kAnnotationIntValue, s.i64(5));
+            putBytes(ev, kEventDebugAnnotations, a);
+            seq.emit(s.i64(3));
+            seq.event(kTypeSliceEnd, track);
+            seq.emit(s.i64(4));
+        }
+        return true;
+    }, true, nullptr);
+
+    add("apis", [&](sqlite3 *conn, Sequence &seq) {
+        Statement s(conn, "select apiName_id, args_id, pid, tid, rocpd_api.start, rocpd_api.end, rocpd_api.id from rocpd_api " + range.api + " order by rocpd_api.id");
+        // Flow starts, walked alongside the apis in id order
+        Statement flows(conn, "select api_id, id from rocpd_api_ops order by api_id, id");
+        if (!s.ok() || !flows.ok())
+            return false;
+        bool haveFlow = flows.step();
+        const uint64_t desc = seq.annotation("desc");
+        const uint64_t hip = seq.category("hip");
+        const uint64_t marker = seq.category("UserMarker");
+        std::string args;
+        while (s.step()) {
+            const sqlite3_int64 apiId = s.i64(6);
+            const std::string *apiName = strings.get(s.i64(0));
+            const std::string *argString = strings.get(s.i64(1));
+            if (apiName == nullptr || argString == nullptr)
+                continue;
+            const bool isMarker = (*apiName == "UserMarker");
+            const sqlite3_int64 pid = s.i64(2);
+            const sqlite3_int64 tid = s.i64(3);
+            const uint64_t track = trackUuid(kThread, pid, tid);
+            seq.threadTrack(pid, tid);
+            const bool instant = isMarker && s.i64(4) == s.i64(5);
+            std::string &ev = seq.event(instant ? kTypeInstant : kTypeSliceBegin, track);
+            args.clear();
+            appendStripped(args, *argString, "\"");
+            putInt(ev, kEventNameIid, seq.name(isMarker ? args : *apiName));
+            putInt(ev, kEventCategoryIids, isMarker ? marker : hip);
+            // Marker args are already the slice name
+            if (!isMarker && !args.empty())
+                putAnnotation(ev, desc, args);
+            while (haveFlow && flows.i64(0) < apiId)
+                haveFlow = flows.step();
+            while (haveFlow && flows.i64(0) == apiId) {
+                putFixed64(ev, kEventFlowIds, flows.i64(1));
+                haveFlow = flows.step();
+            }
+            seq.emit(s.i64(4));
+            if (!instant) {
+                seq.event(kTypeSliceEnd, track);
+                seq.emit(s.i64(5));
+            }
+        }
+        return true;
+    }, false, nullptr);
+
+    add("hsa apis", [&](sqlite3 *conn, Sequence &seq) {
+        Statement s(conn, "select apiName_id, args_id, pid, tid, rocpd_hsaApi.start, rocpd_hsaApi.end from rocpd_hsaApi " + range.api + " order by rocpd_hsaApi.id");
+        if (!s.ok())
+            return false;
+        const uint64_t desc = seq.annotation("desc");
+        const uint64_t hsa = seq.category("hsa");
+        std::string args;
+        while (s.step()) {
+            const std::string *apiName = strings.get(s.i64(0));
+            const std::string *argString = strings.get(s.i64(1));
+            if (apiName == nullptr || argString == nullptr)
+                continue;
+            const sqlite3_int64 pid = s.i64(2);
+            const sqlite3_int64 tid = s.i64(3);
+            const uint64_t track = trackUuid(kHsa, pid, tid);
+            seq.processTrack(pid);
+            seq.track(track, trackUuid(kProcess, pid, 0), "HSA " + std::to_string(tid), false);
+            std::string &ev = seq.event(kTypeSliceBegin, track);
+            putInt(ev, kEventNameIid, seq.name(*apiName));
+            putInt(ev, kEventCategoryIids, hsa);
+            args.clear();
+            appendStripped(args, *argString, "\"");
+            if (!args.empty())
+                putAnnotation(ev, desc, args);
+            seq.emit(s.i64(4));
+            seq.event(kTypeSliceEnd, track);
+            seq.emit(s.i64(5));
+        }
+        return true;
+    }, true, nullptr);
+
+    // Queue depth and idle counters, one section per gpu
+    for (auto gpuId : gpuIds) {
+        add("queue depth", [&, gpuId](sqlite3 *conn, Sequence &seq) {
+            const std::string gpu = std::to_string(gpuId);
+            Statement s(conn, "select * from (select rocpd_api.start as ts, 1 from rocpd_api_ops INNER JOIN rocpd_api on rocpd_api_ops.api_id = rocpd_api.id INNER JOIN rocpd_op on rocpd_api_ops.op_id = rocpd_op.id AND rocpd_op.gpuId = " + gpu + " " + range.op + " UNION ALL select rocpd_op.end, -1 from rocpd_api_ops INNER JOIN rocpd_api on rocpd_api_ops.api_id = rocpd_api.id INNER JOIN rocpd_op on rocpd_api_ops.op_id = rocpd_op.id AND rocpd_op.gpuId = " + gpu + " " + range.op + ") order by ts");
+            if (!s.ok())
+                return false;
+            const uint64_t depthTrack = trackUuid(kDepth, gpuId, 0);
+            const uint64_t idleTrack = trackUuid(kIdle, gpuId, 0);
+            seq.gpuTrack(gpuId);
+            seq.track(depthTrack, trackUuid(kGpu, gpuId, 0), "QueueDepth", true);
+            seq.track(idleTrack, trackUuid(kGpu, gpuId, 0), "Idle", true);
+            auto counter = [&](uint64_t track, sqlite3_int64 ts, sqlite3_int64 value) {
+                putInt(seq.event(kTypeCounter, track), kEventCounterValue, value);
+                seq.emit(ts);
+            };
+            sqlite3_int64 depth = 0;
+            sqlite3_int64 idle = 1;
+            while (s.step()) {
+                const sqlite3_int64 ts = s.i64(0);
+                const sqlite3_int64 delta = s.i64(1);
+                if (idle && delta > 0) {
+                    idle = 0;
+                    counter(idleTrack, ts, idle);
+                }
+                if (depth == 1 && delta < 0) {
+                    idle = 1;
+                    counter(idleTrack, ts, idle);
+                }
+                depth += delta;
+                counter(depthTrack, ts, depth);
+            }
+            if (tEnd > 0) {
+                counter(idleTrack, tEnd, idle);
+                counter(depthTrack, tEnd, depth);
+            }
+            return true;
+        }, false, nullptr);
+    }
+
+    add("smi counters", [&](sqlite3 *conn, Sequence &seq) {
+        auto emit = [&](Statement &s) {
+            while (s.step()) {
+                const sqlite3_int64 deviceId = s.i64(0);
+                const std::string type = s.text(1);
+                const uint64_t track = trackUuid(kMonitor, deviceId, std::hash<std::string>()(type));
+                seq.gpuTrack(deviceId);
+                seq.track(track, trackUuid(kGpu, deviceId, 0), type, true);
+                std::string &ev = seq.event(kTypeCounter, track);
+                if (s.isText(3))
+                    putDouble(ev, kEventDoubleCounterValue, strtod(s.text(3).c_str(), nullptr));
+                else
+                    putDouble(ev, kEventDoubleCounterValue, s.dbl(3));
+                seq.emit(s.i64(2));
+            }
+        };
+        Statement s(conn, "select deviceId, monitorType, start, value from rocpd_monitor " + range.monitor);
+        if (!s.ok())
+            return false;
+        emit(s);
+        // Output the endpoints of the last range
+        Statement last(conn, "select distinct deviceId, monitorType, max(end), value from rocpd_monitor " + range.monitor + " group by deviceId, monitorType");
+        if (!last.ok())
+            return false;
+        emit(last);
+        return true;
+    }, true, "Did not find SMI data");
+
+    if (!userMarkerIds.empty()) {
+        add("marker frames", [&](sqlite3 *conn, Sequence &seq) {
+            const uint64_t desc = seq.annotation("desc");
+            const uint64_t marker = seq.category("UserMarker");
+            return markerFrames(conn, strings, userMarkerIds, range.api, [&](const GpuFrame &gpuFrame) {
+                const std::string name = [&]() { std::string n; appendStripped(n, gpuFrame.name, "\""); return n; }();
+                const std::string ops = "UserMarker frame: " + std::to_string(gpuFrame.totalOps) + " ops";
+                for (auto &g : gpuFrame.gpus) {
+                    const uint64_t track = trackUuid(kFrame, g.first, g.second);
+                    seq.gpuTrack(g.first);
+                    seq.track(track, trackUuid(kGpu, g.first, 0), "UserMarker frames " + std::to_string(g.second), false);
+                    std::string &ev = seq.event(kTypeSliceBegin, track);
+                    putInt(ev, kEventNameIid, seq.name(name));
+                    putInt(ev, kEventCategoryIids, marker);
+                    putAnnotation(ev, desc, ops);
+                    seq.emit(std::llround(gpuFrame.start * 1000));
+                    seq.event(kTypeSliceEnd, track);
+                    seq.emit(std::llround(gpuFrame.end * 1000));
+                }
+            });
+        }, false, nullptr);
+    }
+
+    return runSections(opts, sections, "", "") ? 0 : 1;
+}
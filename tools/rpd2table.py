@@ -31,6 +31,10 @@ import sqlite3
 from datetime import datetime
 import pandas as pd
 import argparse
+try:
+    from rocpd.compress import connect
+except ImportError:
+    from sqlite3 import connect
 
 parser = argparse.ArgumentParser(description='convert an RPD file to a summary table in CSV')
 parser.add_argument('input_rpd', type=str, help="Input RPD file")
@@ -39,7 +43,7 @@ parser.add_argument('output_csv', type=str, help="Output Summary Table to CSV")
 args = parser.parse_args()
 
 def process_rpd_to_df(rpd_path, markers_list):
-    connection = sqlite3.connect(rpd_path)
+    connection = connect(rpd_path)
 
     # Keep it here for now for future extension
     rangeStringApi = ""
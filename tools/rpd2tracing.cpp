@@ -0,0 +1,387 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+
+//
+// Format sqlite trace data as json for chrome:tracing
+//
+// Native counterpart of rpd2tracing.py.  Produces the same events in the same
+// order, but each section is streamed on its own connection into a temporary
+// chunk and the chunks are concatenated once every section has finished.
+//
+
+#include "RpdTrace.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace rpdtrace;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-h] [--start START] [--end END] [--format FORMAT] [--threads N] input_rpd [output_json]\n\n"
+        "convert RPD to json for chrome tracing\n\n"
+        "  --start START    start time - default us or percentage %%. Number only is interpreted as us. Number with %% is interpreted as percentage\n"
+        "  --end END        end time - default us or percentage %%. See help for --start\n"
+        "  --format FORMAT  chome trace format, array or object\n"
+        "  --threads N      sections converted concurrently (default: number of cpus)\n", prog);
+}
+
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    if (!parseArgs(argc, argv, opts, ".json", true)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    sqlite3 *db = openDb(opts.input);
+    if (db == nullptr)
+        return 1;
+
+    TimeRange range;
+    if (!range.load(db, opts))
+        return 1;
+
+    // Counters should extend to the last event in the trace
+    PyNum tEnd = range.hasEnd ? range.end : PyNum::fromInt(range.lastEnd / 1000);
+
+    std::vector<sqlite3_int64> gpuIds;
+    {
+        Statement s(db, "select distinct gpuId from rocpd_op");
+        while (s.ok() && s.step())
+            gpuIds.push_back(s.i64(0));
+    }
+
+    StringMap strings;
+    strings.load(db);
+    const std::string userMarkerIds = strings.idsOf("UserMarker");
+    sqlite3_close(db);
+
+    std::vector<Section> sections;
+
+    sections.push_back({"gpu names", [&](sqlite3 *, Chunk &out) {
+        std::string &b = out.buffer();
+        for (auto gpuId : gpuIds) {
+            b += ",{\"name\": \"process_name\", \"ph\": \"M\", \"pid\":\"";
+            appendInt(b, gpuId);
+            b += "\",\"args\":{\"name\":\"GPU";
+            appendInt(b, gpuId);
+            b += "\"}}";
+            out.endEvent();
+            b += ",{\"name\": \"process_sort_index\", \"ph\": \"M\", \"pid\":\"";
+            appendInt(b, gpuId);
+            b += "\",\"args\":{\"sort_index\":\"";
+            appendInt(b, gpuId + 1000000);
+            b += "\"}}";
+            out.endEvent();
+        }
+        return true;
+    }, false, nullptr});
+
+    auto threadNames = [](const char *table, const char *label, int sortOffset) {
+        return [=](sqlite3 *conn, Chunk &out) {
+            Statement s(conn, std::string("select distinct pid, tid from ") + table);
+            if (!s.ok())
+                return false;
+            std::string &b = out.buffer();
+            while (s.step()) {
+                b += ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":\"";
+                appendInt(b, s.i64(0));
+                b += "\",\"tid\":\"";
+                appendInt(b, s.i64(1));
+                b += "\",\"args\":{\"name\":\"";
+                b += label;
+                appendInt(b, s.i64(1));
+                b += "\"}}";
+                out.endEvent();
+                b += ",{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":\"";
+                appendInt(b, s.i64(0));
+                b += "\",\"tid\":\"";
+                appendInt(b, s.i64(1));
+                b += "\",\"args\":{\"sort_index\":\"";
+                appendInt(b, s.i64(1) * 2 + sortOffset);
+                b += "\"}}";
+                out.endEvent();
+            }
+            return true;
+        };
+    };
+    sections.push_back({"hip threads", threadNames("rocpd_api", "Hip ", 0), false, nullptr});
+    sections.push_back({"hsa threads", threadNames("rocpd_hsaApi", "HSA ", -1), true, nullptr});
+
+    sections.push_back({"ops", [&](sqlite3 *conn, Chunk &out) {
+        Statement s(conn, "select opType_id, description_id, gpuId, queueId, rocpd_op.start/1000.0, (rocpd_op.end-rocpd_op.start) / 1000.0 from rocpd_op " + range.op);
+        if (!s.ok())
+            return false;
+        std::string &b = out.buffer();
+        while (s.step()) {
+            const std::string *opType = strings.get(s.i64(0));
+            const std::string *desc = strings.get(s.i64(1));
+            if (opType == nullptr || desc == nullptr)
+                continue;
+            b += ",{\"pid\":\"";
+            appendInt(b, s.i64(2));
+            b += "\",\"tid\":\"";
+            appendInt(b, s.i64(3));
+            b += "\",\"name\":\"";
+            b += desc->empty() ? *opType : *desc;
+            b += "\",\"ts\":\"";
+            appendDouble(b, s.dbl(4));
+            b += "\",\"dur\":\"";
+            appendDouble(b, s.dbl(5));
+            b += "\",\"ph\":\"X\",\"args\":{\"desc\":\"";
+            b += *opType;
+            b += "\"}}";
+            out.endEvent();
+        }
+        return true;
+    }, false, nullptr});
+
+    sections.push_back({"graphs", [&](sqlite3 *conn, Chunk &out) {
+        Statement s(conn, "select graphExec, gpuId, queueId, min(start)/1000.0, (max(end)-min(start))/1000.0, count(*) from rocpd_graphLaunchapi A join rocpd_api_ops B on B.api_id = A.api_ptr_id join rocpd_op C on C.id = B.op_id " + range.monitor + " group by api_ptr_id");
+        if (!s.ok())
+            return false;
+        std::string &b = out.buffer();
+        while (s.step()) {
+            b += ",{\"pid\":\"";
+            s.append(b, 1);
+            b += "\",\"tid\":\"";
+            s.append(b, 2);
+            b += "\",\"name\":\"Graph ";
+            s.append(b, 0);
+            b += "\",\"ts\":\"";
+            s.append(b, 3);
+            b += "\",\"dur\":\"";
+            s.append(b, 4);
+            b += "\",\"ph\":\"X\",\"args\":{\"kernels\":\"";
+            s.append(b, 5);
+            b += "\"}}";
+            out.endEvent();
+        }
+        return true;
+    }, true, nullptr});
+
+    sections.push_back({"apis", [&](sqlite3 *conn, Chunk &out) {
+        Statement s(conn, "select apiName_id, args_id, pid, tid, rocpd_api.start/1000.0, (rocpd_api.end-rocpd_api.start) / 1000.0, (rocpd_api.end != rocpd_api.start) as has_duration from rocpd_api " + range.api + " order by rocpd_api.id");
+        if (!s.ok())
+            return false;
+        std::string &b = out.buffer();
+        while (s.step()) {
+            const std::string *apiName = strings.get(s.i64(0));
+            const std::string *args = strings.get(s.i64(1));
+            if (apiName == nullptr || args == nullptr)
+                continue;
+            const bool marker = (*apiName == "UserMarker");
+            b += ",{\"pid\":\"";
+            appendInt(b, s.i64(2));
+            b += "\",\"tid\":\"";
+            appendInt(b, s.i64(3));
+            b += "\",\"name\":\"";
+            if (marker)
+                appendStripped(b, *args, "\"");
+            else
+                b += *apiName;
+            b += "\",\"ts\":\"";
+            appendDouble(b, s.dbl(4));
+            if (marker && s.i64(6) == 0) {
+                // instantanuous "mark" messages
+                b += "\",\"ph\":\"i\",\"s\":\"p\",\"args\":{\"desc\":\"";
+            }
+            else {
+                b += "\",\"dur\":\"";
+                appendDouble(b, s.dbl(5));
+                b += "\",\"ph\":\"X\",\"args\":{\"desc\":\"";
+            }
+            appendStripped(b, *args, marker ? "\"" : "\"\t");
+            b += "\"}}";
+            out.endEvent();
+        }
+        return true;
+    }, false, nullptr});
+
+    sections.push_back({"api->op flows", [&](sqlite3 *conn, Chunk &out) {
+        Statement s(conn, "select rocpd_api_ops.id, pid, tid, gpuId, queueId, rocpd_api.end/1000.0 - 2, rocpd_op.start/1000.0 from rocpd_api_ops INNER JOIN rocpd_api on rocpd_api_ops.api_id = rocpd_api.id INNER JOIN rocpd_op on rocpd_api_ops.op_id = rocpd_op.id " + range.api);
+        if (!s.ok())
+            return false;
+        std::string &b = out.buffer();
+        while (s.step()) {
+            const double from = s.dbl(5) < s.dbl(6) ? s.dbl(5) : s.dbl(6);
+            b += ",{\"pid\":\"";
+            appendInt(b, s.i64(1));
+            b += "\",\"tid\":\"";
+            appendInt(b, s.i64(2));
+            b += "\",\"cat\":\"api_op\",\"name\":\"api_op\",\"ts\":\"";
+            appendDouble(b, from);
+            b += "\",\"id\":\"";
+            appendInt(b, s.i64(0));
+            b += "\",\"ph\":\"s\"}";
+            out.endEvent();
+            b += ",{\"pid\":\"";
+            appendInt(b, s.i64(3));
+            b += "\",\"tid\":\"";
+            appendInt(b, s.i64(4));
+            b += "\",\"cat\":\"api_op\",\"name\":\"api_op\",\"ts\":\"";
+            appendDouble(b, s.dbl(6));
+            b += "\",\"id\":\"";
+            appendInt(b, s.i64(0));
+            b += "\",\"ph\":\"f\", \"bp\":\"e\"}";
+            out.endEvent();
+        }
+        return true;
+    }, false, nullptr});
+
+    sections.push_back({"hsa apis", [&](sqlite3 *conn, Chunk &out) {
+        Statement s(conn, "select apiName_id, args_id, pid, tid, rocpd_hsaApi.start/1000.0, (rocpd_hsaApi.end-rocpd_hsaApi.start) / 1000.0 from rocpd_hsaApi " + range.api + " order by rocpd_hsaApi.id");
+        if (!s.ok())
+            return false;
+        std::string &b = out.buffer();
+        while (s.step()) {
+            const std::string *apiName = strings.get(s.i64(0));
+            const std::string *args = strings.get(s.i64(1));
+            if (apiName == nullptr || args == nullptr)
+                continue;
+            b += ",{\"pid\":\"";
+            appendInt(b, s.i64(2));
+            b += "\",\"tid\":\"";
+            appendInt(b, s.i64(3) + 1);
+            b += "\",\"name\":\"";
+            b += *apiName;
+            b += "\",\"ts\":\"";
+            appendDouble(b, s.dbl(4));
+            b += "\",\"dur\":\"";
+            appendDouble(b, s.dbl(5));
+            b += "\",\"ph\":\"X\",\"args\":{\"desc\":\"";
+            appendStripped(b, *args, "\"");
+            b += "\"}}";
+            out.endEvent();
+        }
+        return true;
+    }, true, nullptr});
+
+    // Queue depth and idle counters, one section per gpu
+    for (auto gpuId : gpuIds) {
+        sections.push_back({"queue depth", [&, gpuId](sqlite3 *conn, Chunk &out) {
+            const std::string gpu = std::to_string(gpuId);
+            Statement s(conn, "select * from (select rocpd_api.start/1000.0 as ts, \"1\" from rocpd_api_ops INNER JOIN rocpd_api on rocpd_api_ops.api_id = rocpd_api.id INNER JOIN rocpd_op on rocpd_api_ops.op_id = rocpd_op.id AND rocpd_op.gpuId = " + gpu + " " + range.op + " UNION ALL select rocpd_op.end/1000.0, \"-1\" from rocpd_api_ops INNER JOIN rocpd_api on rocpd_api_ops.api_id = rocpd_api.id INNER JOIN rocpd_op on rocpd_api_ops.op_id = rocpd_op.id AND rocpd_op.gpuId = " + gpu + " " + range.op + ") order by ts");
+            if (!s.ok())
+                return false;
+            std::string &b = out.buffer();
+            auto counter = [&](const char *name, const char *arg, const std::function<void()> &ts, sqlite3_int64 value) {
+                b += ",{\"pid\":\"";
+                b += gpu;
+                b += "\",\"name\":\"";
+                b += name;
+                b += "\",\"ph\":\"C\",\"ts\":";
+                ts();
+                b += ",\"args\":{\"";
+                b += arg;
+                b += "\":";
+                appendInt(b, value);
+                b += "}}";
+                out.endEvent();
+            };
+            sqlite3_int64 depth = 0;
+            sqlite3_int64 idle = 1;
+            while (s.step()) {
+                const sqlite3_int64 delta = s.i64(1);
+                auto ts = [&]() { s.append(b, 0); };
+                if (idle && delta > 0) {
+                    idle = 0;
+                    counter("Idle", "idle", ts, idle);
+                }
+                if (depth == 1 && delta < 0) {
+                    idle = 1;
+                    counter("Idle", "idle", ts, idle);
+                }
+                depth += delta;
+                counter("QueueDepth", "depth", ts, depth);
+            }
+            if (tEnd.value() > 0) {
+                auto ts = [&]() { tEnd.append(b); };
+                counter("Idle", "idle", ts, idle);
+                counter("QueueDepth", "depth", ts, depth);
+            }
+            return true;
+        }, false, nullptr});
+    }
+
+    sections.push_back({"smi counters", [&](sqlite3 *conn, Chunk &out) {
+        std::string &b = out.buffer();
+        auto emit = [&](Statement &s) {
+            while (s.step()) {
+                b += ",{\"pid\":\"";
+                s.append(b, 0);
+                b += "\",\"name\":\"";
+                s.append(b, 1);
+                b += "\",\"ph\":\"C\",\"ts\":";
+                s.append(b, 2);
+                b += ",\"args\":{\"";
+                s.append(b, 1);
+                b += "\":";
+                s.append(b, 3);
+                b += "}}";
+                out.endEvent();
+            }
+        };
+        Statement s(conn, "select deviceId, monitorType, start/1000.0, value from rocpd_monitor " + range.monitor);
+        if (!s.ok())
+            return false;
+        emit(s);
+        // Output the endpoints of the last range
+        Statement last(conn, "select distinct deviceId, monitorType, max(end)/1000.0, value from rocpd_monitor " + range.monitor + " group by deviceId, monitorType");
+        if (!last.ok())
+            return false;
+        emit(last);
+        return true;
+    }, true, "Did not find SMI data"});
+
+    if (!userMarkerIds.empty()) {
+        sections.push_back({"marker frames", [&](sqlite3 *conn, Chunk &out) {
+            std::string &b = out.buffer();
+            return markerFrames(conn, strings, userMarkerIds, range.api, [&](const GpuFrame &gpuFrame) {
+                for (auto &g : gpuFrame.gpus) {
+                    b += ",{\"pid\":\"";
+                    appendInt(b, g.first);
+                    b += "\",\"tid\":\"";
+                    appendInt(b, g.second);
+                    b += "\",\"name\":\"";
+                    appendStripped(b, gpuFrame.name, "\"");
+                    b += "\",\"ts\":\"";
+                    appendDouble(b, gpuFrame.start - 1);
+                    b += "\",\"dur\":\"";
+                    appendDouble(b, gpuFrame.end - gpuFrame.start + 1);
+                    b += "\",\"ph\":\"X\",\"args\":{\"desc\":\"UserMarker frame: ";
+                    appendInt(b, gpuFrame.totalOps);
+                    b += " ops\"}}";
+                    out.endEvent();
+                }
+            });
+        }, false, nullptr});
+    }
+
+    const bool object = (opts.format == "object");
+    return runSections(opts, sections, object ? "{\"traceEvents\": [ {}\n" : "[ {}\n", object ? "]\n} \n" : "]\n") ? 0 : 1;
+}
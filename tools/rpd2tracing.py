@@ -30,10 +30,15 @@ import sys
 import os
 import csv
 import re
+import math
 import sqlite3
 from collections import defaultdict
 from datetime import datetime
 import argparse
+try:
+    from rocpd.compress import connect
+except ImportError:
+    from sqlite3 import connect
 
 parser = argparse.ArgumentParser(description='convert RPD to json for chrome tracing')
 parser.add_argument('input_rpd', type=str, help="input rpd db")
@@ -47,7 +52,7 @@ if args.output_json is None:
     import pathlib
     args.output_json = pathlib.PurePath(args.input_rpd).with_suffix(".json")
 
-connection = sqlite3.connect(args.input_rpd)
+connection = connect(args.input_rpd)
 
 outfile = open(args.output_json, 'w', encoding="utf-8")
 
@@ -102,18 +107,21 @@ if args.start:
         start_time = ( (max_time - min_time) * ( int( args.start.replace("%","") )/100 ) + min_time )/1000
     else:
         start_time = int(args.start)
-    rangeStringApi = "where rocpd_api.start/1000 >= %s"%(start_time)
-    rangeStringOp = "where rocpd_op.start/1000 >= %s"%(start_time)
-    rangeStringMonitor = "where start/1000 >= %s"%(start_time)
+    # Compare raw ns (same rows as start/1000 >= start_time) so the start indexes from rpd_index.py apply
+    start_ns = math.ceil(start_time) * 1000
+    rangeStringApi = "where rocpd_api.start >= %s"%(start_ns)
+    rangeStringOp = "where rocpd_op.start >= %s"%(start_ns)
+    rangeStringMonitor = "where start >= %s"%(start_ns)
 if args.end:
     if "%" in args.end:
         end_time = ( (max_time - min_time) * ( int( args.end.replace("%","") )/100 ) + min_time )/1000
     else:
         end_time = int(args.end)
 
-    rangeStringApi = rangeStringApi + " and rocpd_api.start/1000 <= %s"%(end_time) if args.start != None else "where rocpd_api.start/1000 <= %s"%(end_time)
-    rangeStringOp = rangeStringOp + " and rocpd_op.start/1000 <= %s"%(end_time) if args.start != None else "where rocpd_op.start/1000 <= %s"%(end_time)
-    rangeStringMonitor = rangeStringMonitor + " and start/1000 <= %s"%(end_time) if args.start != None else "where start/1000 <= %s"%(end_time)
+    end_ns = math.floor(end_time) * 1000 + 999
+    rangeStringApi = rangeStringApi + " and rocpd_api.start <= %s"%(end_ns) if args.start != None else "where rocpd_api.start <= %s"%(end_ns)
+    rangeStringOp = rangeStringOp + " and rocpd_op.start <= %s"%(end_ns) if args.start != None else "where rocpd_op.start <= %s"%(end_ns)
+    rangeStringMonitor = rangeStringMonitor + " and start <= %s"%(end_ns) if args.start != None else "where start <= %s"%(end_ns)
 
 print("\nFilter: %s"%(rangeStringApi))
 print(f"Output duration: {(end_time-start_time)/1000000} seconds")
@@ -28,6 +28,10 @@ import sys
 import os
 import sqlite3
 import argparse
+try:
+    from rocpd.compress import connect
+except ImportError:
+    from sqlite3 import connect
 
 parser = argparse.ArgumentParser(description='Format autograd kernel usage as html')
 parser.add_argument('input_rpd', type=str, help="input rpd db")
@@ -36,7 +40,7 @@ parser.add_argument('--start', type=int, help="start timestamp")
 parser.add_argument('--end', type=int, help="end timestamp")
 args = parser.parse_args()
 
-connection = sqlite3.connect(args.input_rpd)
+connection = connect(args.input_rpd)
 
 outfile = open(args.output_html, 'w', encoding="utf-8")
 
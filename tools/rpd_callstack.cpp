@@ -0,0 +1,418 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+
+//
+// Build ext_callstack natively
+//
+// Native counterpart of rocpd/call_stacks.py.  Each (pid, tid) is swept on its
+// own worker: calls are nested by start/end, and every return yields the
+// caller chain plus the inclusive and exclusive cpu/gpu totals.  A single
+// writer inserts the rows thread by thread in one transaction.  --tables
+// writes the callStack_* aggregates as tables instead of views over
+// ext_callstack.
+//
+
+#include "RpdTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace rpdtrace;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-h] [--tables] [--tables-only] [--threads N] input_rpd\n\n"
+        "Generate call stack table to express caller/callee relation\n\n"
+        "  --tables       write callStack_inclusive/exclusive(_name) as tables rather than views\n"
+        "  --tables-only  write only the callStack_* tables, skip the per frame ext_callstack rows\n"
+        "  --threads N    threads swept concurrently (default: number of cpus)\n", prog);
+}
+
+namespace {
+
+struct Call
+{
+    sqlite3_int64 id;
+    sqlite3_int64 start;
+    sqlite3_int64 end;
+};
+
+struct ThreadCalls
+{
+    sqlite3_int64 pid;
+    sqlite3_int64 tid;
+    std::vector<Call> calls;
+};
+
+// One call in return order.  parent indexes the enclosing call's Return.
+struct Return
+{
+    sqlite3_int64 id;
+    sqlite3_int64 parent;
+    sqlite3_int64 cpu;          // exclusive
+    sqlite3_int64 gpu;          // own ops only
+};
+
+struct Totals
+{
+    sqlite3_int64 id;
+    sqlite3_int64 inclusiveCpu;
+    sqlite3_int64 inclusiveGpu;
+    sqlite3_int64 exclusiveCpu;
+    sqlite3_int64 exclusiveGpu;
+};
+
+struct ThreadResult
+{
+    std::vector<Return> returns;
+    std::vector<Totals> totals;
+    size_t maxDepth {0};
+};
+
+struct Frame
+{
+    size_t call;
+    sqlite3_int64 end;          // clamped to the caller's end
+    sqlite3_int64 childCpu {0};
+    sqlite3_int64 childGpu {0};
+    sqlite3_int64 gpu {0};
+};
+
+void sweep(ThreadCalls &thread, const std::unordered_map<sqlite3_int64, sqlite3_int64> &gpuTime, ThreadResult &out)
+{
+    auto &calls = thread.calls;
+    // Outer calls first when starts tie
+    std::sort(calls.begin(), calls.end(), [](const Call &a, const Call &b) {
+        if (a.start != b.start)
+            return a.start < b.start;
+        if (a.end != b.end)
+            return a.end > b.end;
+        return a.id < b.id;
+    });
+
+    out.returns.resize(calls.size());
+    out.totals.reserve(calls.size());
+
+    // Returns are numbered as they pop; a frame's children are patched with
+    // its slot once it pops too
+    std::vector<Frame> stack;
+    std::vector<std::vector<size_t>> pendingChildren;
+    size_t nextSlot = 0;
+
+    auto pop = [&]() {
+        Frame f = stack.back();
+        stack.pop_back();
+        const Call &c = calls[f.call];
+        const sqlite3_int64 duration = f.end - c.start;
+        Return &r = out.returns[nextSlot];
+        r.id = c.id;
+        r.parent = -1;
+        r.cpu = duration - f.childCpu;
+        r.gpu = f.gpu;
+        for (size_t child : pendingChildren[stack.size()])
+            out.returns[child].parent = nextSlot;
+        pendingChildren[stack.size()].clear();
+        if (!stack.empty()) {
+            Frame &parent = stack.back();
+            parent.childCpu += duration;
+            parent.childGpu += f.gpu + f.childGpu;
+            pendingChildren[stack.size() - 1].push_back(nextSlot);
+        }
+        out.totals.push_back({c.id, duration, f.gpu + f.childGpu, r.cpu, f.gpu});
+        ++nextSlot;
+    };
+
+    for (size_t i = 0; i < calls.size(); ++i) {
+        const Call &c = calls[i];
+        while (!stack.empty() && stack.back().end <= c.start)
+            pop();
+        Frame f;
+        f.call = i;
+        f.end = stack.empty() ? c.end : std::min(c.end, stack.back().end);
+        auto it = gpuTime.find(c.id);
+        if (it != gpuTime.end())
+            f.gpu = it->second;
+        stack.push_back(f);
+        if (pendingChildren.size() < stack.size())
+            pendingChildren.resize(stack.size());
+        out.maxDepth = std::max(out.maxDepth, stack.size());
+    }
+    while (!stack.empty())
+        pop();
+
+    std::vector<Call>().swap(calls);
+}
+
+// Same tags rocpd.metadata.Metadata reads and writes
+bool hasMeta(sqlite3 *db, const char *tag)
+{
+    Statement s(db, std::string("select value from rocpd_metadata where tag = '") + tag + "'");
+    return s.ok() && s.step();
+}
+
+bool setMeta(sqlite3 *db, const char *tag)
+{
+    return exec(db, std::string("delete from rocpd_metadata where tag = '") + tag + "'")
+        && exec(db, std::string("insert into rocpd_metadata (tag, value) values ('") + tag + "', 'True')");
+}
+
+std::string objectType(sqlite3 *db, const char *name)
+{
+    Statement s(db, std::string("select type from sqlite_master where name = '") + name + "'");
+    return (s.ok() && s.step()) ? s.text(0) : std::string();
+}
+
+const char *s_aggregates[] = {"callStack_inclusive", "callStack_exclusive", "callStack_inclusive_name", "callStack_exclusive_name"};
+
+const char *s_views[] = {
+    "CREATE VIEW IF NOT EXISTS callStack_inclusive as select parent_id, sum(cpu_time) as cpu_time, sum(gpu_time) as gpu_time from ext_callstack group by parent_id",
+    "CREATE VIEW IF NOT EXISTS callStack_exclusive as select parent_id, sum(cpu_time) as cpu_time, sum(gpu_time) as gpu_time from ext_callstack where depth = 0 group by parent_id",
+    "CREATE VIEW IF NOT EXISTS callStack_inclusive_name as select A.parent_id, B.apiName, B.args, sum(cpu_time) as cpu_time, sum(gpu_time) as gpu_time from ext_callstack A join api B on B.id = A.parent_id group by parent_id",
+    "CREATE VIEW IF NOT EXISTS callStack_exclusive_name as select A.parent_id, B.apiName, B.args, sum(cpu_time) as cpu_time, sum(gpu_time) as gpu_time from ext_callstack A join api B on B.id = A.parent_id where A.depth = 0 group by parent_id",
+};
+
+}  // namespace
+
+
+int main(int argc, char **argv)
+{
+    std::string input;
+    bool tables = false;
+    bool rows = true;
+    int threads = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--tables") == 0)
+            tables = true;
+        else if (strcmp(argv[i], "--tables-only") == 0)
+            tables = true, rows = false;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (argv[i][0] != '-' && input.empty())
+            input = argv[i];
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (input.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    sqlite3 *db = openDbForWrite(input);
+    if (db == nullptr)
+        return 1;
+
+    if (rows && hasMeta(db, "Callstack::Generated")) {
+        fprintf(stderr, "Callstack data has already been generated\n");
+        return 1;
+    }
+    if (tables) {
+        for (const char *name : s_aggregates) {
+            if (objectType(db, name) == "table") {
+                fprintf(stderr, "%s has already been materialized\n", name);
+                return 1;
+            }
+        }
+    }
+
+    // gpu time of each api's ops
+    std::unordered_map<sqlite3_int64, sqlite3_int64> gpuTime;
+    {
+        Statement s(db, "select A.api_id, sum(B.end - B.start) from rocpd_api_ops A join rocpd_op B on B.id = A.op_id group by A.api_id");
+        if (!s.ok()) {
+            fprintf(stderr, "%s\n", s.error().c_str());
+            return 1;
+        }
+        while (s.step())
+            gpuTime[s.i64(0)] = s.i64(1);
+    }
+
+    // Calls bucketed per thread, in the order threads first appear
+    std::vector<ThreadCalls> threadCalls;
+    size_t callCount = 0;
+    {
+        std::map<std::pair<sqlite3_int64, sqlite3_int64>, size_t> index;
+        Statement s(db, "select pid, tid, id, start, end from rocpd_api");
+        if (!s.ok()) {
+            fprintf(stderr, "%s\n", s.error().c_str());
+            return 1;
+        }
+        while (s.step()) {
+            auto key = std::make_pair(s.i64(0), s.i64(1));
+            auto it = index.find(key);
+            if (it == index.end()) {
+                it = index.emplace(key, threadCalls.size()).first;
+                threadCalls.push_back({key.first, key.second, {}});
+            }
+            threadCalls[it->second].calls.push_back({s.i64(2), s.i64(3), s.i64(4)});
+            ++callCount;
+        }
+    }
+
+    // Workers stay a bounded distance ahead of the writer
+    const size_t window = size_t(threads) * 2;
+    std::vector<std::unique_ptr<ThreadResult>> results(threadCalls.size());
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t written = 0;
+    std::atomic<size_t> next {0};
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads && size_t(t) < threadCalls.size(); ++t) {
+        pool.emplace_back([&]() {
+            size_t i;
+            while ((i = next++) < threadCalls.size()) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]() { return i < written + window; });
+                }
+                auto result = std::make_unique<ThreadResult>();
+                sweep(threadCalls[i], gpuTime, *result);
+                std::lock_guard<std::mutex> lock(mutex);
+                results[i] = std::move(result);
+                cv.notify_all();
+            }
+        });
+    }
+
+    bool ok = exec(db, "pragma synchronous = off") && exec(db, "begin")
+        && exec(db, "CREATE TABLE IF NOT EXISTS \"ext_callstack\" (\"id\" integer NOT NULL PRIMARY KEY AUTOINCREMENT, \"parent_id\" integer NOT NULL REFERENCES \"rocpd_api\" (\"id\") DEFERRABLE INITIALLY DEFERRED, \"child_id\" integer NOT NULL REFERENCES \"rocpd_api\" (\"id\") DEFERRABLE INITIALLY DEFERRED, \"depth\" integer NOT NULL, \"cpu_time\" integer NOT NULL DEFAULT 0, \"gpu_time\" integer NOT NULL DEFAULT 0)");
+
+    std::unique_ptr<Statement> insertRow;
+    if (ok && rows) {
+        insertRow = std::make_unique<Statement>(db, "insert into ext_callstack(parent_id, child_id, depth, cpu_time, gpu_time) values (?,?,?,?,?)");
+        if (!insertRow->ok()) {
+            fprintf(stderr, "%s\n", insertRow->error().c_str());
+            ok = false;
+        }
+    }
+
+    std::vector<Totals> totals;
+    size_t rowCount = 0;
+    std::vector<sqlite3_int64> chain;
+    for (size_t i = 0; i < threadCalls.size(); ++i) {
+        std::unique_ptr<ThreadResult> result;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return results[i] != nullptr; });
+            result = std::move(results[i]);
+        }
+
+        // One row per frame on the stack at each return, outermost first
+        for (const Return &r : result->returns) {
+            if (!ok || !rows)
+                break;
+            chain.clear();
+            for (sqlite3_int64 at = &r - result->returns.data(); at >= 0; at = result->returns[at].parent)
+                chain.push_back(result->returns[at].id);
+            sqlite3_stmt *stmt = insertRow->get();
+            for (size_t k = chain.size(); k-- > 0; ) {
+                sqlite3_bind_int64(stmt, 1, chain[k]);
+                sqlite3_bind_int64(stmt, 2, r.id);
+                sqlite3_bind_int64(stmt, 3, sqlite3_int64(k));
+                sqlite3_bind_int64(stmt, 4, r.cpu);
+                sqlite3_bind_int64(stmt, 5, r.gpu);
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    fprintf(stderr, "insert failed: %s\n", sqlite3_errmsg(db));
+                    ok = false;
+                    break;
+                }
+                sqlite3_reset(stmt);
+            }
+            rowCount += chain.size();
+        }
+        if (tables)
+            totals.insert(totals.end(), result->totals.begin(), result->totals.end());
+
+        printf("pid %lld  tid %lld  maxDepth %zu\n", (long long)threadCalls[i].pid, (long long)threadCalls[i].tid, result->maxDepth);
+        std::lock_guard<std::mutex> lock(mutex);
+        ++written;
+        cv.notify_all();
+    }
+    for (auto &t : pool)
+        t.join();
+    insertRow.reset();
+
+    if (ok && tables) {
+        std::sort(totals.begin(), totals.end(), [](const Totals &a, const Totals &b) { return a.id < b.id; });
+        for (const char *name : s_aggregates)
+            ok = ok && exec(db, std::string("DROP VIEW IF EXISTS ") + name);
+        ok = ok && exec(db, "CREATE TABLE callStack_inclusive (\"parent_id\" integer NOT NULL PRIMARY KEY, \"cpu_time\" integer NOT NULL, \"gpu_time\" integer NOT NULL)")
+            && exec(db, "CREATE TABLE callStack_exclusive (\"parent_id\" integer NOT NULL PRIMARY KEY, \"cpu_time\" integer NOT NULL, \"gpu_time\" integer NOT NULL)");
+        if (ok) {
+            Statement inclusive(db, "insert into callStack_inclusive(parent_id, cpu_time, gpu_time) values (?,?,?)");
+            Statement exclusive(db, "insert into callStack_exclusive(parent_id, cpu_time, gpu_time) values (?,?,?)");
+            for (const Totals &t : totals) {
+                for (auto *s : {&inclusive, &exclusive}) {
+                    sqlite3_stmt *stmt = s->get();
+                    const bool incl = (s == &inclusive);
+                    sqlite3_bind_int64(stmt, 1, t.id);
+                    sqlite3_bind_int64(stmt, 2, incl ? t.inclusiveCpu : t.exclusiveCpu);
+                    sqlite3_bind_int64(stmt, 3, incl ? t.inclusiveGpu : t.exclusiveGpu);
+                    if (sqlite3_step(stmt) != SQLITE_DONE) {
+                        fprintf(stderr, "insert failed: %s\n", sqlite3_errmsg(db));
+                        ok = false;
+                    }
+                    sqlite3_reset(stmt);
+                }
+                if (!ok)
+                    break;
+            }
+        }
+        ok = ok && exec(db, "CREATE TABLE callStack_inclusive_name AS select A.parent_id, B.apiName, B.args, A.cpu_time, A.gpu_time from callStack_inclusive A join api B on B.id = A.parent_id")
+            && exec(db, "CREATE TABLE callStack_exclusive_name AS select A.parent_id, B.apiName, B.args, A.cpu_time, A.gpu_time from callStack_exclusive A join api B on B.id = A.parent_id");
+    }
+    else if (ok) {
+        for (const char *view : s_views)
+            ok = ok && exec(db, view);
+    }
+
+    ok = ok && setMeta(db, "Callstack::Table");
+    if (rows)
+        ok = ok && setMeta(db, "Callstack::Generated");
+
+    if (!ok) {
+        exec(db, "rollback");
+        sqlite3_close(db);
+        return 1;
+    }
+    ok = exec(db, "commit");
+    sqlite3_close(db);
+
+    fprintf(stderr, "%zu calls on %zu threads, %zu ext_callstack rows%s\n", callCount, threadCalls.size(), rowCount, tables ? ", callStack_* tables written" : "");
+    return ok ? 0 : 1;
+}
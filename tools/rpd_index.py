@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+
+################################################################################
+# Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+################################################################################
+
+
+#
+# Build (or drop) the time-range indexes used by windowed queries in
+# rpd2tracing, rpd_trim and raptor
+#
+
+import sqlite3
+import argparse
+import time
+from rocpd.schema import RocpdSchema
+from rocpd.compress import isCompressed
+
+parser = argparse.ArgumentParser(description='Add B-tree indexes on event start times (and api<->op links) to an RPD file so --start/--end windows are range scans instead of full table scans')
+parser.add_argument('input_rpd', type=str, help="input rpd db")
+parser.add_argument('--drop', action='store_true', help="remove the indexes again")
+parser.add_argument('--list', action='store_true', help="list the indexes present and exit")
+args = parser.parse_args()
+
+if isCompressed(args.input_rpd):
+    raise Exception(f"{args.input_rpd} is compressed.  Indexing edits in place, unpack it first: python3 -m rocpd.compress unpack {args.input_rpd}")
+
+connection = sqlite3.connect(args.input_rpd)
+
+schema = RocpdSchema()
+statements = [s.strip() for s in schema.timeIndexSchema.split(';') if s.strip()]
+names = [s.split('"')[1] for s in statements]
+# The api_ops link indexes are also part of the full schema (index2Schema); --drop leaves those
+shared = set(s.split('"')[1] for s in (s.strip() for s in schema.index2Schema.split(';')) if s.upper().startswith("CREATE"))
+
+if args.list:
+    present = set(row[0] for row in connection.execute("select name from sqlite_master where type='index'"))
+    for name in names:
+        print(f"{name:40} {'present' if name in present else 'missing'}")
+    exit()
+
+total = time.time()
+for name, statement in zip(names, statements):
+    start = time.time()
+    if args.drop and name in shared:
+        print(f"{name:40} kept (part of the full schema)")
+        continue
+    try:
+        if args.drop:
+            connection.execute(f'DROP INDEX IF EXISTS "{name}"')
+        else:
+            connection.execute(statement)
+        connection.commit()
+    except sqlite3.OperationalError as e:
+        print(f"{name:40} skipped ({e})")
+        continue
+    print(f"{name:40} {'dropped' if args.drop else 'ok'} ({time.time() - start:.2f} s)")
+
+print(f"{'Dropped' if args.drop else 'Indexed'} in {time.time() - total:.2f} s")
+connection.close()
@@ -0,0 +1,50 @@
+################################################################################
+# Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+################################################################################
+
+
+#
+# Merge rpd files collected on several nodes into one trace.  Ids are remapped into
+# disjoint ranges, strings are shared, rows are tagged with a nodeId (see rocpd_node)
+# and times are aligned on the clock anchor each tracer records at start.
+#
+
+import argparse
+
+parser = argparse.ArgumentParser(description='Merge rpd files from several nodes into one, with disjoint ids and aligned clocks')
+parser.add_argument('output_rpd', type=str, help="merged rpd db")
+parser.add_argument('input_rpd', type=str, nargs='+', help="input rpd dbs, one per node")
+parser.add_argument('--names', type=str, help="comma separated node names, one per input (default: traced host name, else file name)")
+parser.add_argument('--no-align', dest='align', action='store_false', help="keep each input's timestamps as recorded")
+parser.add_argument('--jobs', type=int, default=0, help="inputs staged at once (default: number of cpus)")
+args = parser.parse_args()
+
+from rocpd.compress import isCompressed
+for path in args.input_rpd:
+    if isCompressed(path):
+        raise Exception(f"{path} is compressed.  Unpack it first: python3 -m rocpd.compress unpack {path}")
+names = args.names.split(',') if args.names else None
+if names and len(names) != len(args.input_rpd):
+    raise Exception(f"--names has {len(names)} names for {len(args.input_rpd)} inputs")
+
+from rocpd.merge import mergeFiles
+counts = mergeFiles(args.input_rpd, args.output_rpd, names, args.align, args.jobs)
+print(f"{counts.get('rocpd_api', 0)} api calls, {counts.get('rocpd_op', 0)} ops and {counts.get('rocpd_string', 0)} strings from {len(args.input_rpd)} nodes")
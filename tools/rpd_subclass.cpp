@@ -0,0 +1,330 @@
+/*********************************************************************************
+* Copyright (c) 2021 - 2023 Advanced Micro Devices, Inc. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+********************************************************************************/
+
+//
+// Create a subclass table exposing api args (or op descriptions) as columns
+//
+// Native counterpart of rocpd/subclass.py createSubclassTable().  Each distinct
+// args string is split once, on a pool of threads, which yields both the
+// column superset and the row values; column types are inferred from the
+// values.  Rows are then written in a single transaction.
+//
+
+#include "RpdTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace rpdtrace;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-h] [--type COLUMN=SQLTYPE]... [--threads N] input_rpd {api,op} subclass event [event ...]\n\n"
+        "Create rocpd_<subclass><api|op> exposing the 'key=value | key=value' args of the given\n"
+        "apis (or op descriptions of the given op types) as columns, plus a <subclass><api|op> view\n\n"
+        "  --type COLUMN=SQLTYPE  declared type for a column, overriding the inferred one\n"
+        "  --threads N            threads splitting args strings (default: number of cpus)\n", prog);
+}
+
+namespace {
+
+enum Kind { Empty, Integer, Real, Text };
+
+Kind classify(const std::string &v)
+{
+    if (v.empty())
+        return Empty;
+    // strtod also takes hex, inf and nan, which should stay text
+    if (v.find_first_not_of("0123456789+-.eE") != std::string::npos)
+        return Text;
+    // Leading zeros (ids, codes like 007) would be lost as numbers
+    const size_t digit = (v[0] == '+' || v[0] == '-') ? 1 : 0;
+    if (v.size() > digit + 1 && v[digit] == '0' && isdigit(v[digit + 1]))
+        return Text;
+    const char *s = v.c_str();
+    char *end = nullptr;
+    strtoll(s, &end, 10);
+    if (*end == '\0')
+        return Integer;
+    strtod(s, &end);
+    return *end == '\0' ? Real : Text;
+}
+
+Kind merge(Kind a, Kind b)
+{
+    if (a == Empty) return b;
+    if (b == Empty) return a;
+    if (a == b) return a;
+    if (a != Text && b != Text) return Real;
+    return Text;
+}
+
+struct Field
+{
+    std::string key;
+    std::string value;
+    Kind kind;
+};
+
+std::string trim(const std::string &s, const char *chars)
+{
+    size_t b = s.find_first_not_of(chars);
+    if (b == std::string::npos)
+        return std::string();
+    size_t e = s.find_last_not_of(chars);
+    return s.substr(b, e - b + 1);
+}
+
+// python: for line in s.split('|'): key, value = line.partition("=")[::2]
+void split(const std::string &s, std::vector<Field> &out)
+{
+    size_t pos = 0;
+    while (true) {
+        size_t bar = s.find('|', pos);
+        std::string line = s.substr(pos, bar == std::string::npos ? std::string::npos : bar - pos);
+        size_t eq = line.find('=');
+        Field f;
+        f.key = trim(trim(line.substr(0, eq), " \t\n\r\f\v"), "\"");
+        f.value = eq == std::string::npos ? std::string() : trim(line.substr(eq + 1), " \t\n\r\f\v");
+        f.kind = classify(f.value);
+        if (!f.key.empty() && f.key != "s_api" && f.key != "s_op")
+            out.push_back(std::move(f));
+        if (bar == std::string::npos)
+            break;
+        pos = bar + 1;
+    }
+}
+
+std::string quote(const std::string &s)
+{
+    std::string q = "'";
+    for (char c : s) {
+        q += c;
+        if (c == '\'')
+            q += '\'';
+    }
+    return q + "'";
+}
+
+std::string ident(const std::string &s)
+{
+    std::string q = "\"";
+    for (char c : s) {
+        q += c;
+        if (c == '"')
+            q += '"';
+    }
+    return q + "\"";
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv)
+{
+    std::map<std::string, std::string> types;
+    std::vector<std::string> positional;
+    int threads = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--type" && i + 1 < argc) {
+            std::string t = argv[++i];
+            size_t eq = t.find('=');
+            if (eq == std::string::npos) {
+                usage(argv[0]);
+                return 2;
+            }
+            types[t.substr(0, eq)] = t.substr(eq + 1);
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (arg.size() > 1 && arg[0] == '-') {
+            usage(argv[0]);
+            return 2;
+        }
+        else
+            positional.push_back(arg);
+    }
+    if (positional.size() < 4 || (positional[1] != "api" && positional[1] != "op")) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    const std::string &input = positional[0];
+    const std::string &baseClass = positional[1];
+    const std::string &subClass = positional[2];
+    const bool isApi = baseClass == "api";
+    const std::string table = "rocpd_" + subClass + baseClass;
+    const std::string ptr = isApi ? "api_ptr_id" : "op_ptr_id";
+
+    std::string events;
+    for (size_t i = 3; i < positional.size(); ++i)
+        events += (i > 3 ? "," : "") + quote(positional[i]);
+    const std::string rows = isApi
+        ? "select A.id, A.args_id as string_id from rocpd_api A where A.apiName_id in (select id from rocpd_string where string in (" + events + "))"
+        : "select A.id, A.description_id as string_id from rocpd_op A where A.opType_id in (select id from rocpd_string where string in (" + events + "))";
+
+    sqlite3 *db = openDbForWrite(input);
+    if (db == nullptr)
+        return 1;
+
+    // Each distinct args string, split once
+    std::vector<sqlite3_int64> stringIds;
+    std::vector<std::string> strings;
+    {
+        Statement s(db, "select id, string from rocpd_string where id in (select string_id from (" + rows + ")) order by id");
+        if (!s.ok()) {
+            fprintf(stderr, "%s\n", s.error().c_str());
+            return 1;
+        }
+        while (s.step()) {
+            stringIds.push_back(s.i64(0));
+            strings.push_back(s.text(1));
+        }
+    }
+
+    std::vector<std::vector<Field>> parsed(strings.size());
+    {
+        std::atomic<size_t> next {0};
+        const size_t block = 4096;
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t) {
+            pool.emplace_back([&]() {
+                size_t b;
+                while ((b = next.fetch_add(block)) < strings.size()) {
+                    for (size_t i = b; i < std::min(b + block, strings.size()); ++i) {
+                        split(strings[i], parsed[i]);
+                        std::string().swap(strings[i]);
+                    }
+                }
+            });
+        }
+        for (auto &t : pool)
+            t.join();
+    }
+
+    // Column superset in order of first appearance, typed from every value
+    std::vector<std::string> columns;
+    std::vector<Kind> kinds;
+    std::unordered_map<std::string, int> columnIndex;
+    std::vector<std::vector<std::pair<int, const std::string *>>> values(parsed.size());
+    for (size_t i = 0; i < parsed.size(); ++i) {
+        for (const Field &f : parsed[i]) {
+            auto it = columnIndex.find(f.key);
+            if (it == columnIndex.end()) {
+                it = columnIndex.emplace(f.key, int(columns.size())).first;
+                columns.push_back(f.key);
+                kinds.push_back(Empty);
+            }
+            kinds[it->second] = merge(kinds[it->second], f.kind);
+            values[i].push_back({it->second, &f.value});
+        }
+    }
+
+    std::string create = "create table if not exists " + ident(table) + " (" + ident(ptr) + " integer NOT NULL PRIMARY KEY REFERENCES "
+        + ident(isApi ? "rocpd_api" : "rocpd_op") + " (\"id\") DEFERRABLE INITIALLY DEFERRED";
+    std::string insert = "insert into " + ident(table) + "(" + ident(ptr);
+    std::string params = "?";
+    // Missing values: '' for text columns as subclass.py writes, NULL for numbers
+    std::vector<bool> emptyIsNull(columns.size());
+    for (size_t c = 0; c < columns.size(); ++c) {
+        std::string type;
+        auto t = types.find(columns[c]);
+        if (t != types.end())
+            type = t->second;
+        else if (kinds[c] == Integer)
+            type = "integer";
+        else if (kinds[c] == Real)
+            type = "real";
+        else
+            type = "varchar(255)";
+        emptyIsNull[c] = t == types.end() && (kinds[c] == Integer || kinds[c] == Real);
+        create += ", " + ident(columns[c]) + " " + type;
+        insert += "," + ident(columns[c]);
+        params += ",?";
+    }
+    create += ")";
+    insert += ") values (" + params + ")";
+
+    bool ok = exec(db, "begin") && exec(db, create);
+    size_t count = 0;
+    if (ok) {
+        Statement ins(db, insert);
+        Statement s(db, rows);
+        if (!ins.ok() || !s.ok()) {
+            fprintf(stderr, "%s\n", (ins.ok() ? s : ins).error().c_str());
+            ok = false;
+        }
+        sqlite3_stmt *stmt = ins.get();
+        while (ok && s.step()) {
+            auto at = std::lower_bound(stringIds.begin(), stringIds.end(), s.i64(1));
+            sqlite3_bind_int64(stmt, 1, s.i64(0));
+            for (size_t c = 0; c < columns.size(); ++c) {
+                if (emptyIsNull[c])
+                    sqlite3_bind_null(stmt, int(c) + 2);
+                else
+                    sqlite3_bind_text(stmt, int(c) + 2, "", 0, SQLITE_STATIC);
+            }
+            if (at != stringIds.end() && *at == s.i64(1)) {
+                // later duplicates of a key win, like the python dict
+                for (auto &v : values[at - stringIds.begin()]) {
+                    if (v.second->empty() && emptyIsNull[v.first])
+                        sqlite3_bind_null(stmt, v.first + 2);
+                    else
+                        sqlite3_bind_text(stmt, v.first + 2, v.second->data(), int(v.second->size()), SQLITE_STATIC);
+                }
+            }
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                fprintf(stderr, "insert into %s failed: %s\n", table.c_str(), sqlite3_errmsg(db));
+                ok = false;
+            }
+            sqlite3_reset(stmt);
+            ++count;
+        }
+    }
+
+    const std::string base = isApi ? "api" : "op";
+    ok = ok && exec(db, "create view if not exists " + ident(subClass + baseClass) + " as select * from " + base + " A join "
+                        + ident(table) + " B on B." + ptr + "=A.id");
+    ok = ok && exec(db, "commit");
+    if (!ok)
+        exec(db, "rollback");
+    sqlite3_close(db);
+    if (!ok)
+        return 1;
+
+    fprintf(stderr, "%s: %zu rows, %zu columns from %zu distinct strings\n", table.c_str(), count, columns.size(), parsed.size());
+    return 0;
+}
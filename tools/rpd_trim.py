@@ -32,8 +32,13 @@ parser.add_argument('input_rpd', type=str, help="input rpd db")
 parser.add_argument('--start', type=str, help="start time - default ns or percentage %%. Number only is interpreted as ns. Number with %% is interpreted as percentage. Number with leading '+' is interpreted as delta from the start time.")
 parser.add_argument('--end', type=str, help="end time - default ns or percentage %%. See help for --start")
 parser.add_argument('--dryrun', action=argparse.BooleanOptionalAction, help="compute range but take no action")
+parser.add_argument('--output', type=str, help="write the trimmed trace here and leave input_rpd untouched (default: trim in place)")
 args = parser.parse_args()
 
+from rocpd.compress import isCompressed
+if isCompressed(args.input_rpd):
+    raise Exception(f"{args.input_rpd} is compressed.  Unpack it first: python3 -m rocpd.compress unpack {args.input_rpd}")
+
 connection = sqlite3.connect(args.input_rpd)
 
 min_time = connection.execute("select MIN(start) from rocpd_api;").fetchall()[0][0]
@@ -80,10 +85,13 @@ print()
 print(f"Trimmed range:    {start_time} --> {end_time}")
 print(f"Trimmed duration: {(end_time-start_time)/1000000000} seconds")
 
+# Count what is kept with a single range on start (an index range scan once
+# rpd_index.py has run) rather than the two open-ended ranges being removed
 apiCount = connection.execute("select count(*) from rocpd_api").fetchall()[0][0]
-apiRemoveCount = connection.execute("select count(*) from rocpd_api where start < %s or start > %s"%(start_time, end_time)).fetchall()[0][0]
+apiRemoveCount = apiCount - connection.execute("select count(*) from rocpd_api where start between %s and %s"%(start_time, end_time)).fetchall()[0][0]
 opCount = connection.execute("select count(*) from rocpd_op").fetchall()[0][0]
-opRemoveCount = connection.execute("select count(*) from rocpd_api A join rocpd_api_ops B on B.api_id = A.id where A.start < %s or A.start > %s"%(start_time, end_time)).fetchall()[0][0]
+# Op rows, not links: an op can have several links or none, and links can dangle
+opRemoveCount = opCount - connection.execute("select count(*) from rocpd_op where id in (select B.op_id from rocpd_api A join rocpd_api_ops B on B.api_id = A.id where A.start between %s and %s)"%(start_time, end_time)).fetchall()[0][0]
 print()
 print(f"Removing {apiRemoveCount} of {apiCount} api calls.  {apiCount - apiRemoveCount} remaining")
 print(f"Removing {opRemoveCount} of {opCount} async ops.  {opCount - opRemoveCount} remaining")
@@ -92,27 +100,15 @@ if args.dryrun:
     print("Dry run, exiting")
     exit()
 
-connection.execute("delete from rocpd_api where start < %s or start > %s"%(start_time, end_time))
-connection.execute("delete from rocpd_api_ops where api_id not in (select id from rocpd_api)")
-connection.execute("delete from rocpd_op where id not in (select op_id from rocpd_api_ops)")
-try:
-    connection.execute("delete from rocpd_monitor where start < (select min(start) from rocpd_api) or start > (select max(end) from rocpd_op)")
-except:
-    pass
-
-connection.commit()
-
-#clear any unused strings
-stringCount = connection.execute("select count(*) from rocpd_string").fetchall()[0][0]
-from rocpd.importer import RocpdImportData
-from rocpd.strings import cleanStrings
-importData = RocpdImportData()
-importData.resumeExisting(connection) # load the current db state
-cleanStrings(importData, False)
-stringRemaingCount = connection.execute("select count(*) from rocpd_string").fetchall()[0][0]
-print(f"Removed {stringCount - stringRemaingCount} of {stringCount} strings.  {stringRemaingCount} remaining")
-
-connection.isolation_level = None
-connection.execute("vacuum")
-connection.commit()
 connection.close()
+
+# Copy the window forward into a new file rather than delete + vacuum
+from rocpd.trim import trimToWindow, trimInPlace
+if args.output:
+    counts = trimToWindow(args.input_rpd, args.output, start_time, end_time, verbose=False)
+else:
+    counts = trimInPlace(args.input_rpd, start_time, end_time, verbose=False)
+
+if "rocpd_string" in counts:
+    stringRemaingCount, stringCount = counts["rocpd_string"]
+    print(f"Removed {stringCount - stringRemaingCount} of {stringCount} strings.  {stringRemaingCount} remaining")
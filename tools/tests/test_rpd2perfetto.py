@@ -0,0 +1,100 @@
+import os
+import gzip
+import shutil
+import sqlite3
+import subprocess
+from collections import Counter
+
+import pytest
+
+(test_path, test_file) = os.path.split(__file__)
+rpd_file = os.path.join(test_path, "../../raptor/tests/mytrace.rpd.gz")
+rpd2perfetto = os.path.join(test_path, "../rpd2perfetto")
+
+# Track kinds from rpd2perfetto.cpp
+kQueue = 2
+kLane = 11
+
+
+def varint(buf, pos):
+    value = shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7f) << shift
+        shift += 7
+        if b < 0x80:
+            return value, pos
+
+def fields(buf):
+    pos = 0
+    while pos < len(buf):
+        tag, pos = varint(buf, pos)
+        field, wire = tag >> 3, tag & 7
+        if wire == 0:
+            value, pos = varint(buf, pos)
+        elif wire == 1:
+            value, pos = buf[pos:pos + 8], pos + 8
+        elif wire == 2:
+            size, pos = varint(buf, pos)
+            value, pos = buf[pos:pos + size], pos + size
+        elif wire == 5:
+            value, pos = buf[pos:pos + 4], pos + 4
+        else:
+            raise ValueError(f"wire type {wire}")
+        yield field, value
+
+def opSlices(path):
+    """ (gpuId, queueId, start, end) of every op slice, closed the way perfetto does """
+    events = []
+    with open(path, 'rb') as f:
+        trace = f.read()
+    for field, packet in fields(trace):
+        if field != 1:
+            continue
+        ts = event = None
+        for f, v in fields(packet):
+            if f == 8:
+                ts = v
+            elif f == 11:
+                event = dict((k, x) for k, x in fields(v) if k in (9, 11))
+        if event and event.get(11, 0) >> 56 in (kQueue, kLane) and event.get(9) in (1, 2):
+            events.append((ts, len(events), event[9], event[11]))
+
+    # Slice ends close the newest open slice on the track
+    slices = []
+    stacks = {}
+    for ts, _, kind, uuid in sorted(events):
+        stack = stacks.setdefault(uuid, [])
+        if kind == 1:
+            stack.append(ts)
+        else:
+            gpuId = (uuid >> 32) & 0xffffff
+            queueId = uuid & 0xffffffff
+            if uuid >> 56 == kLane:
+                queueId >>= 16
+            slices.append((gpuId, queueId, stack.pop(), ts))
+    return slices
+
+
+@pytest.fixture(scope="module")
+def trace(tmp_path_factory):
+    if not os.path.exists(rpd2perfetto):
+        pytest.skip("rpd2perfetto not built, run make -C tools")
+    tmp = tmp_path_factory.mktemp("perfetto")
+    rpd = str(tmp / "mytrace.rpd")
+    with gzip.open(rpd_file, 'rb') as src, open(rpd, 'wb') as dst:
+        shutil.copyfileobj(src, dst)
+    out = str(tmp / "mytrace.pftrace")
+    subprocess.run([rpd2perfetto, rpd, out], check=True, stdout=subprocess.DEVNULL)
+    return rpd, out
+
+def test_op_durations(trace):
+    rpd, out = trace
+    connection = sqlite3.connect(rpd)
+    expected = Counter(connection.execute("select gpuId, queueId, rocpd_op.start, rocpd_op.end from rocpd_op LEFT JOIN rocpd_api_ops on rocpd_api_ops.op_id = rocpd_op.id").fetchall())
+    overlapping = connection.execute("select count(distinct A.id) from rocpd_op A join rocpd_op B on A.gpuId = B.gpuId and A.queueId = B.queueId and A.id != B.id and B.start > A.start and B.start < A.end and B.end > A.end").fetchone()[0]
+    connection.close()
+
+    assert overlapping > 0      # the trace exercises partly overlapping ops
+    assert Counter(opSlices(out)) == expected